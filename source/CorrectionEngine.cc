@@ -0,0 +1,408 @@
+#include "CorrectionEngine.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+// FNV-1a continued from hash, as in CorrectionTables::GetVersion()
+template <class T>
+void hashvalue(uint64_t &hash, const T &value) {
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+  for (size_t i = 0; i < sizeof(T); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+}
+} // namespace
+
+//____________________________________________________________________________..
+CorrectionEngine::CorrectionEngine() = default;
+
+//____________________________________________________________________________..
+CorrectionEngine::~CorrectionEngine() = default;
+
+//____________________________________________________________________________..
+void CorrectionEngine::CopySettings(const CorrectionEngine &other) {
+  m_verbosity = other.m_verbosity;
+  rapiditydep = other.rapiditydep;
+  mineta = other.mineta;
+  maxeta = other.maxeta;
+  reweightheavierbaryons = other.reweightheavierbaryons;
+  m_useweightgrid = other.m_useweightgrid;
+  m_gridptnodes = other.m_gridptnodes;
+  m_gridtolerance = other.m_gridtolerance;
+  m_kernelisa = other.m_kernelisa;
+  m_species = other.m_species;
+}
+
+//____________________________________________________________________________..
+uint64_t CorrectionEngine::GetVersion() const {
+  uint64_t hash = m_tables ? m_tables->GetVersion(rapiditydep) : 0;
+  hashvalue(hash, (int) rapiditydep);
+  hashvalue(hash, mineta);
+  hashvalue(hash, maxeta);
+  // the grid approximates the histograms within its tolerance
+  hashvalue(hash, (int) m_useweightgrid);
+  if (m_useweightgrid) {
+    hashvalue(hash, m_gridptnodes);
+    hashvalue(hash, m_gridtolerance);
+  }
+  // how every species is built, and which pids it covers
+  for (int i = 0; i < m_species.GetNSpecies(); i++) {
+    const SpeciesRegistry::Species &sp = m_species.GetSpecies(i);
+    hashvalue(hash, sp.ncomponents);
+    for (int j = 0; j < sp.ncomponents; j++) {
+      const SpeciesRegistry::Component &comp = sp.components[j];
+      hashvalue(hash, comp.table);
+      hashvalue(hash, comp.fraction);
+      hashvalue(hash, comp.raptable);
+      hashvalue(hash, comp.rapnorm);
+    }
+    hashvalue(hash, (int) (sp.heavierbaryon && !reweightheavierbaryons));
+  }
+  for (int pid = -SpeciesRegistry::maxpdg; pid <= SpeciesRegistry::maxpdg;
+       pid++)
+    hashvalue(hash, m_species.Index(pid));
+  return hash;
+}
+
+//____________________________________________________________________________..
+void CorrectionEngine::SetTables(
+    const std::shared_ptr<const CorrectionTables> &tables) {
+  m_tables = tables;
+  m_owntables.reset();
+}
+
+//____________________________________________________________________________..
+CorrectionTables &CorrectionEngine::owntables() {
+  // copy on write, shared tables are never modified
+  if (!m_owntables) {
+    m_owntables = m_tables ? std::make_shared<CorrectionTables>(m_tables)
+                           : std::make_shared<CorrectionTables>();
+    m_tables = m_owntables;
+  }
+  return *m_owntables;
+}
+
+//____________________________________________________________________________..
+bool CorrectionEngine::Init() {
+  if (!m_species.Build()) {
+    std::cout << "CorrectionEngine::Init() invalid species registry"
+              << std::endl;
+    return false;
+  }
+  if (m_verbosity > 0)
+    m_species.identify();
+
+  for (int table = 0; table < SpeciesRegistry::ntables; table++) {
+    for (int i = 0; i < ncentbins; i++) {
+      h_ratio[table][i] = m_tables ? m_tables->GetPtTable(table, i) : nullptr;
+      if (!h_ratio[table][i]) {
+        std::cout << "CorrectionEngine::Init() the "
+                  << SpeciesRegistry::GetTableName(table)
+                  << " tables are not set" << std::endl;
+        return false;
+      }
+    }
+  }
+  for (int centclass = 0; centclass < SpeciesRegistry::ncentclasses;
+       centclass++)
+    avgcentclass[centclass] = m_tables->GetCentralityAverages(centclass);
+  for (int raptable = 0; raptable < SpeciesRegistry::nraptables; raptable++)
+    h_rapratio[raptable] = m_tables->GetRapidityShape(raptable);
+  if (rapiditydep && !HasRapidityTables()) {
+    std::cout << "CorrectionEngine::Init() rapidity dependent correction "
+                 "without rapidity tables"
+              << std::endl;
+    return false;
+  }
+  buildcentralityweights();
+
+  if (rapiditydep) {
+      for (int raptable = 0; raptable < SpeciesRegistry::nraptables; raptable++) {
+        // normalisations and interval centers never change, compute them once
+        m_rapnorm[raptable] = h_rapratio[raptable]->Interpolate(0);
+        m_invrapnorm[raptable] = 1. / m_rapnorm[raptable];
+        const std::vector<std::vector<float>> &intervals =
+            CorrectionTables::GetRapidityIntervals(raptable);
+        m_meanrapidity[raptable].clear();
+        for (const std::vector<float> &interval : intervals) {
+          m_meanrapidity[raptable].push_back(std::abs(interval[0] + interval[1]) / 2);
+        }
+      }
+  }
+
+  m_gridnpart = -1;
+  if (m_useweightgrid) {
+    buildweightgrid();
+    if (!checkweightgrid()) {
+      std::cout << "CorrectionEngine::Init() "
+                   "weight grid deviates from the histograms by more than "
+                << m_gridtolerance << ", falling back to the histograms"
+                << std::endl;
+      m_useweightgrid = false;
+      m_centgrid.Reset();
+      m_eventgrid.Reset();
+      m_rapgrid.Reset();
+    }
+  }
+  if (m_useweightgrid)
+    compileweightkernel();
+  return true;
+}
+
+//____________________________________________________________________________..
+void CorrectionEngine::buildweightgrid() {
+  // cover every bin center of the pt correction histograms, beyond them
+  // TH1F::Interpolate returns the edge bin content and so does the grid
+  float ptmin = 0;
+  float ptmax = 0;
+  float minwidth = 0;
+  bool first = true;
+  for (int table = 0; table < SpeciesRegistry::ntables; table++) {
+    const TableHist *const *h = h_ratio[table];
+    for (int i = 0; i < ncentbins; i++) {
+      int nbins = h[i]->GetNbinsX();
+      float lo = h[i]->GetBinCenter(1);
+      float hi = h[i]->GetBinCenter(nbins);
+      if (first) {
+        ptmin = lo;
+        ptmax = hi;
+        minwidth = h[i]->GetBinWidth(1);
+        first = false;
+      }
+      ptmin = std::min(ptmin, lo);
+      ptmax = std::max(ptmax, hi);
+      for (int ibin = 1; ibin <= nbins; ibin++)
+        minwidth = std::min(minwidth, (float) h[i]->GetBinWidth(ibin));
+    }
+  }
+  if (!(ptmax > ptmin))
+    ptmax = ptmin + 1;
+
+  // four nodes per finest histogram bin unless set explicitly
+  int nptnodes = m_gridptnodes;
+  if (nptnodes <= 1) {
+    nptnodes = 4 * (ptmax - ptmin) / minwidth + 1;
+    if (nptnodes > gridmaxptnodes)
+      nptnodes = gridmaxptnodes;
+    if (nptnodes < 2)
+      nptnodes = 2;
+  }
+
+  m_centgrid.Build(SpeciesRegistry::ntables * ncentbins, ptmin, ptmax,
+                   nptnodes, [this](int row, float pt) {
+                     return h_ratio[row / ncentbins][row % ncentbins]
+                         ->Interpolate(pt);
+                   });
+  // one more row of ones for the batch kernel terms without pt dependence
+  m_eventgrid.Build(SpeciesRegistry::ntables + 1, ptmin, ptmax, nptnodes,
+                    [](int, float) { return 1.f; });
+  m_gridnpart = -1;
+
+  if (rapiditydep) {
+    // same for the |y| shapes
+    float ymin = 0;
+    float ymax = 0;
+    float minywidth = 0;
+    for (int raptable = 0; raptable < SpeciesRegistry::nraptables;
+         raptable++) {
+      const TableHist *h = h_rapratio[raptable];
+      int nbins = h->GetNbinsX();
+      if (raptable == 0) {
+        ymin = h->GetBinCenter(1);
+        ymax = h->GetBinCenter(nbins);
+        minywidth = h->GetBinWidth(1);
+      }
+      ymin = std::min(ymin, (float) h->GetBinCenter(1));
+      ymax = std::max(ymax, (float) h->GetBinCenter(nbins));
+      for (int ibin = 1; ibin <= nbins; ibin++)
+        minywidth = std::min(minywidth, (float) h->GetBinWidth(ibin));
+    }
+    // |y| is never negative
+    ymin = std::max(ymin, 0.f);
+    if (!(ymax > ymin))
+      ymax = ymin + 1;
+    int nynodes = 4 * (ymax - ymin) / minywidth + 1;
+    nynodes = std::max(2, std::min(nynodes, (int) gridmaxptnodes));
+    m_rapgrid.Build(SpeciesRegistry::nraptables + 1, ymin, ymax, nynodes,
+                    [this](int raptable, float absy) {
+                      if (raptable == SpeciesRegistry::nraptables)
+                        return 1.f;
+                      return (float) h_rapratio[raptable]->Interpolate(absy);
+                    });
+    if (m_verbosity > 0)
+      std::cout << "CorrectionEngine::buildweightgrid() "
+                << SpeciesRegistry::nraptables << " |y| shapes x " << nynodes
+                << " nodes in [" << ymin << ", " << ymax << "]" << std::endl;
+  }
+
+  if (m_verbosity > 0)
+    std::cout << "CorrectionEngine::buildweightgrid() "
+              << SpeciesRegistry::ntables << " tables x " << ncentbins
+              << " centralities x " << nptnodes << " pt nodes in [" << ptmin
+              << ", " << ptmax << "] GeV, "
+              << (m_centgrid.GetMemorySize() + m_eventgrid.GetMemorySize()) /
+                     1024
+              << " kB" << std::endl;
+}
+
+//____________________________________________________________________________..
+void CorrectionEngine::collapseweightgrid(int npart) {
+  // one pt curve per table for this npart, the hits then need a single
+  // interpolation instead of one per centrality class
+  const int nptnodes = m_eventgrid.GetNPtNodes();
+  for (int table = 0; table < SpeciesRegistry::ntables; table++) {
+    const float *weight =
+        centweights(npart, SpeciesRegistry::GetCentClass(table));
+    float *curve = m_eventgrid.GetRow(table);
+    for (int ipt = 0; ipt < nptnodes; ipt++)
+      curve[ipt] = 0;
+    for (int i = 0; i < ncentbins; i++) {
+      if (weight[i] == 0)
+        continue;
+      const float *nodes = m_centgrid.GetRow(table * ncentbins + i);
+      for (int ipt = 0; ipt < nptnodes; ipt++)
+        curve[ipt] += weight[i] * nodes[ipt];
+    }
+  }
+  m_gridnpart = npart;
+}
+
+//____________________________________________________________________________..
+bool CorrectionEngine::checkweightgrid() {
+  // compare grid and histogram path off the grid nodes, including pt outside
+  // the sampled range where both are expected to clamp
+  const int ncheckpt = 397;
+  const float ptlo = m_centgrid.GetPtMin() - 0.5;
+  const float pthi = 1.2 * m_centgrid.GetPtMax();
+  float maxabs = 0;
+  float maxrel = 0;
+  int worstspecies = 0;
+  int worstnpart = 0;
+  float worstpt = 0;
+  for (int npart = 0; npart <= maxnpart; npart += 7) {
+    collapseweightgrid(npart);
+    for (int species = 0; species < m_species.GetNSpecies(); species++) {
+      for (int ipt = 0; ipt < ncheckpt; ipt++) {
+        float pt = ptlo + (pthi - ptlo) * (ipt + 0.37) / ncheckpt;
+        float ref = speciescorrection(species, npart, pt, 0, false, false);
+        float grid = speciescorrection(species, npart, pt, 0, false, true);
+        float diff = std::abs(grid - ref);
+        float rel = diff / std::max(std::abs(ref), 1e-6f);
+        maxabs = std::max(maxabs, diff);
+        if (rel > maxrel) {
+          maxrel = rel;
+          worstspecies = species;
+          worstnpart = npart;
+          worstpt = pt;
+        }
+      }
+    }
+  }
+  if (rapiditydep) {
+    // coarser in npart and pt, the |y| shapes do not depend on them
+    const int nchecky = 41;
+    const float yhi = 1.2 * m_rapgrid.GetPtMax();
+    for (int npart = 0; npart <= maxnpart; npart += 49) {
+      collapseweightgrid(npart);
+      for (int species = 0; species < m_species.GetNSpecies(); species++) {
+        for (int ipt = 0; ipt < ncheckpt; ipt += 4) {
+          float pt = ptlo + (pthi - ptlo) * (ipt + 0.37) / ncheckpt;
+          for (int iy = 0; iy < nchecky; iy++) {
+            float absy = yhi * (iy + 0.29) / nchecky;
+            float ref =
+                speciescorrection(species, npart, pt, absy, true, false);
+            float grid =
+                speciescorrection(species, npart, pt, absy, true, true);
+            float diff = std::abs(grid - ref);
+            float rel = diff / std::max(std::abs(ref), 1e-6f);
+            maxabs = std::max(maxabs, diff);
+            if (rel > maxrel) {
+              maxrel = rel;
+              worstspecies = species;
+              worstnpart = npart;
+              worstpt = pt;
+            }
+          }
+        }
+      }
+    }
+  }
+  m_gridnpart = -1;
+  if (m_verbosity > 0 || maxrel > m_gridtolerance)
+    std::cout << "CorrectionEngine::checkweightgrid() max abs deviation "
+              << maxabs << ", max rel deviation " << maxrel << " ("
+              << m_species.GetSpecies(worstspecies).name << ", npart "
+              << worstnpart << ", pt " << worstpt << ")" << std::endl;
+  return maxrel <= m_gridtolerance;
+}
+
+//____________________________________________________________________________..
+void CorrectionEngine::buildcentralityweights() {
+  for (int centclass = 0; centclass < SpeciesRegistry::ncentclasses;
+       centclass++) {
+    assert(avgcentclass[centclass][0] <= maxnpart);
+    for (int npart = 0; npart <= maxnpart; npart++) {
+      centralityweights(npart, centclass, m_centweights[centclass][npart]);
+    }
+  }
+}
+
+//____________________________________________________________________________..
+void CorrectionEngine::compileweightkernel() {
+  // every species becomes two (pt row, |y| row, fraction, 1/norm) terms,
+  // unused parts point to the rows of ones
+  const int unitptrow = SpeciesRegistry::ntables;
+  const int unityrow = SpeciesRegistry::nraptables;
+  m_kernel.SetPtCurves(&m_eventgrid);
+  m_kernel.SetRapidityShapes(rapiditydep ? &m_rapgrid : nullptr);
+  m_kernel.SetEtaRange(mineta, maxeta);
+  m_kernel.ClearSpecies();
+  for (int species = 0; species < m_species.GetNSpecies(); species++) {
+    const SpeciesRegistry::Species &sp = m_species.GetSpecies(species);
+    bool ptdep = !sp.heavierbaryon || reweightheavierbaryons;
+    WeightKernel::Term terms[2];
+    for (int i = 0; i < 2; i++) {
+      terms[i].ptrow = unitptrow;
+      terms[i].yrow = unityrow;
+      terms[i].fraction = 0;
+      if (i >= sp.ncomponents)
+        continue;
+      const SpeciesRegistry::Component &comp = sp.components[i];
+      terms[i].fraction = comp.fraction;
+      if (ptdep)
+        terms[i].ptrow = comp.table;
+      if (comp.raptable >= 0) {
+        terms[i].yrow = comp.raptable;
+        terms[i].invnorm = m_invrapnorm[comp.rapnorm];
+      }
+    }
+    m_kernel.AddSpecies(terms[0], terms[1]);
+  }
+  m_kernel.Compile(unitptrow, unityrow);
+  m_kernel.SetIsa(m_kernelisa);
+  if (m_verbosity > 0)
+    std::cout << "CorrectionEngine::compileweightkernel() using the "
+              << WeightKernel::GetIsaName(m_kernel.GetIsa()) << " kernel"
+              << std::endl;
+}
+
+//____________________________________________________________________________..
+bool CorrectionEngine::Accept(double px, double py, double pz, double e,
+                              Kinematics &kin) const {
+  // get particle pid and pt
+  float pt = sqrt(px * px + py * py);
+
+  float p = sqrt(pt * pt + pz * pz);
+  float eta = 0.5 * log((p + pz) / (p - pz));
+
+  kin.pt = pt;
+  kin.eta = eta;
+  if (eta < mineta || eta > maxeta)
+    return false;
+  if (rapiditydep)
+    kin.y = 0.5 * log((e + pz) / (e - pz));
+  return true;
+}
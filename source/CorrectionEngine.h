@@ -0,0 +1,397 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef CORRECTIONENGINE_H
+#define CORRECTIONENGINE_H
+
+#include "CorrectionTables.h"
+#include "SpeciesRegistry.h"
+#include "TableHist.h"
+#include "WeightGrid.h"
+#include "WeightKernel.h"
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+class TH1F;
+
+// The weight of a primary from its pid and kinematics, without any Fun4All
+// dependence. The correction tables are either shared read-only ones from
+// CorrectionTables::Acquire() or loaded/set through the engine into its own
+// copy; Init() then derives the centrality weights, the lookup grids and the
+// batch kernel from them.
+class CorrectionEngine
+{
+public:
+    static const int ncentbins = CorrectionTables::ncentbins;
+    // Npart range of the precomputed centrality weights, 2 x 197 for Au+Au;
+    // above it the weights no longer change
+    static const int maxnpart = 394;
+
+    CorrectionEngine();
+    ~CorrectionEngine();
+
+    CorrectionEngine(const CorrectionEngine &) = delete;
+    CorrectionEngine &operator=(const CorrectionEngine &) = delete;
+
+    void SetVerbosity(int verbosity) { m_verbosity = verbosity; }
+
+    void SetRapidityDep(bool rapidity = true) { rapiditydep = rapidity; }
+    bool GetRapidityDep() const { return rapiditydep; }
+
+    void SetMinEta(float min) { mineta = min; }
+    void SetMaxEta(float max) { maxeta = max; }
+    float GetMinEta() const { return mineta; }
+    float GetMaxEta() const { return maxeta; }
+
+    void SetReweightHeavierBaryons(bool reweight) { reweightheavierbaryons = reweight; }
+    bool GetReweightHeavierBaryons() const { return reweightheavierbaryons; }
+
+    // see EnergyCorrection::SetUseWeightGrid()
+    void SetUseWeightGrid(bool use = true) { m_useweightgrid = use; }
+    bool GetUseWeightGrid() const { return m_useweightgrid; }
+    void SetWeightGridPtNodes(int n) { m_gridptnodes = n; }
+    void SetWeightGridTolerance(float tol) { m_gridtolerance = tol; }
+
+    void SetKernelIsa(WeightKernel::Isa isa) { m_kernelisa = isa; }
+
+    // eta range, rapidity mode, grid, kernel and species rules of other,
+    // not its tables; for engines evaluating variants of the same correction
+    void CopySettings(const CorrectionEngine &other);
+
+    SpeciesRegistry &GetSpeciesRegistry() { return m_species; }
+    const SpeciesRegistry &GetSpeciesRegistry() const { return m_species; }
+
+    // use these tables, e.g. the shared ones from CorrectionTables::Acquire();
+    // the loaders and setters below then work on a private copy on top of them
+    void SetTables(const std::shared_ptr<const CorrectionTables> &tables);
+    const std::shared_ptr<const CorrectionTables> &GetTables() const { return m_tables; }
+
+    // see CorrectionTables
+    bool LoadPtTables(const std::string &generatortype, const std::string &directory = CorrectionTables::defaulttabledir)
+    {
+        return owntables().LoadPtTables(generatortype, directory);
+    }
+    bool SetGeneratorType(const std::string &generatortype) { return owntables().SetGeneratorType(generatortype); }
+    bool LoadRapidityTables(const std::string &filename = CorrectionTables::defaultrapfile)
+    {
+        return owntables().LoadRapidityTables(filename);
+    }
+    void SetPtTable(int table, int centbin, const TH1F *h) { owntables().SetPtTable(table, centbin, h); }
+    void SetCentralityAverages(int centclass, const float *avg) { owntables().SetCentralityAverages(centclass, avg); }
+    void SetRapidityTable(int raptable, const TH1F *ratio, TH1F *const *intervalhists)
+    {
+        owntables().SetRapidityTable(raptable, ratio, intervalhists);
+    }
+    int GetNRapidityIntervals(int raptable) const { return CorrectionTables::GetNRapidityIntervals(raptable); }
+    bool LoadTableFile(const std::string &filename, const std::string &generatortype)
+    {
+        return owntables().LoadTableFile(filename, generatortype, m_verbosity);
+    }
+    bool WriteTableFile(const std::string &filename, const std::string &generatortype) const
+    {
+        return m_tables && m_tables->WriteTableFile(filename, generatortype);
+    }
+    bool HasRapidityTables() const { return m_tables && m_tables->HasRapidityTables(); }
+
+    // species lookup, centrality weights, |y| normalisations, grid and kernel;
+    // false if the species registry is invalid
+    bool Init();
+
+    // checksum of everything the weights depend on after Init(): the tables
+    // that are used, the eta range, rapidity mode, heavier baryon switch,
+    // weight grid and species rules
+    uint64_t GetVersion() const;
+
+    // select the npart of the event, collapses the grid when it changes
+    void SetNpart(int npart)
+    {
+        if (m_useweightgrid && npart != m_gridnpart) collapseweightgrid(npart);
+    }
+
+    struct Kinematics
+    {
+        float pt = 0;
+        float eta = 0;
+        // only filled in rapidity dependent mode
+        float y = 0;
+    };
+
+    // eta acceptance and weight of one primary, the scale is 1 outside
+    // [mineta, maxeta]; for the grid path npart should be the SetNpart() one
+    bool Weight(double px, double py, double pz, double e, int pid, int npart, float &scale) const
+    {
+        Kinematics kin;
+        scale = 1.0;
+        if (!Accept(px, py, pz, e, kin))
+            return false;
+        scale = Correction(pid, npart, kin);
+        return true;
+    }
+
+    // the two halves of Weight()
+    bool Accept(double px, double py, double pz, double e, Kinematics &kin) const;
+    float Correction(int pid, int npart, const Kinematics &kin) const
+    {
+        // find correction factor for G4Hits
+        if (!rapiditydep)
+            return ptcorrection(npart, pid, kin.pt);
+        return findrapcorrection(pid, kin.pt, kin.y, npart);
+    }
+
+    // batch kernel on the pt curves of the current npart, only with the grid
+    WeightKernel &GetKernel() { return m_kernel; }
+    const WeightKernel &GetKernel() const { return m_kernel; }
+
+    // histogram path
+    float findcorrection(int npart, int pid, float pt) const
+    {
+        int species = m_species.Index(pid);
+        if (species < 0) return 1;
+        return speciescorrection(species, npart, pt, 0, false, false);
+    }
+
+    float gridcorrection(int npart, int pid, float pt) const
+    {
+        int species = m_species.Index(pid);
+        if (species < 0) return 1;
+        return speciescorrection(species, npart, pt, 0, false, true);
+    }
+
+    // centrality dependent correction through whichever path is selected
+    float ptcorrection(int npart, int pid, float pt) const
+    {
+        int species = m_species.Index(pid);
+        if (species < 0) return 1;
+        return speciescorrection(species, npart, pt, 0, false, m_useweightgrid);
+    }
+
+    float findrapcorrection(int pid, float pt, float y, int npart) const
+    {
+        int species = m_species.Index(pid);
+        if (species < 0) return 1;
+        return speciescorrection(species, npart, pt, std::abs(y), true, m_useweightgrid);
+    }
+
+private:
+    int m_verbosity = 0;
+
+    bool rapiditydep = false;
+
+    float mineta = -2.5;
+    float maxeta = 2.5;
+
+    bool reweightheavierbaryons = true;
+
+    bool m_useweightgrid = true;
+    int m_gridptnodes = 0;
+    float m_gridtolerance = 1e-3;
+
+    static const int gridmaxptnodes = 4096;
+
+    // sampled centrality histograms, row table x ncentbins + centbin
+    WeightGrid m_centgrid;
+    // the centrality weighted sum of those rows for m_gridnpart, row table
+    WeightGrid m_eventgrid;
+    int m_gridnpart = -1;
+
+    void buildweightgrid();
+    bool checkweightgrid();
+    void collapseweightgrid(int npart);
+
+    WeightKernel::Isa m_kernelisa = WeightKernel::kAVX2;
+    WeightKernel m_kernel;
+    void compileweightkernel();
+
+    SpeciesRegistry m_species;
+
+    // the tables in use, and the private copy if the engine loaded or set any
+    std::shared_ptr<const CorrectionTables> m_tables;
+    std::shared_ptr<CorrectionTables> m_owntables;
+
+    CorrectionTables &owntables();
+
+    // centrality histograms of every pt correction table, from m_tables at Init()
+    const TableHist *h_ratio[SpeciesRegistry::ntables][ncentbins] = {{nullptr}};
+
+    // interval centers of each rapidity table, filled in Init()
+    std::vector<float> m_meanrapidity[SpeciesRegistry::nraptables];
+
+    // |y| shape of each rapidity table, from m_tables at Init()
+    const TableHist *h_rapratio[SpeciesRegistry::nraptables] = {nullptr};
+    // the shapes at y = 0 they are normalised to, and the inverse
+    double m_rapnorm[SpeciesRegistry::nraptables] = {0};
+    float m_invrapnorm[SpeciesRegistry::nraptables] = {0};
+    // |y| shapes sampled like the pt curves, row raptable
+    WeightGrid m_rapgrid;
+
+    int getRapTable(int pid) const
+    {
+        int species = m_species.Index(pid);
+        if (species < 0 || m_species.GetSpecies(species).ncomponents != 1 || m_species.GetSpecies(species).components[0].raptable < 0)
+            throw std::invalid_argument("Invalid particle ID");
+        return m_species.GetSpecies(species).components[0].raptable;
+    }
+
+    const std::vector<std::vector<float>>& getRapidityIntervals(int pid) const
+    {
+        return CorrectionTables::GetRapidityIntervals(getRapTable(pid));
+    }
+
+    const TableHist* getHist(int pid, int i) const
+    {
+        return m_tables->GetRapidityIntervalTable(getRapTable(pid), i);
+    }
+
+    float findrapscale(int pid, float pt, float y){
+        float scale = 1;
+        y = std::abs(y);
+        int Lowerbin = -1;
+        int Upperbin = 1000;
+
+        const std::vector<float> &meanrapidity = m_meanrapidity[getRapTable(pid)];
+        // find which two bins the y falls in between, and interpolate
+        for (int i = 0; i < (int) meanrapidity.size() - 1; i++)
+        {
+
+            if (y >= meanrapidity[i] && y <= meanrapidity[i + 1])
+            {
+                Lowerbin = i;
+                Upperbin = i + 1;
+                break;
+            }
+        }
+        if(y < meanrapidity[0]){
+            Lowerbin = -1;
+            Upperbin = 0;
+        }
+        if(y > meanrapidity[meanrapidity.size()-1]){
+            Lowerbin = meanrapidity.size()-1;
+            Upperbin = 1000;
+        }
+        //interpolation
+        if (Lowerbin == -1 && Upperbin == 0)
+        {
+            const TableHist *h = getHist(pid, Upperbin);
+            scale = h->Interpolate(pt);
+        }
+        else if (Upperbin == 1000)
+        {
+            const TableHist *h = getHist(pid, Lowerbin);
+            scale = h->Interpolate(pt);
+        }
+        else
+        {
+            const TableHist *h1 = getHist(pid, Lowerbin);
+            const TableHist *h2 = getHist(pid, Upperbin);
+            scale = (h1->Interpolate(pt) * (meanrapidity[Upperbin] - y) + h2->Interpolate(pt) * (y - meanrapidity[Lowerbin])) / (meanrapidity[Upperbin] - meanrapidity[Lowerbin]);
+        }
+        return scale;
+    }
+
+    // centrality averages of m_tables, set at Init()
+    const float *avgcentclass[SpeciesRegistry::ncentclasses] = {nullptr};
+
+    // centralityweights() of every integer npart, filled in Init()
+    float m_centweights[SpeciesRegistry::ncentclasses][maxnpart + 1][ncentbins] = {};
+
+    void buildcentralityweights();
+
+    const float *centweights(int npart, int centclass) const
+    {
+        if (npart < 0)
+            npart = 0;
+        else if (npart > maxnpart)
+            npart = maxnpart;
+        return m_centweights[centclass][npart];
+    }
+
+    // interpolation weights of the centrality classes for this npart
+    void centralityweights(int npart, int centclass, float *weight) const
+    {
+        const float *cent = avgcentclass[centclass];
+        for (int i = 0; i < ncentbins; i++)
+        {
+            weight[i] = 0;
+        }
+        if (npart > cent[0] || npart < cent[ncentbins - 1])
+        {
+            if (npart > cent[0])
+                weight[0] = 1;
+            if (npart < cent[ncentbins - 1])
+                weight[ncentbins - 1] = 1;
+            return;
+        }
+        // use interpolation here
+        // first find which two bins the npart falls in between
+        int lowerBin = -1;
+        int upperBin = -1;
+        for (int i = 0; i < ncentbins - 1; i++)
+        {
+            if (npart <= cent[i] && npart >= cent[i + 1])
+            {
+                lowerBin = i;
+                upperBin = i + 1;
+                break;
+            }
+        }
+        // interpolate
+        weight[upperBin] = (cent[lowerBin] - npart) / (cent[lowerBin] - cent[upperBin]);
+        weight[lowerBin] = (npart - cent[upperBin]) / (cent[lowerBin] - cent[upperBin]);
+    }
+
+    // centrality interpolated Interpolate() of one table
+    float findtablecorrection(int npart, int table, float pt) const
+    {
+        const float *weight = centweights(npart, SpeciesRegistry::GetCentClass(table));
+        float scale = 0;
+        // loop over cent bins
+        for (int i = 0; i < ncentbins; i++)
+        {
+            scale += weight[i] * h_ratio[table][i]->Interpolate(pt);
+        }
+        return scale;
+    }
+
+    float tablecorrection(int npart, int table, float pt, bool usegrid) const
+    {
+        if (!usegrid) return findtablecorrection(npart, table, pt);
+        if (npart == m_gridnpart) return m_eventgrid.Value(table, pt);
+        // not the npart of this event, combine the centrality rows directly
+        const float *weight = centweights(npart, SpeciesRegistry::GetCentClass(table));
+        float scale = 0;
+        for (int i = 0; i < ncentbins; i++)
+        {
+            scale += weight[i] * m_centgrid.Value(table * ncentbins + i, pt);
+        }
+        return scale;
+    }
+
+    // combine the tables of one species as given by the registry
+    float speciescorrection(int species, int npart, float pt, float absy, bool withrap, bool usegrid) const
+    {
+        const SpeciesRegistry::Species &sp = m_species.GetSpecies(species);
+        // SetReweightHeavierBaryons(false) drops the pt part, the |y| shape stays
+        bool ptdep = !sp.heavierbaryon || reweightheavierbaryons;
+        float scale = 0;
+        for (int i = 0; i < sp.ncomponents; i++)
+        {
+            const SpeciesRegistry::Component &comp = sp.components[i];
+            float s = ptdep ? tablecorrection(npart, comp.table, pt, usegrid) : 1;
+            if (withrap && comp.raptable >= 0)
+            {
+                if (usegrid)
+                    s = s * m_rapgrid.Value(comp.raptable, absy) * m_invrapnorm[comp.rapnorm];
+                else
+                    s = s * h_rapratio[comp.raptable]->Interpolate(absy) / m_rapnorm[comp.rapnorm];
+            }
+            scale += comp.fraction * s;
+        }
+        return scale;
+    }
+};
+
+#endif // CORRECTIONENGINE_H
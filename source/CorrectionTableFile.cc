@@ -0,0 +1,234 @@
+#include "CorrectionTableFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// on-disk structures, only fixed size members and explicit padding
+struct CorrectionTableFile::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nentries;
+    // bytes after the header, and their FNV-1a hash
+    uint64_t payloadsize;
+    uint64_t checksum;
+    char generatortype[32];
+    float avgcent[5];
+    float avgcentlambda[5];
+};
+
+struct CorrectionTableFile::Entry
+{
+    int32_t kind;
+    int32_t table;
+    int32_t index;
+    int32_t nbins;
+    // 1 if edges holds nbins + 1 bin edges
+    int32_t variable;
+    int32_t pad;
+    double xmin;
+    double xmax;
+    // from the start of the file
+    uint64_t edgesoffset;
+    uint64_t contentsoffset;
+};
+
+namespace {
+const char tablemagic[8] = {'E', 'C', 'T', 'A', 'B', 'L', 'E', '\0'};
+
+size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+} // namespace
+
+//____________________________________________________________________________..
+CorrectionTableFile::~CorrectionTableFile() {
+  Unmap();
+}
+
+//____________________________________________________________________________..
+uint64_t CorrectionTableFile::checksum(const unsigned char *data,
+                                       size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+//____________________________________________________________________________..
+bool CorrectionTableFile::Write(const std::string &filename,
+                                const std::string &generatortype,
+                                const float *avgcent,
+                                const float *avgcentlambda,
+                                const std::vector<Input> &hists) {
+  // lay out entries and data first, then fill the header
+  size_t offset = align8(sizeof(Header) + hists.size() * sizeof(Entry));
+  std::vector<Entry> entries(hists.size());
+  for (unsigned int i = 0; i < hists.size(); i++) {
+    const TableHist &h = *hists[i].hist;
+    Entry &entry = entries[i];
+    std::memset(&entry, 0, sizeof(Entry));
+    entry.kind = hists[i].kind;
+    entry.table = hists[i].table;
+    entry.index = hists[i].index;
+    entry.nbins = h.GetNbinsX();
+    entry.variable = h.GetEdges() != nullptr;
+    entry.xmin = h.GetXmin();
+    entry.xmax = h.GetXmax();
+    if (entry.variable) {
+      entry.edgesoffset = offset;
+      offset = align8(offset + (entry.nbins + 1) * sizeof(double));
+    }
+    entry.contentsoffset = offset;
+    offset = align8(offset + entry.nbins * sizeof(float));
+  }
+
+  std::vector<unsigned char> buffer(offset, 0);
+  std::memcpy(buffer.data() + sizeof(Header), entries.data(),
+              entries.size() * sizeof(Entry));
+  for (unsigned int i = 0; i < hists.size(); i++) {
+    const TableHist &h = *hists[i].hist;
+    if (entries[i].variable)
+      std::memcpy(buffer.data() + entries[i].edgesoffset, h.GetEdges(),
+                  (entries[i].nbins + 1) * sizeof(double));
+    std::memcpy(buffer.data() + entries[i].contentsoffset, h.GetContents(),
+                entries[i].nbins * sizeof(float));
+  }
+
+  Header header;
+  std::memset(&header, 0, sizeof(Header));
+  std::memcpy(header.magic, tablemagic, sizeof(tablemagic));
+  header.version = version;
+  header.nentries = entries.size();
+  header.payloadsize = buffer.size() - sizeof(Header);
+  std::strncpy(header.generatortype, generatortype.c_str(),
+               sizeof(header.generatortype) - 1);
+  std::memcpy(header.avgcent, avgcent, sizeof(header.avgcent));
+  std::memcpy(header.avgcentlambda, avgcentlambda,
+              sizeof(header.avgcentlambda));
+  header.checksum =
+      checksum(buffer.data() + sizeof(Header), header.payloadsize);
+  std::memcpy(buffer.data(), &header, sizeof(Header));
+
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  out.write((const char *) buffer.data(), buffer.size());
+  out.close();
+  if (!out) {
+    std::cout << "CorrectionTableFile::Write() cannot write " << filename
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//____________________________________________________________________________..
+bool CorrectionTableFile::Map(const std::string &filename) {
+  Unmap();
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "CorrectionTableFile::Map() cannot open " << filename
+              << std::endl;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header)) {
+    std::cout << "CorrectionTableFile::Map() " << filename
+              << " is too short for a table file" << std::endl;
+    close(fd);
+    return false;
+  }
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    std::cout << "CorrectionTableFile::Map() cannot map " << filename
+              << std::endl;
+    return false;
+  }
+  m_data = (const unsigned char *) data;
+  m_size = st.st_size;
+  m_filename = filename;
+
+  const Header *header = (const Header *) m_data;
+  const char *error = nullptr;
+  if (std::memcmp(header->magic, tablemagic, sizeof(tablemagic)) != 0)
+    error = "is not a correction table file";
+  else if (header->version != version)
+    error = "has an unsupported version";
+  else if (header->payloadsize != m_size - sizeof(Header) ||
+           sizeof(Header) + (uint64_t) header->nentries * sizeof(Entry) > m_size)
+    error = "is truncated";
+  else if (checksum(m_data + sizeof(Header), header->payloadsize) !=
+           header->checksum)
+    error = "fails the checksum";
+  if (!error) {
+    const Entry *entries = (const Entry *) (m_data + sizeof(Header));
+    for (unsigned int i = 0; i < header->nentries && !error; i++) {
+      const Entry &entry = entries[i];
+      uint64_t nedges = entry.variable ? entry.nbins + 1 : 0;
+      if (entry.nbins <= 0 || entry.kind < 0 || entry.kind >= nkinds ||
+          entry.contentsoffset % 8 != 0 || entry.edgesoffset % 8 != 0 ||
+          entry.contentsoffset + entry.nbins * sizeof(float) > m_size ||
+          entry.edgesoffset + nedges * sizeof(double) > m_size) {
+        error = "has an invalid histogram entry";
+        break;
+      }
+      Hist hist;
+      hist.kind = entry.kind;
+      hist.table = entry.table;
+      hist.index = entry.index;
+      hist.hist = TableHist(
+          entry.nbins, entry.xmin, entry.xmax,
+          entry.variable ? (const double *) (m_data + entry.edgesoffset)
+                         : nullptr,
+          (const float *) (m_data + entry.contentsoffset));
+      m_hists.push_back(hist);
+    }
+  }
+  if (error) {
+    std::cout << "CorrectionTableFile::Map() " << filename << " " << error
+              << std::endl;
+    Unmap();
+    return false;
+  }
+  m_generatortype.assign(header->generatortype,
+                         strnlen(header->generatortype,
+                                 sizeof(header->generatortype)));
+  return true;
+}
+
+//____________________________________________________________________________..
+void CorrectionTableFile::Unmap() {
+  if (m_data)
+    munmap((void *) m_data, m_size);
+  m_data = nullptr;
+  m_size = 0;
+  m_hists.clear();
+  m_generatortype.clear();
+}
+
+//____________________________________________________________________________..
+const float *CorrectionTableFile::GetCentralityAverages(int centclass) const {
+  const Header *header = (const Header *) m_data;
+  return centclass == 0 ? header->avgcent : header->avgcentlambda;
+}
+
+//____________________________________________________________________________..
+uint64_t CorrectionTableFile::GetChecksum() const {
+  return m_data ? ((const Header *) m_data)->checksum : 0;
+}
+
+//____________________________________________________________________________..
+const TableHist *CorrectionTableFile::Find(int kind, int table,
+                                           int index) const {
+  for (const Hist &hist : m_hists) {
+    if (hist.kind == kind && hist.table == table && hist.index == index)
+      return &hist.hist;
+  }
+  return nullptr;
+}
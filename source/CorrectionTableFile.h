@@ -0,0 +1,90 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef CORRECTIONTABLEFILE_H
+#define CORRECTIONTABLEFILE_H
+
+#include "TableHist.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Flat binary file with every correction histogram of one generator and its
+// centrality averages, mapped read-only with mmap. Layout, host byte order:
+//
+//   Header       magic, version, sizes, checksum of everything after it
+//   Entry[n]     kind, table, index, binning, offsets of edges/contents
+//   data         bin edges (double, variable binning only), contents (float)
+//
+// Map() checks magic, version, size, checksum and every offset before the
+// histograms are handed out as TableHist views into the mapping.
+class CorrectionTableFile
+{
+public:
+    static const uint32_t version = 1;
+
+    enum Kind
+    {
+        // table = SpeciesRegistry::Table, index = centrality bin
+        kPtTable = 0,
+        // table = SpeciesRegistry::RapTable, index = |y| interval
+        kRapInterval,
+        // table = SpeciesRegistry::RapTable, index 0
+        kRapRatio,
+        nkinds
+    };
+
+    struct Input
+    {
+        int kind;
+        int table;
+        int index;
+        const TableHist *hist;
+    };
+
+    CorrectionTableFile() = default;
+    ~CorrectionTableFile();
+
+    CorrectionTableFile(const CorrectionTableFile &) = delete;
+    CorrectionTableFile &operator=(const CorrectionTableFile &) = delete;
+
+    static bool Write(const std::string &filename, const std::string &generatortype,
+                      const float *avgcent, const float *avgcentlambda, const std::vector<Input> &hists);
+
+    // false with a message if the file is missing, truncated or corrupted
+    bool Map(const std::string &filename);
+    void Unmap();
+
+    const std::string &GetFileName() const { return m_filename; }
+    const std::string &GetGeneratorType() const { return m_generatortype; }
+    // ncentbins averages of SpeciesRegistry::kCentDefault / kCentLambda
+    const float *GetCentralityAverages(int centclass) const;
+    uint64_t GetChecksum() const;
+    size_t GetMappedSize() const { return m_size; }
+
+    // null if the file does not contain it
+    const TableHist *Find(int kind, int table, int index) const;
+
+    static uint64_t checksum(const unsigned char *data, size_t size);
+
+private:
+    struct Header;
+    struct Entry;
+
+    std::string m_filename;
+    std::string m_generatortype;
+    const unsigned char *m_data = nullptr;
+    size_t m_size = 0;
+
+    struct Hist
+    {
+        int kind;
+        int table;
+        int index;
+        TableHist hist;
+    };
+    std::vector<Hist> m_hists;
+};
+
+#endif // CORRECTIONTABLEFILE_H
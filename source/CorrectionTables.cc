@@ -0,0 +1,439 @@
+#include "CorrectionTables.h"
+#include "CorrectionTableFile.h"
+
+#include <TFile.h>
+#include <TH1.h>
+
+#include <iostream>
+#include <map>
+#include <mutex>
+
+namespace {
+std::mutex &sharedmutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::map<std::string, std::weak_ptr<const CorrectionTables>> &sharedtables() {
+  static std::map<std::string, std::weak_ptr<const CorrectionTables>> tables;
+  return tables;
+}
+} // namespace
+
+const std::string CorrectionTables::defaulttabledir =
+    "/sphenix/user/shuhangli/dETdeta/macro";
+const std::string CorrectionTables::defaultrapfile =
+    "/sphenix/u/shuhang98/MakePlots/yspectrum/fittedratios.root";
+
+//____________________________________________________________________________..
+CorrectionTables::CorrectionTables() = default;
+
+//____________________________________________________________________________..
+CorrectionTables::CorrectionTables(
+    const std::shared_ptr<const CorrectionTables> &parent)
+    : m_parent(parent) {
+  for (int table = 0; table < SpeciesRegistry::ntables; table++) {
+    for (int i = 0; i < ncentbins; i++)
+      h_ratio[table][i] = parent->h_ratio[table][i];
+  }
+  for (int raptable = 0; raptable < SpeciesRegistry::nraptables; raptable++) {
+    h_rapratio[raptable] = parent->h_rapratio[raptable];
+    for (int i = 0; i < maxrapintervals; i++)
+      raphists[raptable][i] = parent->raphists[raptable][i];
+  }
+  SetCentralityAverages(SpeciesRegistry::kCentDefault, parent->avgcent);
+  SetCentralityAverages(SpeciesRegistry::kCentLambda, parent->avgcentlambda);
+}
+
+//____________________________________________________________________________..
+CorrectionTables::~CorrectionTables() = default;
+
+//____________________________________________________________________________..
+const std::vector<std::vector<float>> &
+CorrectionTables::GetRapidityIntervals(int raptable) {
+  //pi
+  static const std::vector<std::vector<float>> rapIntervalsPi = {{-0.1,0.},{0.,0.1},{0.4,0.6},{0.6,0.8},{0.8,1.0}, {1.0,1.2},{1.2,1.4},{2.1,2.3},{2.4,2.6},{3.0,3.1},{3.1,3.2},{3.2,3.3}, {3.3,3.4},{3.4,3.66}};
+  //K
+  static const std::vector<std::vector<float>> rapIntervalsK = {{-0.1,0.},{0.,0.1},{0.4,0.6},{0.6,0.8},{0.8,1.0}, {1.0,1.2},{2.0,2.2},{2.3,2.5},{2.9,3.0},{3.0,3.1},{3.1,3.2},{3.2,3.4}};
+  //p
+  static const std::vector<std::vector<float>> rapIntervalsP = {{-0.1,0.1},{0.75,0.95},{1.7,2.4},{2.7,3.1}};
+  //pbar
+  static const std::vector<std::vector<float>> rapIntervalsPbar = {{-0.1,0.1},{0.75,0.95},{1.7,2.4},{2.7,3.1}};
+
+  switch (raptable) {
+  case SpeciesRegistry::kRapPip:
+  case SpeciesRegistry::kRapPim:
+    return rapIntervalsPi;
+  case SpeciesRegistry::kRapKp:
+  case SpeciesRegistry::kRapKm:
+    return rapIntervalsK;
+  case SpeciesRegistry::kRapP:
+    return rapIntervalsP;
+  default:
+    return rapIntervalsPbar;
+  }
+}
+
+//____________________________________________________________________________..
+std::shared_ptr<const CorrectionTables>
+CorrectionTables::Acquire(const std::string &key, const Loader &loader) {
+  // weak references, the tables go away with their last user
+  std::lock_guard<std::mutex> lock(sharedmutex());
+  std::map<std::string, std::weak_ptr<const CorrectionTables>> &shared =
+      sharedtables();
+  std::shared_ptr<const CorrectionTables> tables = shared[key].lock();
+  if (tables)
+    return tables;
+  std::shared_ptr<CorrectionTables> loaded =
+      std::make_shared<CorrectionTables>();
+  if (!loader(*loaded)) {
+    shared.erase(key);
+    return nullptr;
+  }
+  shared[key] = loaded;
+  return loaded;
+}
+
+//____________________________________________________________________________..
+std::vector<std::string> CorrectionTables::GetSharedKeys() {
+  std::lock_guard<std::mutex> lock(sharedmutex());
+  std::vector<std::string> keys;
+  for (const auto &entry : sharedtables()) {
+    if (!entry.second.expired())
+      keys.push_back(entry.first);
+  }
+  return keys;
+}
+
+//____________________________________________________________________________..
+const TableHist *CorrectionTables::copyhist(const TH1 *h) {
+  m_ownedhists.emplace_back(new OwnedHist);
+  OwnedHist &owned = *m_ownedhists.back();
+  const TAxis *axis = h->GetXaxis();
+  int nbins = h->GetNbinsX();
+  const TArrayD *xbins = axis->GetXbins();
+  if (xbins->GetSize() == nbins + 1)
+    owned.edges.assign(xbins->GetArray(), xbins->GetArray() + nbins + 1);
+  owned.contents.resize(nbins);
+  for (int ibin = 1; ibin <= nbins; ibin++)
+    owned.contents[ibin - 1] = h->GetBinContent(ibin);
+  owned.hist = TableHist(nbins, axis->GetXmin(), axis->GetXmax(),
+                         owned.edges.empty() ? nullptr : owned.edges.data(),
+                         owned.contents.data());
+  return &owned.hist;
+}
+
+namespace {
+// the histogram or null with a message
+TH1 *gethist(TFile *f, const std::string &name) {
+  TH1 *h = dynamic_cast<TH1 *>(f->Get(name.c_str()));
+  if (!h)
+    std::cout << "CorrectionTables: no histogram " << name << " in "
+              << f->GetName() << std::endl;
+  return h;
+}
+
+TFile *openfile(const std::string &filename) {
+  TFile *f = TFile::Open(filename.c_str());
+  if (!f || f->IsZombie()) {
+    std::cout << "CorrectionTables: cannot open " << filename << std::endl;
+    delete f;
+    return nullptr;
+  }
+  return f;
+}
+} // namespace
+
+//____________________________________________________________________________..
+bool CorrectionTables::LoadPtTables(const std::string &generatortype,
+                                    const std::string &directory) {
+  // read correction histogram from file
+  std::string filename = directory + "/fitratio" + generatortype + ".root";
+  std::string filenamelambda =
+      directory + "/fitratioLambda" + generatortype + ".root";
+  TFile *f_upweight = openfile(filename);
+  TFile *f_upweightlambda = openfile(filenamelambda);
+  bool ok = f_upweight && f_upweightlambda;
+
+  std::string postfix[5] = {"0010_ratio", "1020_ratio", "2040_ratio",
+                            "4060_ratio", "6092_ratio"};
+  const char *prefix[SpeciesRegistry::ntables] = {nullptr};
+  prefix[SpeciesRegistry::kPimi] = "h_pimi";
+  prefix[SpeciesRegistry::kPip] = "h_pip";
+  prefix[SpeciesRegistry::kP] = "h_p";
+  prefix[SpeciesRegistry::kPbar] = "h_pbar";
+  prefix[SpeciesRegistry::kKp] = "h_kp";
+  prefix[SpeciesRegistry::kKmi] = "h_kmi";
+
+  for (int i = 0; i < 5 && ok; i++) {
+    for (int table = 0; table < SpeciesRegistry::ntables && ok; table++) {
+      TH1 *h = nullptr;
+      if (table == SpeciesRegistry::kLambda)
+        h = gethist(f_upweightlambda, "lambdaratio_" + std::to_string(i));
+      else if (table == SpeciesRegistry::kLambdabar)
+        h = gethist(f_upweightlambda, "lambdabarratio_" + std::to_string(i));
+      else
+        h = gethist(f_upweight, prefix[table] + postfix[i]);
+      if (h)
+        h_ratio[table][i] = copyhist(h);
+      ok = h;
+    }
+  }
+  // the histograms are copies, the files are not needed any more
+  for (TFile *f : {f_upweight, f_upweightlambda}) {
+    if (!f)
+      continue;
+    f->Close();
+    delete f;
+  }
+  return ok;
+}
+
+//____________________________________________________________________________..
+bool CorrectionTables::SetGeneratorType(const std::string &generatortype) {
+  //set centralities average
+  if(generatortype == "HIJING") {
+    avgcent[0] = 329.815; 
+    avgcent[1] = 238.602;
+    avgcent[2] = 144.272;
+    avgcent[3] = 64.9728;
+    avgcent[4] = 17.8337;
+
+    avgcentlambda[0] = 356.192;
+    avgcentlambda[1] = 238.602;
+    avgcentlambda[2] = 144.272;
+    avgcentlambda[3] = 64.9728;
+    avgcentlambda[4] = 23.566;
+  }
+  else if(generatortype == "AMPT") {
+    avgcent[0] = 340.095;
+    avgcent[1] = 254.515;
+    avgcent[2] = 160.105;
+    avgcent[3] = 76.1558;
+    avgcent[4] = 22.783;
+
+    avgcentlambda[0] = 363.887;
+    avgcentlambda[1] = 254.515;
+    avgcentlambda[2] = 160.105;
+    avgcentlambda[3] = 76.1558;
+    avgcentlambda[4] = 29.5574;
+  }
+  else if (generatortype == "EPOS") {
+    avgcent[0] = 326.566;
+    avgcent[1] = 237.198;
+    avgcent[2] = 144.771;
+    avgcent[3] = 66.0863;
+    avgcent[4] = 18.3792;
+
+    avgcentlambda[0] = 356.192;
+    avgcentlambda[1] = 238.602;
+    avgcentlambda[2] = 144.272;
+    avgcentlambda[3] = 64.9728;
+    avgcentlambda[4] = 23.566;
+
+
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+//____________________________________________________________________________..
+void CorrectionTables::SetCentralityAverages(int centclass, const float *avg) {
+  float *cent = centclass == SpeciesRegistry::kCentLambda ? avgcentlambda : avgcent;
+  for (int i = 0; i < ncentbins; i++)
+    cent[i] = avg[i];
+}
+
+//____________________________________________________________________________..
+bool CorrectionTables::LoadRapidityTables(const std::string &filename) {
+  TFile *f_upweightrap = openfile(filename);
+  if (!f_upweightrap)
+    return false;
+
+  const char *intervalprefix[SpeciesRegistry::nraptables] = {nullptr};
+  const char *rationame[SpeciesRegistry::nraptables] = {nullptr};
+  intervalprefix[SpeciesRegistry::kRapPip] = "hPiplus_";
+  intervalprefix[SpeciesRegistry::kRapPim] = "hPiminus_";
+  intervalprefix[SpeciesRegistry::kRapKp] = "hKplus_";
+  intervalprefix[SpeciesRegistry::kRapKm] = "hKminus_";
+  intervalprefix[SpeciesRegistry::kRapP] = "hP_";
+  intervalprefix[SpeciesRegistry::kRapPbar] = "hPbar_";
+  rationame[SpeciesRegistry::kRapP] = "hPratio_0";
+  rationame[SpeciesRegistry::kRapPbar] = "hPbarratio_0";
+  rationame[SpeciesRegistry::kRapPip] = "hPipratio_0";
+  rationame[SpeciesRegistry::kRapPim] = "hPimratio_0";
+  rationame[SpeciesRegistry::kRapKp] = "hKpratio_0";
+  rationame[SpeciesRegistry::kRapKm] = "hKmratio_0";
+
+  bool ok = true;
+  for (int raptable = 0; raptable < SpeciesRegistry::nraptables && ok;
+       raptable++) {
+    for (int i = 0; i < GetNRapidityIntervals(raptable) && ok; i++) {
+      TH1 *h = gethist(f_upweightrap,
+                       intervalprefix[raptable] + std::to_string(i));
+      if (h)
+        raphists[raptable][i] = copyhist(h);
+      ok = h;
+    }
+    TH1 *h = ok ? gethist(f_upweightrap, rationame[raptable]) : nullptr;
+    if (h)
+      h_rapratio[raptable] = copyhist(h);
+    ok = h;
+  }
+  f_upweightrap->Close();
+  delete f_upweightrap;
+  return ok;
+}
+
+//____________________________________________________________________________..
+void CorrectionTables::SetPtTable(int table, int centbin, const TH1F *h) {
+  h_ratio[table][centbin] = copyhist(h);
+}
+
+//____________________________________________________________________________..
+void CorrectionTables::SetRapidityTable(int raptable, const TH1F *ratio,
+                                        TH1F *const *intervalhists) {
+  h_rapratio[raptable] = copyhist(ratio);
+  for (int i = 0; i < GetNRapidityIntervals(raptable); i++)
+    raphists[raptable][i] = copyhist(intervalhists[i]);
+}
+
+//____________________________________________________________________________..
+bool CorrectionTables::HasPtTables() const {
+  for (int table = 0; table < SpeciesRegistry::ntables; table++) {
+    for (int i = 0; i < ncentbins; i++) {
+      if (!h_ratio[table][i])
+        return false;
+    }
+  }
+  return true;
+}
+
+//____________________________________________________________________________..
+bool CorrectionTables::HasRapidityTables() const {
+  for (int raptable = 0; raptable < SpeciesRegistry::nraptables; raptable++) {
+    if (!h_rapratio[raptable])
+      return false;
+    for (int i = 0; i < GetNRapidityIntervals(raptable); i++) {
+      if (!raphists[raptable][i])
+        return false;
+    }
+  }
+  return true;
+}
+
+//____________________________________________________________________________..
+uint64_t CorrectionTables::GetVersion(bool rapidity) const {
+  // FNV-1a like the table file checksum, missing tables hash as empty ones
+  uint64_t hash = 14695981039346656037ULL;
+  auto hashbytes = [&hash](const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
+    }
+  };
+  auto hashhist = [&hashbytes](const TableHist *h) {
+    int nbins = h ? h->GetNbinsX() : 0;
+    hashbytes(&nbins, sizeof(nbins));
+    if (!h)
+      return;
+    double range[2] = {h->GetXmin(), h->GetXmax()};
+    hashbytes(range, sizeof(range));
+    if (h->GetEdges())
+      hashbytes(h->GetEdges(), (nbins + 1) * sizeof(double));
+    hashbytes(h->GetContents(), nbins * sizeof(float));
+  };
+  for (int table = 0; table < SpeciesRegistry::ntables; table++) {
+    for (int i = 0; i < ncentbins; i++)
+      hashhist(h_ratio[table][i]);
+  }
+  for (int raptable = 0; rapidity && raptable < SpeciesRegistry::nraptables;
+       raptable++) {
+    hashhist(h_rapratio[raptable]);
+    for (int i = 0; i < GetNRapidityIntervals(raptable); i++)
+      hashhist(raphists[raptable][i]);
+  }
+  hashbytes(avgcent, sizeof(avgcent));
+  hashbytes(avgcentlambda, sizeof(avgcentlambda));
+  return hash;
+}
+
+//____________________________________________________________________________..
+bool CorrectionTables::LoadTableFile(const std::string &filename,
+                                     const std::string &generatortype,
+                                     int verbosity) {
+  std::shared_ptr<CorrectionTableFile> file =
+      std::make_shared<CorrectionTableFile>();
+  if (!file->Map(filename))
+    return false;
+  if (file->GetGeneratorType() != generatortype) {
+    std::cout << "CorrectionTables::LoadTableFile() " << filename
+              << " holds the " << file->GetGeneratorType()
+              << " tables, not " << generatortype << std::endl;
+    return false;
+  }
+  // the views below point into the mapping
+  m_tablefiles.push_back(file);
+  for (int table = 0; table < SpeciesRegistry::ntables; table++) {
+    for (int i = 0; i < ncentbins; i++) {
+      h_ratio[table][i] =
+          file->Find(CorrectionTableFile::kPtTable, table, i);
+      if (!h_ratio[table][i]) {
+        std::cout << "CorrectionTables::LoadTableFile() " << filename
+                  << " misses the " << SpeciesRegistry::GetTableName(table)
+                  << " table of centrality bin " << i << std::endl;
+        return false;
+      }
+    }
+  }
+  // rapidity tables are optional, HasRapidityTables() tells
+  for (int raptable = 0; raptable < SpeciesRegistry::nraptables; raptable++) {
+    h_rapratio[raptable] =
+        file->Find(CorrectionTableFile::kRapRatio, raptable, 0);
+    for (int i = 0; i < GetNRapidityIntervals(raptable); i++)
+      raphists[raptable][i] =
+          file->Find(CorrectionTableFile::kRapInterval, raptable, i);
+  }
+  SetCentralityAverages(SpeciesRegistry::kCentDefault,
+                        file->GetCentralityAverages(SpeciesRegistry::kCentDefault));
+  SetCentralityAverages(SpeciesRegistry::kCentLambda,
+                        file->GetCentralityAverages(SpeciesRegistry::kCentLambda));
+  if (verbosity > 0)
+    std::cout << "CorrectionTables::LoadTableFile() mapped " << filename
+              << ", " << file->GetMappedSize() << " bytes, checksum "
+              << std::hex << file->GetChecksum() << std::dec << std::endl;
+  return true;
+}
+
+//____________________________________________________________________________..
+bool CorrectionTables::WriteTableFile(const std::string &filename,
+                                      const std::string &generatortype) const {
+  std::vector<CorrectionTableFile::Input> hists;
+  for (int table = 0; table < SpeciesRegistry::ntables; table++) {
+    for (int i = 0; i < ncentbins; i++) {
+      if (!h_ratio[table][i]) {
+        std::cout << "CorrectionTables::WriteTableFile() the "
+                  << SpeciesRegistry::GetTableName(table)
+                  << " tables are not set" << std::endl;
+        return false;
+      }
+      hists.push_back({CorrectionTableFile::kPtTable, table, i, h_ratio[table][i]});
+    }
+  }
+  if (HasRapidityTables()) {
+    for (int raptable = 0; raptable < SpeciesRegistry::nraptables;
+         raptable++) {
+      hists.push_back({CorrectionTableFile::kRapRatio, raptable, 0,
+                       h_rapratio[raptable]});
+      for (int i = 0; i < GetNRapidityIntervals(raptable); i++)
+        hists.push_back({CorrectionTableFile::kRapInterval, raptable, i,
+                         raphists[raptable][i]});
+    }
+  }
+  return CorrectionTableFile::Write(filename, generatortype, avgcent,
+                                    avgcentlambda, hists);
+}
+
@@ -0,0 +1,116 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef CORRECTIONTABLES_H
+#define CORRECTIONTABLES_H
+
+#include "SpeciesRegistry.h"
+#include "TableHist.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CorrectionTableFile;
+class TH1;
+class TH1F;
+
+// The correction histograms of one generator and its centrality averages,
+// loaded from the ROOT correction files, mapped from a binary table file or
+// set one by one. Once loaded they are only read, so engines with the same
+// tables can share one copy: Acquire() hands out a process-wide,
+// reference-counted instance per key, loaded by the first caller and freed
+// with the last user.
+class CorrectionTables
+{
+public:
+    static const int ncentbins = 5;
+    static const int maxrapintervals = 14;
+
+    static const std::string defaulttabledir;
+    static const std::string defaultrapfile;
+
+    typedef std::function<bool(CorrectionTables &tables)> Loader;
+
+    CorrectionTables();
+    // starts from the tables of parent, which is kept alive
+    explicit CorrectionTables(const std::shared_ptr<const CorrectionTables> &parent);
+    ~CorrectionTables();
+
+    CorrectionTables(const CorrectionTables &) = delete;
+    CorrectionTables &operator=(const CorrectionTables &) = delete;
+
+    // the shared tables of key, null if the loader of the first caller failed;
+    // key has to describe everything the loader reads
+    static std::shared_ptr<const CorrectionTables> Acquire(const std::string &key, const Loader &loader);
+    // keys with live tables, for diagnostics
+    static std::vector<std::string> GetSharedKeys();
+
+    // pt tables of a generator from fitratio<generator>.root and
+    // fitratioLambda<generator>.root in directory, false if one is missing
+    bool LoadPtTables(const std::string &generatortype, const std::string &directory = defaulttabledir);
+    // Npart averages of the centrality classes, false for an unknown generator
+    bool SetGeneratorType(const std::string &generatortype);
+    // |y| shapes and |y| interval tables from the correction file
+    bool LoadRapidityTables(const std::string &filename = defaultrapfile);
+
+    // or set them directly, the histograms are copied
+    void SetPtTable(int table, int centbin, const TH1F *h);
+    void SetCentralityAverages(int centclass, const float *avg);
+    // intervalhists holds GetNRapidityIntervals(raptable) histograms
+    void SetRapidityTable(int raptable, const TH1F *ratio, TH1F *const *intervalhists);
+
+    // all tables and centrality averages from a file written by
+    // WriteTableFile(), mapped instead of read; false if it cannot be mapped,
+    // fails its checks or was made for another generator
+    bool LoadTableFile(const std::string &filename, const std::string &generatortype, int verbosity = 0);
+    // the tables currently set, rapidity tables only if all of them are
+    bool WriteTableFile(const std::string &filename, const std::string &generatortype) const;
+
+    bool HasPtTables() const;
+    bool HasRapidityTables() const;
+
+    // checksum of all bins and centrality averages, the same for the same
+    // tables whether they come from the ROOT files or a table file; the
+    // rapidity tables only with rapidity, a table file always holds them
+    uint64_t GetVersion(bool rapidity = true) const;
+
+    const TableHist *GetPtTable(int table, int centbin) const { return h_ratio[table][centbin]; }
+    const TableHist *GetRapidityShape(int raptable) const { return h_rapratio[raptable]; }
+    const TableHist *GetRapidityIntervalTable(int raptable, int i) const { return raphists[raptable][i]; }
+    const float *GetCentralityAverages(int centclass) const
+    {
+        return centclass == SpeciesRegistry::kCentLambda ? avgcentlambda : avgcent;
+    }
+
+    // |y| intervals the interval tables were measured in
+    static const std::vector<std::vector<float>> &GetRapidityIntervals(int raptable);
+    static int GetNRapidityIntervals(int raptable) { return GetRapidityIntervals(raptable).size(); }
+
+private:
+    // bins of the histograms copied from ROOT, or the mapped table files and
+    // the parent tables the histogram views below point into
+    struct OwnedHist
+    {
+        std::vector<double> edges;
+        std::vector<float> contents;
+        TableHist hist;
+    };
+    std::vector<std::unique_ptr<OwnedHist>> m_ownedhists;
+    std::vector<std::shared_ptr<const CorrectionTableFile>> m_tablefiles;
+    std::shared_ptr<const CorrectionTables> m_parent;
+
+    const TableHist *copyhist(const TH1 *h);
+
+    // centrality histograms of every pt correction table
+    const TableHist *h_ratio[SpeciesRegistry::ntables][ncentbins] = {{nullptr}};
+    // |y| shape and |y| interval histograms of each rapidity table
+    const TableHist *h_rapratio[SpeciesRegistry::nraptables] = {nullptr};
+    const TableHist *raphists[SpeciesRegistry::nraptables][maxrapintervals] = {{nullptr}};
+
+    float avgcent[ncentbins] = {325.8, 236.1, 141.5, 61.6, 14.7};
+    float avgcentlambda[ncentbins] = {356.192, 238.602, 144.272, 64.9728, 23.566};
+};
+
+#endif // CORRECTIONTABLES_H
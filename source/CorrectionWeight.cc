@@ -0,0 +1,85 @@
+#include "CorrectionWeight.h"
+
+#include "CorrectionEngine.h"
+
+#include <iostream>
+
+//____________________________________________________________________________..
+bool CorrectionWeight::Init(const CorrectionEngine &engine) {
+  if (!engine.GetTables()) {
+    std::cout << "CorrectionWeight::Init() the engine has no tables"
+              << std::endl;
+    return false;
+  }
+  std::shared_ptr<CorrectionEngine> own = std::make_shared<CorrectionEngine>();
+  own->CopySettings(engine);
+  own->SetTables(engine.GetTables());
+  return setup(own);
+}
+
+//____________________________________________________________________________..
+bool CorrectionWeight::Init(const std::string &tablefile,
+                            const std::string &generatortype, bool rapidity,
+                            bool heavierbaryons) {
+  std::shared_ptr<CorrectionEngine> own = std::make_shared<CorrectionEngine>();
+  own->SetRapidityDep(rapidity);
+  own->SetReweightHeavierBaryons(heavierbaryons);
+  if (!own->LoadTableFile(tablefile, generatortype)) {
+    std::cout << "CorrectionWeight::Init() cannot load " << generatortype
+              << " from " << tablefile << std::endl;
+    return false;
+  }
+  return setup(own);
+}
+
+//____________________________________________________________________________..
+bool CorrectionWeight::setup(const std::shared_ptr<CorrectionEngine> &engine) {
+  // SetNpart() is never called, every weight comes from the const paths
+  if (!engine->Init()) {
+    std::cout << "CorrectionWeight::Init() cannot set up the correction"
+              << std::endl;
+    return false;
+  }
+  m_engine = engine;
+  m_rapidity = engine->GetRapidityDep();
+  return true;
+}
+
+//____________________________________________________________________________..
+float CorrectionWeight::Weight(int pid, float pt, float y, int npart) const {
+  if (!m_engine)
+    return 1;
+  // the engine keeps -1 for the npart of its unused event grid
+  if (npart < 0)
+    npart = 0;
+  if (m_rapidity)
+    return m_engine->findrapcorrection(pid, pt, y, npart);
+  return m_engine->ptcorrection(npart, pid, pt);
+}
+
+//____________________________________________________________________________..
+bool CorrectionWeight::Weight(double px, double py, double pz, double e,
+                              int pid, int npart, float &weight) const {
+  weight = 1;
+  CorrectionEngine::Kinematics kin;
+  if (!m_engine || !m_engine->Accept(px, py, pz, e, kin))
+    return false;
+  weight = Weight(pid, kin.pt, kin.y, npart);
+  return true;
+}
+
+//____________________________________________________________________________..
+void CorrectionWeight::Weight(int n, const int *pid, const float *pt,
+                              const float *y, const int *npart,
+                              float *weight) const {
+  for (int i = 0; i < n; i++)
+    weight[i] = Weight(pid[i], pt[i], y ? y[i] : 0, npart[i]);
+}
+
+//____________________________________________________________________________..
+void CorrectionWeight::Weight(int n, const int *pid, const float *pt,
+                              const float *y, int npart,
+                              float *weight) const {
+  for (int i = 0; i < n; i++)
+    weight[i] = Weight(pid[i], pt[i], y ? y[i] : 0, npart);
+}
@@ -0,0 +1,59 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef CORRECTIONWEIGHT_H
+#define CORRECTIONWEIGHT_H
+
+#include <memory>
+#include <string>
+
+class CorrectionEngine;
+
+// Read-only weight of a primary from pid, pt, rapidity and Npart for
+// analyses outside Fun4All, e.g. RDataFrame Define() columns of truth
+// ntuples. After Init() every call is const and reentrant: the weights are
+// combined from the centrality rows for the Npart of each call instead of
+// the per-event grid of CorrectionEngine::SetNpart(), so any number of
+// threads can share one instance. Copies share the engine and are cheap,
+// as RDataFrame copies its callables. The rapidity is ignored unless the
+// correction is rapidity dependent; no eta acceptance is applied.
+//
+//   CorrectionWeight w;
+//   w.Init("HIJING_tables.bin", "HIJING", false);
+//   df.Define("weight", w, {"pid", "pt", "y", "npart"});
+class CorrectionWeight
+{
+public:
+    CorrectionWeight() = default;
+
+    // same settings and tables as engine, which needs its tables, e.g. the
+    // engine of EnergyCorrection after Init()
+    bool Init(const CorrectionEngine &engine);
+    // tables of generatortype from a table file written by
+    // EnergyCorrectionTableConverter, mapped without ROOT
+    bool Init(const std::string &tablefile, const std::string &generatortype, bool rapidity,
+              bool heavierbaryons = true);
+
+    bool IsValid() const { return m_engine != nullptr; }
+    bool GetRapidityDep() const { return m_rapidity; }
+
+    // 1 for pids without a correction or before Init()
+    float Weight(int pid, float pt, float y, int npart) const;
+    float operator()(int pid, float pt, float y, int npart) const { return Weight(pid, pt, y, npart); }
+
+    // from the momentum with the eta acceptance of the engine as in
+    // EnergyCorrection, false and weight 1 outside it
+    bool Weight(double px, double py, double pz, double e, int pid, int npart, float &weight) const;
+
+    // n primaries, y may be null for a correction without rapidity dependence
+    void Weight(int n, const int *pid, const float *pt, const float *y, const int *npart, float *weight) const;
+    // n primaries of one event
+    void Weight(int n, const int *pid, const float *pt, const float *y, int npart, float *weight) const;
+
+private:
+    bool setup(const std::shared_ptr<CorrectionEngine> &engine);
+
+    std::shared_ptr<const CorrectionEngine> m_engine;
+    bool m_rapidity = false;
+};
+
+#endif // CORRECTIONWEIGHT_H
@@ -7,8 +7,14 @@
 #include <fun4all/Fun4AllReturnCodes.h>
 
 #include <phool/PHCompositeNode.h>
+#include <phool/PHDataNode.h>
+#include <phool/PHNodeIterator.h>
 #include <phool/getClass.h>
 
+#include <phparameter/PHParameters.h>
+
+#include <pdbcalbase/PdbParameterMap.h>
+
 #include <phhepmc/PHHepMCGenEvent.h>
 #include <phhepmc/PHHepMCGenEventMap.h>
 
@@ -29,13 +35,29 @@
 #include <HepMC/GenRanges.h>
 #include <HepMC/HeavyIon.h> // for HeavyIon
 
-#include <TFile.h>
-#include <TH1.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <unistd.h>
 
-#include <cassert>
+namespace {
+// node names of every event, built once instead of a temporary per lookup
+const std::string genevtmapnode = "PHHepMCGenEventMap";
+const std::string truthnode = "G4TruthInfo";
+
+std::string versionstring(uint64_t version) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) version);
+  return buffer;
+}
+} // namespace
 
 //____________________________________________________________________________..
 EnergyCorrection::EnergyCorrection(const std::string &name) : SubsysReco(name) {
+  m_instance = name + " " + std::to_string(getpid()) + " " +
+               std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) +
+               " " + std::to_string((unsigned long) this);
   std::cout << "EnergyCorrection::EnergyCorrection(const std::string &name) "
                "Calling ctor"
             << std::endl;
@@ -51,143 +73,350 @@ EnergyCorrection::~EnergyCorrection() {
 int EnergyCorrection::Init(PHCompositeNode *topNode) {
   std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) Initializing"
             << std::endl;
-  // read correction histogram from file
-  std::string filename = "/sphenix/user/shuhangli/dETdeta/macro/fitratio" + m_generatortype + ".root";
-  TFile *f_upweight =
-      new TFile(filename.c_str());
-  
-  std::string postfix[5] = {"0010_ratio", "1020_ratio", "2040_ratio",
-                            "4060_ratio", "6092_ratio"};
-
-  std::string filenamelambda = "/sphenix/user/shuhangli/dETdeta/macro/fitratioLambda" + m_generatortype + ".root";
-  TFile *f_upweightlambda =
-      new TFile(filenamelambda.c_str());
-  
-  for (int i = 0; i < 5; i++) {
-    h_pimi[i] = (TH1F *)f_upweight->Get(Form("h_pimi%s", postfix[i].c_str()));
-    h_pip[i] = (TH1F *)f_upweight->Get(Form("h_pip%s", postfix[i].c_str()));
-    h_p[i] = (TH1F *)f_upweight->Get(Form("h_p%s", postfix[i].c_str()));
-    h_pbar[i] = (TH1F *)f_upweight->Get(Form("h_pbar%s", postfix[i].c_str()));
-    h_kp[i] = (TH1F *)f_upweight->Get(Form("h_kp%s", postfix[i].c_str()));
-    h_kmi[i] = (TH1F *)f_upweight->Get(Form("h_kmi%s", postfix[i].c_str()));
-
-    h_lambda[i] = (TH1F *)f_upweightlambda->Get(Form("lambdaratio_%d", i));
-    h_lambdabar[i] = (TH1F *)f_upweightlambda->Get(Form("lambdabarratio_%d", i));
-
-    assert(h_pimi[i]);
-    assert(h_pip[i]);
-    assert(h_p[i]);
-    assert(h_pbar[i]);
-    assert(h_kp[i]);
-    assert(h_kmi[i]);
-    assert(h_lambda[i]);
-    assert(h_lambdabar[i]);
-
-  }
-
-  //set centralities average
-  if(m_generatortype == "HIJING") {
-    avgcent[0] = 329.815; 
-    avgcent[1] = 238.602;
-    avgcent[2] = 144.272;
-    avgcent[3] = 64.9728;
-    avgcent[4] = 17.8337;
-
-    avgcentlambda[0] = 356.192;
-    avgcentlambda[1] = 238.602;
-    avgcentlambda[2] = 144.272;
-    avgcentlambda[3] = 64.9728;
-    avgcentlambda[4] = 23.566;
-  }
-  else if(m_generatortype == "AMPT") {
-    avgcent[0] = 340.095;
-    avgcent[1] = 254.515;
-    avgcent[2] = 160.105;
-    avgcent[3] = 76.1558;
-    avgcent[4] = 22.783;
-
-    avgcentlambda[0] = 363.887;
-    avgcentlambda[1] = 254.515;
-    avgcentlambda[2] = 160.105;
-    avgcentlambda[3] = 76.1558;
-    avgcentlambda[4] = 29.5574;
-  }
-  else if (m_generatortype == "EPOS") {
-    avgcent[0] = 326.566;
-    avgcent[1] = 237.198;
-    avgcent[2] = 144.771;
-    avgcent[3] = 66.0863;
-    avgcent[4] = 18.3792;
-
-    avgcentlambda[0] = 356.192;
-    avgcentlambda[1] = 238.602;
-    avgcentlambda[2] = 144.272;
-    avgcentlambda[3] = 64.9728;
-    avgcentlambda[4] = 23.566;
-
-
-  }
-  else {
+  m_engine.SetVerbosity(Verbosity());
+
+  bool badgenerator = false;
+  std::shared_ptr<const CorrectionTables> tables = acquiretables(
+      m_generatortype, m_engine.GetRapidityDep(), m_tablefile, badgenerator);
+  if (badgenerator) {
     std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
                  "generator type not supported"
               << std::endl;
     return Fun4AllReturnCodes::ABORTEVENT;
   }
-  if(rapiditydep){
-    std::string filename  = "/sphenix/u/shuhang98/MakePlots/yspectrum/fittedratios.root";
-    TFile *f_upweightrap = new TFile(filename.c_str());
-
-     for (int i = 0; i < Pihistosize; i++) {
-        hPiplus[i] = (TH1F *)f_upweightrap->Get(Form("hPiplus_%d", i));
-        hPiminus[i] = (TH1F *)f_upweightrap->Get(Form("hPiminus_%d", i));
-        assert(hPiplus[i]);
-        assert(hPiminus[i]);
-     }
-      for (int i = 0; i < Khistosize; i++) {
-          hKplus[i] = (TH1F *)f_upweightrap->Get(Form("hKplus_%d", i));
-          hKminus[i] = (TH1F *)f_upweightrap->Get(Form("hKminus_%d", i));
-          assert(hKplus[i]);
-          assert(hKminus[i]);
-      }
-      for (int i = 0; i < Phistosize; i++) {
-          hP[i] = (TH1F *)f_upweightrap->Get(Form("hP_%d", i));
-          assert(hP[i]);
-      }
-      for (int i = 0; i < Pbarhistosize; i++) {
-          hPbar[i] = (TH1F *)f_upweightrap->Get(Form("hPbar_%d", i));
-          assert(hPbar[i]);
-      }
-      hPratio = (TH1F *)f_upweightrap->Get("hPratio_0");
-      hPbarratio = (TH1F *)f_upweightrap->Get("hPbarratio_0");
-      hPipratio = (TH1F *)f_upweightrap->Get("hPipratio_0");
-      hPimratio = (TH1F *)f_upweightrap->Get("hPimratio_0");
-      hKpratio = (TH1F *)f_upweightrap->Get("hKpratio_0");
-      hKmratio = (TH1F *)f_upweightrap->Get("hKmratio_0");
-      assert(hPratio);
-      assert(hPbarratio);
-      assert(hPipratio);
-      assert(hPimratio);
-      assert(hKpratio);
-      assert(hKmratio);
+  if (!tables)
+    return Fun4AllReturnCodes::ABORTRUN;
+  m_engine.SetTables(tables);
 
-      
+  if (!m_engine.Init()) {
+    std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                 "cannot set up the correction"
+              << std::endl;
+    return Fun4AllReturnCodes::ABORTRUN;
+  }
+  m_version = m_engine.GetVersion();
+  if (Verbosity() > 0)
+    std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                 "correction version "
+              << versionstring(m_version) << std::endl;
+
+  std::vector<std::string> speciesnames;
+  const SpeciesRegistry &species = m_engine.GetSpeciesRegistry();
+  for (int i = 0; i < species.GetNSpecies(); i++)
+    speciesnames.push_back(species.GetSpecies(i).name);
+  m_stats.SetSpecies(speciesnames);
+  if (!m_statsdump.empty() && !m_stats.OpenDump(m_statsdump)) {
+    std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                 "cannot open "
+              << m_statsdump << std::endl;
+    return Fun4AllReturnCodes::ABORTRUN;
+  }
+
+  if (!initvariants())
+    return Fun4AllReturnCodes::ABORTRUN;
+
+  if (!m_deltaname.empty()) {
+    if (!m_sidecarname.empty()) {
+      std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                   "the delta mode does not write a weight sidecar"
+                << std::endl;
+      return Fun4AllReturnCodes::ABORTRUN;
+    }
+    // the truth was upweighted from its own momenta, which are not recorded
+    if (m_upweighttruth) {
+      std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                   "the delta mode cannot upweight the truth particles again"
+                << std::endl;
+      return Fun4AllReturnCodes::ABORTRUN;
+    }
+    if (!m_delta.OpenRead(m_deltaname))
+      return Fun4AllReturnCodes::ABORTRUN;
+    if (!m_delta.Read(0)) {
+      std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                   "no events in "
+                << m_deltaname << std::endl;
+      return Fun4AllReturnCodes::ABORTRUN;
+    }
+    m_deltaversion = m_delta.GetVersion();
+    if (m_deltaversion == m_version) {
+      std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                << m_deltaname << " was written with the same correction "
+                << versionstring(m_version)
+                << ", refusing to apply it twice" << std::endl;
+      return Fun4AllReturnCodes::ABORTRUN;
+    }
+    m_deltaentry = 0;
+  }
+  // the truth would carry a correction that neither the hits nor the RUN
+  // records show
+  if (m_upweighttruth && !m_modifyhits) {
+    std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                 "the truth particles are only upweighted together with the "
+                 "hits, not with SetModifyHits(false)"
+              << std::endl;
+    return Fun4AllReturnCodes::ABORTRUN;
+  }
+  if (!m_provenancename.empty() && !m_provenance.OpenWrite(m_provenancename))
+    return Fun4AllReturnCodes::ABORTRUN;
+
+  std::vector<std::string> variantnames;
+  for (const Variant &variant : m_variants)
+    variantnames.push_back(variant.name);
+  if (!m_sidecarname.empty() &&
+      !m_sidecar.OpenWrite(m_sidecarname, variantnames))
+    return Fun4AllReturnCodes::ABORTRUN;
+
+  if (!m_snapshotname.empty() &&
+      !m_snapshot.OpenWrite(m_snapshotname, m_HitNodeNames))
+    return Fun4AllReturnCodes::ABORTRUN;
+
+  if (!m_qaname.empty())
+    m_qa.Setup(speciesnames, m_HitNodeNames,
+               m_engine.GetTables()->GetCentralityAverages(
+                   SpeciesRegistry::kCentDefault));
+
+  if (m_nthreads > 1) {
+    m_pool.Start(m_nthreads);
+    if (Verbosity() > 0)
+      std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                   "reweighting hits on "
+                << m_pool.GetNThreads() << " threads" << std::endl;
   }
 
   return Fun4AllReturnCodes::EVENT_OK;
 }
 
+//____________________________________________________________________________..
+int EnergyCorrection::InitRun(PHCompositeNode *topNode) {
+  PHNodeIterator iter(topNode);
+  if (!m_weighttablenode.empty()) {
+    m_weighttable =
+        findNode::getClass<PrimaryWeightTable>(topNode, m_weighttablenode);
+    if (!m_weighttable) {
+      PHCompositeNode *dstNode = dynamic_cast<PHCompositeNode *>(
+          iter.findFirst("PHCompositeNode", "DST"));
+      if (!dstNode) {
+        std::cout << "EnergyCorrection::InitRun(PHCompositeNode *topNode) "
+                     "Could not locate the DST node"
+                  << std::endl;
+        return Fun4AllReturnCodes::ABORTRUN;
+      }
+      m_weighttable = new PrimaryWeightTable();
+      dstNode->addNode(
+          new PHDataNode<PrimaryWeightTable>(m_weighttable, m_weighttablenode));
+    }
+  }
+
+  // the weights only go to the table, for the towers, or only to files
+  const bool tableonly = m_weighttable && !m_modifyhits;
+  if (!m_modifyhits && !tableonly)
+    return Fun4AllReturnCodes::EVENT_OK;
+  PHCompositeNode *runNode = dynamic_cast<PHCompositeNode *>(
+      iter.findFirst("PHCompositeNode", "RUN"));
+  if (!runNode) {
+    std::cout << "EnergyCorrection::InitRun(PHCompositeNode *topNode) "
+                 "Could not locate the RUN node"
+              << std::endl;
+    return Fun4AllReturnCodes::ABORTRUN;
+  }
+  // a table published by another job went into the towers of this input
+  const std::string tablerecordname = "EnergyCorrection_weighttable";
+  PHParameters tablerecord(tablerecordname);
+  PdbParameterMap *savedtable =
+      findNode::getClass<PdbParameterMap>(runNode, tablerecordname);
+  if (savedtable) {
+    tablerecord.FillFrom(savedtable);
+    if (tablerecord.get_string_param("instance") != m_instance) {
+      std::cout << "EnergyCorrection::InitRun(PHCompositeNode *topNode) "
+                   "the towers were already weighted with correction "
+                << tablerecord.get_string_param("version") << " by "
+                << tablerecord.get_string_param("instance")
+                << ", refusing to apply the correction twice" << std::endl;
+      return Fun4AllReturnCodes::ABORTRUN;
+    }
+  }
+  for (const std::string &nodename : m_HitNodeNames) {
+    const std::string recordname = "EnergyCorrection_" + nodename;
+    PHParameters record(recordname);
+    PdbParameterMap *saved =
+        findNode::getClass<PdbParameterMap>(runNode, recordname);
+    if (saved) {
+      record.FillFrom(saved);
+      // written by this instance for an earlier run
+      if (record.get_string_param("instance") == m_instance)
+        continue;
+    }
+    bool applied = saved && record.exist_string_param("version");
+    if (!m_delta.IsOpen() && applied) {
+      std::cout << "EnergyCorrection::InitRun(PHCompositeNode *topNode) "
+                << nodename << " was already reweighted with correction "
+                << record.get_string_param("version") << " by "
+                << record.get_string_param("instance")
+                << ", refusing to apply the correction twice" << std::endl;
+      return Fun4AllReturnCodes::ABORTRUN;
+    }
+    if (m_delta.IsOpen() &&
+        (!applied || record.get_string_param("version") !=
+                         versionstring(m_deltaversion))) {
+      std::cout << "EnergyCorrection::InitRun(PHCompositeNode *topNode) "
+                << nodename << " was not reweighted with the correction "
+                << versionstring(m_deltaversion) << " of " << m_deltaname
+                << std::endl;
+      return Fun4AllReturnCodes::ABORTRUN;
+    }
+    // the hits stay as they are
+    if (tableonly)
+      continue;
+    fillrunrecord(record);
+    record.SaveToNodeTree(runNode, recordname);
+  }
+  if (tableonly) {
+    fillrunrecord(tablerecord);
+    tablerecord.set_string_param("node", m_weighttablenode);
+    tablerecord.SaveToNodeTree(runNode, tablerecordname);
+  }
+  return Fun4AllReturnCodes::EVENT_OK;
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::fillrunrecord(PHParameters &record) const {
+  record.set_string_param("version", versionstring(m_version));
+  record.set_string_param("generator", m_generatortype);
+  record.set_int_param("rapidity", m_engine.GetRapidityDep());
+  record.set_int_param("heavierbaryons", m_engine.GetReweightHeavierBaryons());
+  record.set_int_param("weightgrid", m_engine.GetUseWeightGrid());
+  record.set_double_param("mineta", m_engine.GetMinEta());
+  record.set_double_param("maxeta", m_engine.GetMaxEta());
+  record.set_int_param("delta", m_delta.IsOpen());
+  record.set_string_param("instance", m_instance);
+}
+
+//____________________________________________________________________________..
+const CorrectionWeight &EnergyCorrection::GetWeightFunctor() {
+  if (!m_weightfunctor.IsValid() && m_engine.GetTables())
+    m_weightfunctor.Init(m_engine);
+  return m_weightfunctor;
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::AddVariant(const std::string &name,
+                                  const std::string &generatortype,
+                                  bool rapidity, bool heavierbaryons,
+                                  const std::string &tablefile) {
+  Variant variant;
+  variant.name = name;
+  variant.generatortype = generatortype;
+  variant.rapidity = rapidity;
+  variant.heavierbaryons = heavierbaryons;
+  variant.tablefile = tablefile;
+  m_variants.push_back(std::move(variant));
+}
+
+//____________________________________________________________________________..
+bool EnergyCorrection::initvariants() {
+  if (m_variants.empty())
+    return true;
+  if (m_sidecarname.empty()) {
+    std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                 "the variant weights need a weight sidecar"
+              << std::endl;
+    return false;
+  }
+  for (Variant &variant : m_variants) {
+    variant.engine.reset(new CorrectionEngine());
+    CorrectionEngine &engine = *variant.engine;
+    engine.CopySettings(m_engine);
+    engine.SetRapidityDep(variant.rapidity);
+    engine.SetReweightHeavierBaryons(variant.heavierbaryons);
+    bool badgenerator = false;
+    std::shared_ptr<const CorrectionTables> tables = acquiretables(
+        variant.generatortype, variant.rapidity, variant.tablefile,
+        badgenerator);
+    if (!tables) {
+      std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                   "cannot load the tables of variant "
+                << variant.name << std::endl;
+      return false;
+    }
+    engine.SetTables(tables);
+    if (!engine.Init()) {
+      std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+                   "cannot set up variant "
+                << variant.name << std::endl;
+      return false;
+    }
+  }
+  if (Verbosity() > 0)
+    std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) "
+              << m_variants.size() << " variants" << std::endl;
+  return true;
+}
+
+//____________________________________________________________________________..
+std::shared_ptr<const CorrectionTables>
+EnergyCorrection::acquiretables(const std::string &generatortype,
+                                bool rapidity, const std::string &tablefile,
+                                bool &badgenerator) const {
+  if (!m_sharetables) {
+    std::shared_ptr<CorrectionTables> own =
+        std::make_shared<CorrectionTables>();
+    if (!loadtables(*own, generatortype, rapidity, tablefile, badgenerator))
+      return nullptr;
+    return own;
+  }
+  // everything loadtables() reads
+  std::string key = generatortype;
+  if (!tablefile.empty())
+    key += " file " + tablefile;
+  else
+    key += " dir " + m_tabledir;
+  if (rapidity && tablefile.empty())
+    key += " rapidity " + m_raptablefile;
+  std::shared_ptr<const CorrectionTables> tables = CorrectionTables::Acquire(
+      key, [&](CorrectionTables &t) {
+        return loadtables(t, generatortype, rapidity, tablefile, badgenerator);
+      });
+  if (Verbosity() > 0)
+    std::cout << "EnergyCorrection::Init(PHCompositeNode *topNode) tables "
+              << key << ", " << tables.use_count() - 1 << " other users"
+              << std::endl;
+  return tables;
+}
+
+//____________________________________________________________________________..
+bool EnergyCorrection::loadtables(CorrectionTables &tables,
+                                  const std::string &generatortype,
+                                  bool rapidity, const std::string &tablefile,
+                                  bool &badgenerator) const {
+  if (!tablefile.empty()) {
+    // the centrality averages come with the tables
+    return tables.LoadTableFile(tablefile, generatortype, Verbosity());
+  }
+  if (!tables.SetGeneratorType(generatortype)) {
+    badgenerator = true;
+    return false;
+  }
+  if (!tables.LoadPtTables(generatortype, m_tabledir))
+    return false;
+  if (rapidity && !tables.LoadRapidityTables(m_raptablefile))
+    return false;
+  return true;
+}
+
 //____________________________________________________________________________..
 int EnergyCorrection::process_event(PHCompositeNode *topNode) {
   if (Verbosity() > 0)
     std::cout << "EnergyCorrection::process_event(PHCompositeNode *topNode) "
                  "Processing Event"
               << std::endl;
+  ReweightStats::Clock::time_point start = m_stats.Start();
+  m_inputevent++;
 
   PHHepMCGenEventMap *genevtmap =
-      findNode::getClass<PHHepMCGenEventMap>(topNode, "PHHepMCGenEventMap");
+      findNode::getClass<PHHepMCGenEventMap>(topNode, genevtmapnode);
   if (!genevtmap) {
     std::cout << "no genevtmap" << std::endl;
-    return Fun4AllReturnCodes::ABORTEVENT;
+    return abortevent();
   }
   for (PHHepMCGenEventMap::Iter iter = genevtmap->begin();
        iter != genevtmap->end(); ++iter) {
@@ -213,85 +442,106 @@ int EnergyCorrection::process_event(PHCompositeNode *topNode) {
   }
   if (m_npart < 0) {
     std::cout << "cant find npart" << std::endl;
-    return Fun4AllReturnCodes::ABORTEVENT;
+    return abortevent();
   }
+  m_engine.SetNpart(m_npart);
 
   // get truthinfo
   PHG4TruthInfoContainer *truthinfo =
-      findNode::getClass<PHG4TruthInfoContainer>(topNode, "G4TruthInfo");
+      findNode::getClass<PHG4TruthInfoContainer>(topNode, truthnode);
   // get primary particles
   if (!truthinfo) {
     std::cout << "EnergyCorrection::process_event(PHCompositeNode *topNode) "
                  "Could not locate G4TruthInfo node"
               << std::endl;
-    return Fun4AllReturnCodes::ABORTEVENT;
+    return abortevent();
   }
  
 
-  // get hits
-  PHG4HitContainer *hits =
-      findNode::getClass<PHG4HitContainer>(topNode, m_HitNodeName);
-  if (!hits) {
-    std::cout << "EnergyCorrection::process_event(PHCompositeNode *topNode) "
-                 "Could not locate g4 hit node "
-              << m_HitNodeName << std::endl;
-    return Fun4AllReturnCodes::ABORTEVENT;
-  }
-  PHG4HitContainer::ConstRange hit_range = hits->getHits();
-  for (PHG4HitContainer::ConstIterator hit_iter = hit_range.first;
-       hit_iter != hit_range.second; hit_iter++) {
-    PHG4Hit *hit = hit_iter->second;
-    int showerid = hit_iter->second->get_shower_id();
-    PHG4Shower *shower = truthinfo->GetPrimaryShower(showerid);
-    if (!shower) {
-      if (Verbosity() > 0)
-        std::cout << "EnergyCorrection::process_event(PHCompositeNode "
-                     "*topNode) No shower found showerid: "
-                  << showerid << std::endl;
-      continue;
-    }
-    int trkid = shower->get_parent_particle_id();
-    PHG4Particle *part = truthinfo->GetParticle(trkid);
-    if (!part) {
+  // get hits, all containers are reweighted with the same primary weights
+  m_hitcontainers.clear();
+  for (const std::string &nodename : m_HitNodeNames) {
+    PHG4HitContainer *hits =
+        findNode::getClass<PHG4HitContainer>(topNode, nodename);
+    if (!hits) {
       std::cout << "EnergyCorrection::process_event(PHCompositeNode *topNode) "
-                   "No parent particle found, track id: "
-                << trkid << std::endl;
+                   "Could not locate g4 hit node "
+                << nodename << std::endl;
+      return abortevent();
     }
-    // get particle pid and pt
-    
-    float pt =
-        sqrt(part->get_px() * part->get_px() + part->get_py() * part->get_py());
+    m_hitcontainers.push_back(hits);
+  }
+  // the recorded primaries of the delta mode, before the stats record is
+  // opened
+  if (m_delta.IsOpen() && !readdelta())
+    return Fun4AllReturnCodes::ABORTRUN;
+  // only events that are reweighted get a stats record, every one of them
+  // reaches EndEvent()
+  m_stats.BeginEvent();
+  m_stats.Lap(ReweightStats::kNodeLookup, start);
+  // new event, every entry of the primary weight table becomes stale
+  m_eventcounter++;
+  m_sidecar.BeginEvent();
+  indexevent(truthinfo);
+  m_stats.Lap(ReweightStats::kTruthLookup, start);
 
-    float pz = part->get_pz();
-    float p = sqrt(pt * pt + pz * pz);
-    float eta = 0.5 * log((p + pz) / (p - pz));
-    
+  // inputs before any hit is modified
+  if (m_snapshot.IsWriting() &&
+      (m_eventcounter - 1) % m_snapshotprescale == 0 &&
+      (m_snapshotmaxevents < 0 ||
+       m_snapshot.GetNEvents() < (unsigned long) m_snapshotmaxevents))
+    capturesnapshot(truthinfo);
 
-    if (eta < mineta || eta > maxeta)
-      continue;
-    // find correction factor for G4Hits
-    float scale = 1.0;
-    int pid = part->get_pid();
-    if(!rapiditydep){
-      scale = findcorrection(m_npart, pid, pt);
-    }
-    else{
-      float e = part->get_e();
-      float y = 0.5 * log((e + pz) / (e - pz));
-      scale = findrapcorrection(pid, pt, y, m_npart);
-    }
+  const bool sampleqa = !m_qaname.empty() && m_qa.Sample(m_eventcounter);
+  if (sampleqa) {
+    m_qa.BeginEvent(m_npart);
+    sumedep(m_qaedep[0]);
+  }
 
-    // apply correction
-    hit->set_edep(hit->get_edep() * scale);
-    hit->set_light_yield(hit->get_light_yield() * scale);
+  if (m_delta.IsOpen())
+    reweightdelta();
+  else if (m_weighttable && !m_modifyhits)
+    reweightprimaries();
+  else if (m_pool.GetNThreads() > 1)
+    reweightparallel();
+  else if (m_engine.GetUseWeightGrid() && m_usebatchkernel)
+    reweightbatch();
+  else
+    reweightscalar();
+
+  if (m_weighttable)
+    fillweighttable();
+  if (m_sidecar.IsWriting() || m_provenance.IsWriting())
+    collecteventprimaries();
+  if (m_sidecar.IsWriting()) {
+    evaluatevariants();
+    storesidecar();
+  }
+  if (m_provenance.IsWriting())
+    storeprovenance();
+
+  if (sampleqa)
+    fillqa();
+
+  if (Verbosity() > 0) {
+    unsigned long nhits = m_stats.GetEventCount(ReweightStats::kHits);
+    unsigned long nprimaries = m_stats.GetEventCount(ReweightStats::kPrimaries);
+    std::cout << "EnergyCorrection::process_event(PHCompositeNode *topNode) "
+              << nhits << " hits from " << nprimaries
+              << " primaries, hits per primary weight: "
+              << (nprimaries > 0 ? (double) nhits / nprimaries : 0.)
+              << std::endl;
   }
 
   if (m_upweighttruth) {
     PHG4TruthInfoContainer::Range range = truthinfo->GetPrimaryParticleRange();
+    double truthbefore = 0;
+    double truthchange = 0;
 
     for (PHG4TruthInfoContainer::Iterator iter = range.first;
          iter != range.second; ++iter) {
       PHG4Particle *particle = iter->second;
+      truthbefore += particle->get_e();
       float pz = particle->get_pz();
       
       float pt = sqrt(particle->get_px() * particle->get_px() +
@@ -301,24 +551,668 @@ int EnergyCorrection::process_event(PHCompositeNode *topNode) {
 
       float eta = 0.5 * log((p + pz) / (p - pz));
 
-      if (eta < mineta || eta > maxeta)
+      if (eta < m_engine.GetMinEta() || eta > m_engine.GetMaxEta())
         continue;
 
-      int pid = particle->get_pid();
-
-      float scale = findcorrection(m_npart, pid, pt);
+      // the hit weights are the same centrality correction unless they
+      // include the rapidity dependence
+      float scale = 1.0;
+      int iprimary = m_index.FindTrack(iter->first);
+      const PrimaryWeight *entry =
+          iprimary >= 0 ? &m_primaryweights[iprimary] : nullptr;
+      if (!m_engine.GetRapidityDep() && entry && entry->event == m_eventcounter) {
+        scale = entry->scale;
+      } else {
+        int pid = particle->get_pid();
+        scale = m_engine.ptcorrection(m_npart, pid, pt);
+      }
+      truthchange += (scale - 1) * particle->get_e();
       particle->set_e(particle->get_e() * scale);
       particle->set_px(particle->get_px() * scale);
       particle->set_py(particle->get_py() * scale);
       particle->set_pz(particle->get_pz() * scale);
     }
+    if (sampleqa)
+      m_qa.FillTruth(truthbefore, truthbefore + truthchange);
   }
+  m_stats.EndEvent(m_eventcounter, m_npart);
+  if (m_sidecar.IsWriting())
+    m_sidecar.Fill(m_inputevent, m_npart);
 
   return Fun4AllReturnCodes::EVENT_OK;
 }
 
+//____________________________________________________________________________..
+void EnergyCorrection::capturesnapshot(PHG4TruthInfoContainer *truthinfo) {
+  m_snapshotevent.clear();
+  m_snapshotevent.event = m_eventcounter;
+  m_snapshotevent.npart = m_npart;
+  m_snapshotprimaries.clear();
+  for (unsigned int icont = 0; icont < m_hitcontainers.size(); icont++) {
+    PHG4HitContainer::ConstRange hit_range = m_hitcontainers[icont]->getHits();
+    for (PHG4HitContainer::ConstIterator hit_iter = hit_range.first;
+         hit_iter != hit_range.second; hit_iter++) {
+      PHG4Hit *hit = hit_iter->second;
+      EventSnapshot::Hit snaphit;
+      snaphit.container = icont;
+      snaphit.showerid = hit->get_shower_id();
+      int iprimary = m_index.Find(snaphit.showerid);
+      if (iprimary >= 0) {
+        snaphit.trkid = m_index.GetPrimary(iprimary).trkid;
+        m_snapshotprimaries.push_back(iprimary);
+      } else if (iprimary == ShowerIndex::noparticle) {
+        // the replay reports the missing parent too
+        snaphit.trkid =
+            truthinfo->GetPrimaryShower(snaphit.showerid)->get_parent_particle_id();
+      } else {
+        snaphit.trkid = EventSnapshot::noshower;
+      }
+      snaphit.edep = hit->get_edep();
+      snaphit.lightyield = hit->get_light_yield();
+      m_snapshotevent.hits.push_back(snaphit);
+    }
+  }
+  // every primary once, those missing from the truth container are left out
+  std::sort(m_snapshotprimaries.begin(), m_snapshotprimaries.end());
+  m_snapshotprimaries.erase(
+      std::unique(m_snapshotprimaries.begin(), m_snapshotprimaries.end()),
+      m_snapshotprimaries.end());
+  for (int iprimary : m_snapshotprimaries) {
+    const ShowerIndex::Primary &part = m_index.GetPrimary(iprimary);
+    EventSnapshot::Primary primary;
+    primary.trkid = part.trkid;
+    primary.pid = part.pid;
+    primary.px = part.px;
+    primary.py = part.py;
+    primary.pz = part.pz;
+    primary.e = part.e;
+    m_snapshotevent.primaries.push_back(primary);
+  }
+  if (!m_snapshot.Write(m_snapshotevent))
+    m_snapshot.Close();
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::collecteventprimaries() {
+  m_eventprimaries.clear();
+  for (int iprimary = 0; iprimary < m_index.GetNPrimaries(); iprimary++) {
+    if (m_primaryweights[iprimary].event == m_eventcounter)
+      m_eventprimaries.push_back(iprimary);
+  }
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::evaluatevariants() {
+  const int nvariants = m_variants.size();
+  if (nvariants == 0)
+    return;
+  ReweightStats::Clock::time_point start = m_stats.Start();
+  const int nprimaries = m_eventprimaries.size();
+  m_variantweights.resize(nprimaries * nvariants);
+  // the variants share the species rules, one batch serves all of them
+  const bool usekernel = m_engine.GetUseWeightGrid() && m_usebatchkernel;
+  if (usekernel) {
+    const int unitspecies = m_engine.GetKernel().GetUnitSpecies();
+    m_variantbatch.clear();
+    for (int iprimary : m_eventprimaries) {
+      const ShowerIndex::Primary &part = m_index.GetPrimary(iprimary);
+      m_variantbatch.push_back(part.px, part.py, part.pz, part.e,
+                               part.species < 0 ? unitspecies : part.species);
+    }
+  }
+  for (int ivariant = 0; ivariant < nvariants; ivariant++) {
+    CorrectionEngine &engine = *m_variants[ivariant].engine;
+    engine.SetNpart(m_npart);
+    if (usekernel)
+      engine.GetKernel().Evaluate(m_variantbatch);
+    for (int i = 0; i < nprimaries; i++) {
+      float &scale = m_variantweights[i * nvariants + ivariant];
+      if (usekernel) {
+        scale = m_variantbatch.accepted[i] ? m_variantbatch.weight[i] : 1;
+      } else {
+        const ShowerIndex::Primary &part =
+            m_index.GetPrimary(m_eventprimaries[i]);
+        engine.Weight(part.px, part.py, part.pz, part.e, part.pid, m_npart,
+                      scale);
+      }
+    }
+  }
+  m_stats.Lap(ReweightStats::kWeight, start);
+}
+
+//____________________________________________________________________________..
+int EnergyCorrection::abortevent() {
+  // the sidecar keeps one entry per input event, the reader runs on the
+  // original DST which still has this event
+  if (m_sidecar.IsWriting()) {
+    m_sidecar.BeginEvent();
+    m_sidecar.Fill(m_inputevent, WeightSidecar::abortednpart);
+  }
+  return Fun4AllReturnCodes::ABORTEVENT;
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::storesidecar() {
+  // primaries whose nominal or any variant weight differs from 1
+  const int nvariants = m_variants.size();
+  for (unsigned int i = 0; i < m_eventprimaries.size(); i++) {
+    int iprimary = m_eventprimaries[i];
+    const PrimaryWeight &entry = m_primaryweights[iprimary];
+    float scale = entry.accepted ? entry.scale : 1;
+    const float *variantweights =
+        nvariants > 0 ? &m_variantweights[i * nvariants] : nullptr;
+    bool listed = scale != 1;
+    for (int ivariant = 0; ivariant < nvariants; ivariant++)
+      listed |= variantweights[ivariant] != 1;
+    if (listed)
+      m_sidecar.Add(m_index.GetPrimary(iprimary).trkid, scale,
+                    variantweights);
+  }
+}
+
+//____________________________________________________________________________..
+bool EnergyCorrection::readdelta() {
+  if (!m_delta.Read(m_deltaentry)) {
+    std::cout << "EnergyCorrection::process_event(PHCompositeNode *topNode) "
+                 "no provenance for event "
+              << m_deltaentry << " in " << m_deltaname << std::endl;
+    return false;
+  }
+  m_deltaentry++;
+  if (m_delta.GetNpart() != m_npart || m_delta.GetVersion() != m_deltaversion) {
+    std::cout << "EnergyCorrection::process_event(PHCompositeNode *topNode) "
+                 "provenance of event "
+              << m_delta.GetEvent() << " in " << m_deltaname
+              << " does not belong to this event, Npart " << m_npart
+              << " recorded " << m_delta.GetNpart() << std::endl;
+    return false;
+  }
+  const SpeciesRegistry &registry = m_engine.GetSpeciesRegistry();
+  const int nprimaries = m_delta.GetNPrimaries();
+  m_deltaprimaries.resize(nprimaries);
+  m_deltaweights.resize(nprimaries);
+  for (int i = 0; i < nprimaries; i++) {
+    ShowerIndex::Primary &primary = m_deltaprimaries[i];
+    primary.trkid = m_delta.GetTrackId(i);
+    primary.pid = m_delta.GetPid(i);
+    primary.species = registry.Index(primary.pid);
+    primary.px = m_delta.GetPx(i);
+    primary.py = m_delta.GetPy(i);
+    primary.pz = m_delta.GetPz(i);
+    primary.e = m_delta.GetE(i);
+    m_deltaweights[i] = m_delta.GetWeight(i);
+  }
+  return true;
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::reweightdelta() {
+  ReweightStats::Clock::time_point start = m_stats.Start();
+  // new/old weight of every recorded primary, the index keeps their order
+  const int nprimaries = m_deltaprimaries.size();
+  for (int iprimary = 0; iprimary < nprimaries; iprimary++) {
+    const ShowerIndex::Primary &part = m_deltaprimaries[iprimary];
+    float scale;
+    m_engine.Weight(part.px, part.py, part.pz, part.e, part.pid, m_npart,
+                    scale);
+    PrimaryWeight &entry = m_primaryweights[iprimary];
+    entry.event = m_eventcounter;
+    entry.accepted = true;
+    entry.scale = m_deltaweights[iprimary] > 0 ? scale / m_deltaweights[iprimary] : 1;
+    m_stats.CountSpecies(part.species);
+    m_stats.Count(ReweightStats::kPrimaries);
+  }
+  m_stats.Lap(ReweightStats::kWeight, start);
+
+  for (PHG4HitContainer *hits : m_hitcontainers) {
+    PHG4HitContainer::ConstRange hit_range = hits->getHits();
+    for (PHG4HitContainer::ConstIterator hit_iter = hit_range.first;
+         hit_iter != hit_range.second; hit_iter++) {
+      PHG4Hit *hit = hit_iter->second;
+      m_stats.Count(ReweightStats::kHits);
+      int showerid = hit->get_shower_id();
+      int iprimary = m_index.Find(showerid);
+      if (iprimary < 0) {
+        countunresolved(iprimary, showerid);
+        continue;
+      }
+      float scale = m_primaryweights[iprimary].scale;
+      if (scale == 1) {
+        m_stats.Count(ReweightStats::kHitsPassthrough);
+      } else if (m_modifyhits) {
+        hit->set_edep(hit->get_edep() * scale);
+        hit->set_light_yield(hit->get_light_yield() * scale);
+      }
+    }
+  }
+  m_stats.Lap(ReweightStats::kHitUpdate, start);
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::storeprovenance() {
+  // the kinematics before the truth upweighting, the weight the hits got
+  m_provenance.BeginEvent();
+  for (int iprimary : m_eventprimaries) {
+    const PrimaryWeight &entry = m_primaryweights[iprimary];
+    const ShowerIndex::Primary &part = m_index.GetPrimary(iprimary);
+    float applied = m_modifyhits && entry.accepted ? entry.scale : 1;
+    if (m_delta.IsOpen())
+      applied *= m_deltaweights[iprimary];
+    m_provenance.Add(part.trkid, part.pid, part.px, part.py, part.pz, part.e,
+                     applied);
+  }
+  m_provenance.Fill(m_eventcounter, m_npart, m_version);
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::sumedep(std::vector<double> &edep) const {
+  edep.assign(m_hitcontainers.size(), 0);
+  for (unsigned int icont = 0; icont < m_hitcontainers.size(); icont++) {
+    PHG4HitContainer::ConstRange hit_range = m_hitcontainers[icont]->getHits();
+    for (PHG4HitContainer::ConstIterator hit_iter = hit_range.first;
+         hit_iter != hit_range.second; hit_iter++)
+      edep[icont] += hit_iter->second->get_edep();
+  }
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::fillqa() {
+  sumedep(m_qaedep[1]);
+  for (unsigned int icont = 0; icont < m_hitcontainers.size(); icont++)
+    m_qa.FillEdep(icont, m_qaedep[0][icont], m_qaedep[1][icont]);
+  // every primary with hits has its weight of this event in the table
+  for (int iprimary = 0; iprimary < m_index.GetNPrimaries(); iprimary++) {
+    const PrimaryWeight &entry = m_primaryweights[iprimary];
+    if (entry.event != m_eventcounter || !entry.accepted)
+      continue;
+    const ShowerIndex::Primary &part = m_index.GetPrimary(iprimary);
+    m_qa.FillPrimary(part.species, part.px, part.py, entry.scale);
+  }
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::indexevent(PHG4TruthInfoContainer *truthinfo) {
+  if (m_delta.IsOpen())
+    m_index.Build(truthinfo, m_deltaprimaries);
+  else
+    m_index.Build(truthinfo, m_engine.GetSpeciesRegistry());
+  if (m_primaryweights.size() < (unsigned int) m_index.GetNPrimaries())
+    m_primaryweights.resize(m_index.GetNPrimaries());
+  // primaries without hits are not in a provenance record
+  if (m_delta.IsOpen())
+    return;
+  for (int trkid : m_index.GetMissingParents())
+    std::cout << "EnergyCorrection::process_event(PHCompositeNode *topNode) "
+                 "No parent particle found, track id: "
+              << trkid << std::endl;
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::countunresolved(int iprimary, int showerid) {
+  if (iprimary == ShowerIndex::noparticle) {
+    // reported once per parent by indexevent()
+    m_stats.Count(ReweightStats::kHitsNoParticle);
+    return;
+  }
+  m_stats.Count(ReweightStats::kHitsNoShower);
+  if (Verbosity() > 0)
+    std::cout << "EnergyCorrection::process_event(PHCompositeNode "
+                 "*topNode) No shower found showerid: "
+              << showerid << std::endl;
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::reweightscalar() {
+  ReweightStats::Clock::time_point start = m_stats.Start();
+  for (PHG4HitContainer *hits : m_hitcontainers) {
+    PHG4HitContainer::ConstRange hit_range = hits->getHits();
+    for (PHG4HitContainer::ConstIterator hit_iter = hit_range.first;
+         hit_iter != hit_range.second; hit_iter++) {
+      PHG4Hit *hit = hit_iter->second;
+      m_stats.Count(ReweightStats::kHits);
+      int showerid = hit->get_shower_id();
+      int iprimary = m_index.Find(showerid);
+      if (iprimary < 0) {
+        countunresolved(iprimary, showerid);
+        continue;
+      }
+
+      // weight of this primary, computed by the first hit that references it
+      PrimaryWeight *entry = &m_primaryweights[iprimary];
+      if (entry->event != m_eventcounter) {
+        const ShowerIndex::Primary &part = m_index.GetPrimary(iprimary);
+        m_stats.Lap(ReweightStats::kTruthLookup, start);
+        CorrectionEngine::Kinematics kin;
+        entry->accepted =
+            m_engine.Accept(part.px, part.py, part.pz, part.e, kin);
+        m_stats.Lap(ReweightStats::kKinematics, start);
+        entry->scale = 1.0;
+        if (entry->accepted)
+          entry->scale = m_engine.Correction(part.pid, m_npart, kin);
+        else
+          m_stats.Count(ReweightStats::kPrimariesEtaRejected);
+        m_stats.Lap(ReweightStats::kWeight, start);
+        m_stats.CountSpecies(part.species);
+        m_stats.Count(ReweightStats::kPrimaries);
+        entry->event = m_eventcounter;
+      } else {
+        m_stats.Lap(ReweightStats::kTruthLookup, start);
+      }
+
+      // apply correction
+      if (!entry->accepted) {
+        m_stats.Count(ReweightStats::kHitsEtaRejected);
+      } else if (entry->scale == 1) {
+        m_stats.Count(ReweightStats::kHitsPassthrough);
+      } else if (m_modifyhits) {
+        float scale = entry->scale;
+        hit->set_edep(hit->get_edep() * scale);
+        hit->set_light_yield(hit->get_light_yield() * scale);
+      }
+      m_stats.Lap(ReweightStats::kHitUpdate, start);
+    }
+  }
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::reweightbatch() {
+  const WeightKernel &kernel = m_engine.GetKernel();
+  ReweightStats::Clock::time_point start = m_stats.Start();
+  // gather: one batch entry per primary, one slot index per hit
+  m_batch.clear();
+  m_batchprimary.clear();
+  m_slothits.clear();
+  m_hitbuffer.clear();
+  m_hitslot.clear();
+  for (PHG4HitContainer *hits : m_hitcontainers) {
+    PHG4HitContainer::ConstRange hit_range = hits->getHits();
+    for (PHG4HitContainer::ConstIterator hit_iter = hit_range.first;
+         hit_iter != hit_range.second; hit_iter++) {
+      PHG4Hit *hit = hit_iter->second;
+      m_stats.Count(ReweightStats::kHits);
+      int showerid = hit->get_shower_id();
+      int iprimary = m_index.Find(showerid);
+      if (iprimary < 0) {
+        countunresolved(iprimary, showerid);
+        continue;
+      }
+
+      PrimaryWeight &entry = m_primaryweights[iprimary];
+      int slot;
+      if (entry.event == m_eventcounter) {
+        slot = entry.slot;
+      } else {
+        const ShowerIndex::Primary &part = m_index.GetPrimary(iprimary);
+        m_stats.CountSpecies(part.species);
+        int species = part.species < 0 ? kernel.GetUnitSpecies() : part.species;
+        slot = m_batch.size();
+        m_batch.push_back(part.px, part.py, part.pz, part.e, species);
+        m_batchprimary.push_back(iprimary);
+        m_slothits.push_back(0);
+        entry.event = m_eventcounter;
+        entry.slot = slot;
+      }
+      m_hitbuffer.push_back(hit);
+      m_hitslot.push_back(slot);
+      m_slothits[slot]++;
+    }
+  }
+  m_stats.Lap(ReweightStats::kTruthLookup, start);
+
+  // evaluate all primaries at once, kinematics included
+  kernel.Evaluate(m_batch);
+  m_stats.Lap(ReweightStats::kWeight, start);
+  if (m_benchmarkkernel) {
+    benchmarkkernel();
+    start = m_stats.Start();
+  }
+
+  storeweights();
+
+  // scatter the weights back onto the hits
+  const int nhitbuffer = m_modifyhits ? m_hitbuffer.size() : 0;
+  for (int ihit = 0; ihit < nhitbuffer; ihit++) {
+    int slot = m_hitslot[ihit];
+    if (!m_batch.accepted[slot])
+      continue;
+    float scale = m_batch.weight[slot];
+    if (scale == 1)
+      continue;
+    PHG4Hit *hit = m_hitbuffer[ihit];
+    hit->set_edep(hit->get_edep() * scale);
+    hit->set_light_yield(hit->get_light_yield() * scale);
+  }
+  m_stats.Lap(ReweightStats::kHitUpdate, start);
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::storeweights() {
+  // weights of the batch into the primary weight table, used by the truth
+  // upweighting, and the per-primary counters
+  const int nbatch = m_batch.size();
+  for (int slot = 0; slot < nbatch; slot++) {
+    bool accepted = m_batch.accepted[slot];
+    float scale = accepted ? m_batch.weight[slot] : 1;
+    PrimaryWeight &entry = m_primaryweights[m_batchprimary[slot]];
+    entry.accepted = accepted;
+    entry.scale = scale;
+    m_stats.Count(ReweightStats::kPrimaries);
+    if (!accepted) {
+      m_stats.Count(ReweightStats::kPrimariesEtaRejected);
+      m_stats.Count(ReweightStats::kHitsEtaRejected, m_slothits[slot]);
+    } else if (scale == 1) {
+      m_stats.Count(ReweightStats::kHitsPassthrough, m_slothits[slot]);
+    }
+  }
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::reweightparallel() {
+  // The walk over the hit maps stays serial, the shower lookup of every hit
+  // runs on the pool. Assigning batch entries to primaries, counting and
+  // printing are then one serial pass over the lookup results in hit order,
+  // so the weights and the messages are the same as in the serial paths,
+  // whatever the thread count. The weights and the hit updates are spread
+  // over the pool too.
+  ReweightStats::Clock::time_point start = m_stats.Start();
+  m_hitbuffer.clear();
+  for (PHG4HitContainer *hits : m_hitcontainers) {
+    PHG4HitContainer::ConstRange hit_range = hits->getHits();
+    for (PHG4HitContainer::ConstIterator hit_iter = hit_range.first;
+         hit_iter != hit_range.second; hit_iter++)
+      m_hitbuffer.push_back(hit_iter->second);
+  }
+  const int nhitbuffer = m_hitbuffer.size();
+  m_stats.Count(ReweightStats::kHits, nhitbuffer);
+
+  // primary of every hit, each chunk writes its own hits
+  m_hitslot.resize(nhitbuffer);
+  m_pool.ParallelFor(nhitbuffer, hitgrain, [&](int begin, int end) {
+    for (int ihit = begin; ihit < end; ihit++)
+      m_hitslot[ihit] = m_index.Find(m_hitbuffer[ihit]->get_shower_id());
+  });
+
+  // one batch entry per primary, in order of the first hit; the primary of
+  // each hit becomes its batch entry, -1 for hits that are not reweighted
+  m_batchprimary.clear();
+  m_slothits.clear();
+  for (int ihit = 0; ihit < nhitbuffer; ihit++) {
+    int iprimary = m_hitslot[ihit];
+    if (iprimary < 0) {
+      countunresolved(iprimary, m_hitbuffer[ihit]->get_shower_id());
+      m_hitslot[ihit] = -1;
+      continue;
+    }
+    PrimaryWeight &entry = m_primaryweights[iprimary];
+    if (entry.event != m_eventcounter) {
+      entry.event = m_eventcounter;
+      entry.slot = m_batchprimary.size();
+      m_batchprimary.push_back(iprimary);
+      m_slothits.push_back(0);
+    }
+    m_hitslot[ihit] = entry.slot;
+    m_slothits[entry.slot]++;
+  }
+  m_stats.Lap(ReweightStats::kTruthLookup, start);
+
+  weighbatch(start);
+
+  // scatter, every hit is written by exactly one chunk
+  m_pool.ParallelFor(m_modifyhits ? nhitbuffer : 0, hitgrain, [&](int begin, int end) {
+    for (int ihit = begin; ihit < end; ihit++) {
+      int slot = m_hitslot[ihit];
+      if (slot < 0 || !m_batch.accepted[slot])
+        continue;
+      float scale = m_batch.weight[slot];
+      if (scale == 1)
+        continue;
+      PHG4Hit *hit = m_hitbuffer[ihit];
+      hit->set_edep(hit->get_edep() * scale);
+      hit->set_light_yield(hit->get_light_yield() * scale);
+    }
+  });
+  m_stats.Lap(ReweightStats::kHitUpdate, start);
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::weighbatch(ReweightStats::Clock::time_point &start) {
+  // kinematics and weights of the primaries of m_batchprimary over the pool,
+  // counted as weight time
+  const WeightKernel &kernel = m_engine.GetKernel();
+  const int nbatch = m_batchprimary.size();
+  const bool usekernel = m_engine.GetUseWeightGrid() && m_usebatchkernel;
+  m_batch.resize(nbatch);
+  m_pool.ParallelFor(nbatch, primarygrain, [&](int begin, int end) {
+    for (int slot = begin; slot < end; slot++) {
+      const ShowerIndex::Primary &part =
+          m_index.GetPrimary(m_batchprimary[slot]);
+      m_batch.px[slot] = part.px;
+      m_batch.py[slot] = part.py;
+      m_batch.pz[slot] = part.pz;
+      m_batch.e[slot] = part.e;
+      if (usekernel) {
+        m_batch.species[slot] =
+            part.species < 0 ? kernel.GetUnitSpecies() : part.species;
+      } else {
+        PrimaryWeight weight;
+        computeprimaryweight(part.px, part.py, part.pz, part.e, part.pid,
+                             weight);
+        m_batch.weight[slot] = weight.scale;
+        m_batch.accepted[slot] = weight.accepted;
+      }
+    }
+    if (usekernel)
+      kernel.Evaluate(m_batch, begin, end);
+  });
+  m_stats.Lap(ReweightStats::kWeight, start);
+
+  for (int slot = 0; slot < nbatch; slot++)
+    m_stats.CountSpecies(m_index.GetPrimary(m_batchprimary[slot]).species);
+  storeweights();
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::reweightprimaries() {
+  // no hit loop: every primary of the index gets its weight, the hits are
+  // weighted downstream through the weight table
+  ReweightStats::Clock::time_point start = m_stats.Start();
+  const int nbatch = m_index.GetNPrimaries();
+  m_batchprimary.resize(nbatch);
+  m_slothits.assign(nbatch, 0);
+  for (int slot = 0; slot < nbatch; slot++) {
+    m_batchprimary[slot] = slot;
+    m_primaryweights[slot].event = m_eventcounter;
+    m_primaryweights[slot].slot = slot;
+  }
+  weighbatch(start);
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::fillweighttable() {
+  m_weighttable->Reset(&m_index, m_eventcounter, m_npart, m_modifyhits);
+  for (int iprimary = 0; iprimary < m_index.GetNPrimaries(); iprimary++) {
+    const PrimaryWeight &entry = m_primaryweights[iprimary];
+    if (entry.event == m_eventcounter && entry.accepted)
+      m_weighttable->SetWeight(iprimary, entry.scale);
+  }
+}
+
+//____________________________________________________________________________..
+void EnergyCorrection::benchmarkkernel() {
+  WeightKernel &kernel = m_engine.GetKernel();
+  // time the same batch through the per-primary scalar path and both kernels
+  const int nbatch = m_batch.size();
+  if (nbatch == 0)
+    return;
+  PrimaryWeight entry;
+  float checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int slot = 0; slot < nbatch; slot++) {
+    computeprimaryweight(m_batch.px[slot], m_batch.py[slot], m_batch.pz[slot],
+                         m_batch.e[slot],
+                         m_index.GetPrimary(m_batchprimary[slot]).pid, entry);
+    checksum += entry.scale;
+  }
+  auto stop = std::chrono::steady_clock::now();
+  m_benchns[0] += std::chrono::duration<double, std::nano>(stop - start).count();
+
+  WeightKernel::Isa isa = kernel.GetIsa();
+  WeightKernel::Isa isas[2] = {WeightKernel::kScalar, WeightKernel::kAVX2};
+  for (int i = 0; i < 2; i++) {
+    kernel.SetIsa(isas[i]);
+    if (kernel.GetIsa() != isas[i])
+      continue;
+    start = std::chrono::steady_clock::now();
+    kernel.Evaluate(m_batch);
+    stop = std::chrono::steady_clock::now();
+    m_benchns[i + 1] +=
+        std::chrono::duration<double, std::nano>(stop - start).count();
+  }
+  kernel.SetIsa(isa);
+  kernel.Evaluate(m_batch);
+  m_benchprimaries += nbatch;
+  m_benchhits += m_hitbuffer.size();
+  if (Verbosity() > 2)
+    std::cout << "EnergyCorrection::benchmarkkernel() checksum " << checksum
+              << std::endl;
+}
+
 //____________________________________________________________________________..
 int EnergyCorrection::End(PHCompositeNode *topNode) {
+  m_stats.Print();
+  m_stats.CloseDump();
+  m_sidecar.Close();
+  m_provenance.Close();
+  if (m_delta.IsOpen() && m_deltaentry != m_delta.GetEntries())
+    std::cout << "EnergyCorrection::End(PHCompositeNode *topNode) "
+              << m_deltaentry << " events rescaled, " << m_delta.GetEntries()
+              << " in " << m_deltaname << std::endl;
+  m_delta.Close();
+  if (m_snapshot.IsWriting())
+    std::cout << "EnergyCorrection::End(PHCompositeNode *topNode) "
+              << m_snapshot.GetNEvents() << " event snapshots in "
+              << m_snapshotname << std::endl;
+  m_snapshot.Close();
+  if (!m_qaname.empty()) {
+    m_qa.Print();
+    if (m_qa.Write(m_qaname))
+      std::cout << "EnergyCorrection::End(PHCompositeNode *topNode) QA of "
+                << m_qa.GetNEvents() << " events in " << m_qaname
+                << std::endl;
+  }
+  if (m_benchprimaries > 0) {
+    const char *names[3] = {"per-primary scalar path", "scalar kernel",
+                            "AVX2 kernel"};
+    for (int i = 0; i < 3; i++) {
+      if (m_benchns[i] <= 0)
+        continue;
+      std::cout << "EnergyCorrection::End(PHCompositeNode *topNode) "
+                << names[i] << ": " << m_benchns[i] / m_benchprimaries
+                << " ns/primary, " << m_benchns[i] / m_benchhits
+                << " ns/hit" << std::endl;
+    }
+  }
+  m_pool.Stop();
   std::cout
       << "EnergyCorrection::End(PHCompositeNode *topNode) This is the End..."
       << std::endl;
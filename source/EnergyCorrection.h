@@ -3,13 +3,29 @@
 #ifndef ENERGYCORRECTION_H
 #define ENERGYCORRECTION_H
 
+#include "CorrectionEngine.h"
+#include "CorrectionWeight.h"
+#include "EventSnapshot.h"
+#include "PrimaryWeightTable.h"
+#include "ReweightProvenance.h"
+#include "ReweightStats.h"
+#include "ShowerIndex.h"
+#include "WeightQA.h"
+#include "WeightSidecar.h"
+#include "WorkStealingPool.h"
+
 #include <fun4all/SubsysReco.h>
-#include <TH1.h>
 
-#include <string>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
 class PHCompositeNode;
+class PHParameters;
+class PHG4Hit;
+class PHG4HitContainer;
+class PHG4TruthInfoContainer;
 
 class EnergyCorrection : public SubsysReco
 {
@@ -25,389 +41,296 @@ public:
         database, because you know the run number. A place
         to book histograms which have to know the run number.
      */
+    // records the correction applied to each hit container on the RUN node,
+    // or with SetWeightTableNode() and SetModifyHits(false) the one published
+    // for the towers, and refuses input that was already corrected either
+    // way, e.g. by a second instance of this module or in the job that wrote
+    // the input DST
+    int InitRun(PHCompositeNode *topNode) override;
 
     /** Called for each event.
         This is where you do the real work.
      */
-
+    // all per-event scratch (index, weight tables, batch and hit buffers)
+    // belongs to the module and is reset, not freed, between events: once
+    // the largest event has been seen nothing is allocated here, see
+    // EnergyCorrectionReplay -a
     int process_event(PHCompositeNode *topNode) override;
 
     /// Called at the end of all processing.
     int End(PHCompositeNode *topNode) override;
 
-    void SetHitNodeName(const std::string &name) { m_HitNodeName = name; }
+    // hit containers reweighted by this module, the truth lookups and primary
+    // weights of an event are shared by all of them
+    void SetHitNodeName(const std::string &name) { m_HitNodeNames.assign(1, name); }
+    void AddHitNodeName(const std::string &name) { m_HitNodeNames.push_back(name); }
+    void SetHitNodeNames(const std::vector<std::string> &names) { m_HitNodeNames = names; }
+    // scale the truth particles with the weights of their hits, only together
+    // with the hit rewrite
     void SetUpweightTruth(bool upweight) { m_upweighttruth = upweight; }
-    void SetRapidityDep(bool rapidity = true) { rapiditydep = rapidity; }
+    void SetRapidityDep(bool rapidity = true) { m_engine.SetRapidityDep(rapidity); }
 
     void SetGeneratorType(const std::string &type) { m_generatortype = type; }
 
-    void SetMinEta(float min) { mineta = min; }
-    void SetMaxEta(float max) { maxeta = max; }
+    // directory of fitratio<generator>.root and fitratioLambda<generator>.root
+    // and the file of the rapidity tables
+    void SetTableDirectory(const std::string &dir) { m_tabledir = dir; }
+    void SetRapidityTableFile(const std::string &filename) { m_raptablefile = filename; }
+    // binary table file from EnergyCorrectionTableConverter, mapped instead of
+    // reading the ROOT files above
+    void SetTableFile(const std::string &filename) { m_tablefile = filename; }
+    // modules with the same generator, rapidity mode and table source share
+    // one read-only copy of the tables; false loads a private one
+    void SetShareTables(bool share) { m_sharetables = share; }
+
+    void SetMinEta(float min) { m_engine.SetMinEta(min); }
+    void SetMaxEta(float max) { m_engine.SetMaxEta(max); }
+
+    void SetReweightHeavierBaryons(bool reweight) { m_engine.SetReweightHeavierBaryons(reweight); }
+
+    // use the precomputed lookup grid, collapsed to one pt curve per table at
+    // the start of each event, instead of calling TH1F::Interpolate for every
+    // hit; false gives the old histogram path
+    void SetUseWeightGrid(bool use = true) { m_engine.SetUseWeightGrid(use); }
+    // number of pt nodes per curve, 0 picks it from the finest histogram binning
+    void SetWeightGridPtNodes(int n) { m_engine.SetWeightGridPtNodes(n); }
+    // largest relative grid/histogram difference accepted by the Init() check
+    void SetWeightGridTolerance(float tol) { m_engine.SetWeightGridTolerance(tol); }
+
+    // with the grid, gather the primaries of all hits into one batch and
+    // evaluate it with the vectorized kernel before scattering the weights back
+    void SetUseBatchKernel(bool use = true) { m_usebatchkernel = use; }
+    // WeightKernel::kScalar forces the portable kernel, AVX2 is used if available
+    void SetKernelIsa(WeightKernel::Isa isa) { m_engine.SetKernelIsa(isa); }
+    // time the per-primary scalar path and the kernels on every batch, printed at End()
+    void SetBenchmarkKernel(bool bench = true) { m_benchmarkkernel = bench; }
+
+    // reweight the hits on nthreads threads (including the Fun4All one);
+    // the weights are identical to the serial ones, 1 keeps everything serial
+    void SetNumThreads(int nthreads) { m_nthreads = nthreads; }
+
+    // per-stage timers, printed at End() with the counters; they read the clock
+    // for every hit on the scalar path, the counters alone are always on
+    void SetStageTimers(bool timers = true) { m_stats.SetTimers(timers); }
+    // write the counters (and timers) of every event to a TTree (.root) or as
+    // JSON lines (any other name)
+    void SetStatsDump(const std::string &filename) { m_statsdump = filename; }
+    const ReweightStats &GetStats() const { return m_stats; }
+
+    // write the primary weights of every event to a sidecar file, applied
+    // downstream by EnergyCorrectionReader
+    void SetWeightSidecar(const std::string &filename) { m_sidecarname = filename; }
+    // a systematic variant of the correction, e.g.
+    //   AddVariant("AMPT", "AMPT", false);
+    // is evaluated for every primary with hits in the same pass, with the eta
+    // range, grid and species rules of this module, and its weights go to the
+    // sidecar as weight_<name>, selected downstream by
+    // EnergyCorrectionReader::SetVariant(); the hits and the truth only get the
+    // nominal weights. tablefile is a binary table file of the variant
+    // generator, empty reads its ROOT tables from the table directory
+    void AddVariant(const std::string &name, const std::string &generatortype, bool rapidity, bool heavierbaryons = true,
+                    const std::string &tablefile = "");
+    // false leaves the hits untouched, e.g. when only the sidecar is wanted
+    void SetModifyHits(bool modify) { m_modifyhits = modify; }
+
+    // publish the weights of each event as PHDataNode<PrimaryWeightTable>
+    // nodename under DST, every primary gets its weight. With
+    // SetModifyHits(false) the hits are not walked at all and only
+    // EnergyCorrectionTowers applies the weights, to HCal sim towers built
+    // from edep; the hits, the cells and the CEMC towers stay uncorrected,
+    // so the hit rewrite remains the general correction.
+    void SetWeightTableNode(const std::string &nodename = PrimaryWeightTable::defaultnode) { m_weighttablenode = nodename; }
+
+    // record the correction version, Npart and the kinematics and applied weight of
+    // every primary with hits of each event
+    void SetProvenanceFile(const std::string &filename) { m_provenancename = filename; }
+    // delta mode: the hits were reweighted by a job that wrote this
+    // provenance file and are rescaled by the ratio of the weights of the
+    // tables configured here to the recorded ones, computed from the recorded
+    // kinematics instead of the truth particles, which are left alone
+    void SetDeltaProvenance(const std::string &filename) { m_deltaname = filename; }
+
+    // dump the reweighting inputs of every prescale-th event, at most
+    // maxevents, for EnergyCorrectionReplay
+    void SetSnapshotFile(const std::string &filename, int prescale = 1, int maxevents = -1)
+    {
+        m_snapshotname = filename;
+        m_snapshotprescale = prescale > 0 ? prescale : 1;
+        m_snapshotmaxevents = maxevents;
+    }
+
+    // QA summaries of the applied weights from every prescale-th event,
+    // written at End() as histograms (.root) or as JSON (any other name)
+    void SetQAFile(const std::string &filename, int prescale = 10)
+    {
+        m_qaname = filename;
+        m_qa.SetPrescale(prescale);
+    }
+    const WeightQA &GetQA() const { return m_qa; }
+
+    // pid -> species rules, e.g. GetSpeciesRegistry().Map(3312, "Lambda");
+    // compiled into the dense lookup at Init()
+    SpeciesRegistry &GetSpeciesRegistry() { return m_engine.GetSpeciesRegistry(); }
 
-    void SetReweightHeavierBaryons(bool reweight) { reweightheavierbaryons = reweight; }
+    // tables and weights of single primaries
+    CorrectionEngine &GetCorrectionEngine() { return m_engine; }
+    // the same correction as a const, thread-safe functor for analyses
+    // outside Fun4All, sharing the tables; valid after Init()
+    const CorrectionWeight &GetWeightFunctor();
 
 private:
-    std::string m_HitNodeName {"G4HIT_CEMC"};
+    std::vector<std::string> m_HitNodeNames {"G4HIT_CEMC"};
     std::string m_generatortype {"HIJING"};
+    std::string m_tabledir {CorrectionTables::defaulttabledir};
+    std::string m_raptablefile {CorrectionTables::defaultrapfile};
+    std::string m_tablefile;
+    bool m_sharetables = true;
+
+    // the tables of a generator, shared or private, loaded from tablefile or
+    // the ROOT files; null if they cannot be loaded, badgenerator if the
+    // generator is unknown
+    std::shared_ptr<const CorrectionTables> acquiretables(const std::string &generatortype, bool rapidity,
+                                                          const std::string &tablefile, bool &badgenerator) const;
+    bool loadtables(CorrectionTables &tables, const std::string &generatortype, bool rapidity, const std::string &tablefile,
+                    bool &badgenerator) const;
     
     bool m_upweighttruth = false;
-    bool rapiditydep = false;
 
     int m_npart =  -1;
 
-    float mineta = -2.5;
-    float maxeta = 2.5;
-
-    bool reweightheavierbaryons = true;
-
-    static const int ncentbins = 5;
-    TH1F *h_pimi[ncentbins] = {nullptr};
-    TH1F *h_pip[ncentbins] = {nullptr};
-    TH1F *h_p[ncentbins] = {nullptr};
-    TH1F *h_pbar[ncentbins] = {nullptr};
-    TH1F *h_kp[ncentbins] = {nullptr};
-    TH1F *h_kmi[ncentbins] = {nullptr};
-
-    TH1F *h_lambda[ncentbins] = {nullptr};
-    TH1F *h_lambdabar[ncentbins] = {nullptr};   
-
-    //pi
-    std::vector<std::vector<float>> rapIntervalsPi = {{-0.1,0.},{0.,0.1},{0.4,0.6},{0.6,0.8},{0.8,1.0}, {1.0,1.2},{1.2,1.4},{2.1,2.3},{2.4,2.6},{3.0,3.1},{3.1,3.2},{3.2,3.3}, {3.3,3.4},{3.4,3.66}};
-    //K
-    std::vector<std::vector<float>> rapIntervalsK = {{-0.1,0.},{0.,0.1},{0.4,0.6},{0.6,0.8},{0.8,1.0}, {1.0,1.2},{2.0,2.2},{2.3,2.5},{2.9,3.0},{3.0,3.1},{3.1,3.2},{3.2,3.4}};
-    //p
-    std::vector<std::vector<float>> rapIntervalsP = {{-0.1,0.1},{0.75,0.95},{1.7,2.4},{2.7,3.1}};
-    //pbar
-    std::vector<std::vector<float>> rapIntervalsPbar = {{-0.1,0.1},{0.75,0.95},{1.7,2.4},{2.7,3.1}};
-
-    //rapidity dependent correction
-    static const int Pihistosize = 14;
-    static const int Khistosize = 12;
-    static const int Phistosize = 4;
-    static const int Pbarhistosize = 4;
-
-    TH1F *hPiplus[Pihistosize] = {nullptr};
-    TH1F *hPiminus[Pihistosize] = {nullptr};
-    TH1F *hKplus[Khistosize] = {nullptr};
-    TH1F *hKminus[Khistosize] = {nullptr};
-    TH1F *hP[Phistosize] = {nullptr};
-    TH1F *hPbar[Pbarhistosize] = {nullptr};
-    TH1F *hPratio = nullptr;
-    TH1F *hPbarratio = nullptr;
-    TH1F *hPipratio = nullptr;
-    TH1F* hPimratio = nullptr;
-    TH1F* hKpratio = nullptr;
-    TH1F* hKmratio = nullptr;
-
-    const std::vector<std::vector<float>>& getRapidityIntervals(int pid) {
-    switch(pid) {
-        case 211: return rapIntervalsPi;
-        case -211: return rapIntervalsPi;
-        case 321: return rapIntervalsK;
-        case -321: return rapIntervalsK;
-        case 2212: return rapIntervalsP;
-        case -2212: return rapIntervalsPbar;
-        default: throw std::invalid_argument("Invalid particle ID");
-    }
-}   
-
-    TH1F* getHist(int pid, int i) {
-    switch(pid) {
-        case 211: return hPiplus[i];
-        case -211: return hPiminus[i];
-        case 321: return hKplus[i];
-        case -321: return hKminus[i];
-        case 2212: return hP[i];
-        case -2212: return hPbar[i];
-
-        default: throw std::invalid_argument("Invalid particle ID");
-    }
+    CorrectionEngine m_engine;
+    CorrectionWeight m_weightfunctor;
 
-    }
-
-    float findrapscale(int pid, float pt, float y){
-        float scale = 1;
-        y = std::abs(y);
-        const auto& rapIntervals = getRapidityIntervals(pid);
-        int Lowerbin = -1;
-        int Upperbin = 1000;
-
-        std::vector<float> meanrapidity;
-        for (int i = 0; i < (int)rapIntervals.size(); i++)
-        {
-            meanrapidity.push_back(abs(rapIntervals[i][0] + rapIntervals[i][1]) / 2);
-        }
-        // find which two bins the y falls in between, and interpolate
-        for (int i = 0; i < (int) meanrapidity.size() - 1; i++)
-        {
-
-            if (y >= meanrapidity[i] && y <= meanrapidity[i + 1])
-            {
-                Lowerbin = i;
-                Upperbin = i + 1;
-                break;
-            }
-        }
-        if(y < meanrapidity[0]){
-            Lowerbin = -1;
-            Upperbin = 0;
-        }
-        if(y > meanrapidity[meanrapidity.size()-1]){
-            Lowerbin = meanrapidity.size()-1;
-            Upperbin = 1000;
-        }
-        //interpolation
-        if (Lowerbin == -1 && Upperbin == 0)
-        {
-            TH1F *h = getHist(pid, Upperbin);
-            scale = h->Interpolate(pt);
-        }
-        else if (Upperbin == 1000)
-        {
-            TH1F *h = getHist(pid, Lowerbin);
-            scale = h->Interpolate(pt);
-        }
-        else
-        {
-            TH1F *h1 = getHist(pid, Lowerbin);
-            TH1F *h2 = getHist(pid, Upperbin);
-            scale = (h1->Interpolate(pt) * (meanrapidity[Upperbin] - y) + h2->Interpolate(pt) * (y - meanrapidity[Lowerbin])) / (meanrapidity[Upperbin] - meanrapidity[Lowerbin]);
-        }
-        return scale;
-    }
+    // truth of the event, built once before the hit loops
+    ShowerIndex m_index;
+    void indexevent(PHG4TruthInfoContainer *truthinfo);
+    // counts a hit whose shower (noshower) or parent (noparticle) is missing
+    void countunresolved(int iprimary, int showerid);
 
-    float findrapcorrection(int pid, float pt, float y, int npart)
+    // per-event weight of each primary, indexed like the primaries of
+    // m_index; an entry is valid only if its event stamp matches
+    // m_eventcounter, so the table is never cleared and keeps its capacity
+    // from one event to the next
+    struct PrimaryWeight
     {
+        unsigned int event = 0;
+        bool accepted = false;
         float scale = 1;
-        if (pid == 211 )
-        {
-            //scale = findrapscale(pid, pt, y);
-            scale = findcorrection(npart,211, pt) * hPipratio->Interpolate(std::abs(y)) / hPipratio->Interpolate(0);
-        }
-        else if(pid == -211){
-            scale = findcorrection(npart,-211, pt) * hPimratio->Interpolate(std::abs(y)) / hPimratio->Interpolate(0);
-        }
-        else if(pid == 321){
-            scale = findcorrection(npart,321, pt) * hKpratio->Interpolate(std::abs(y)) / hKpratio->Interpolate(0);
-        }
-        else if(pid == -321){
-            scale = findcorrection(npart,-321, pt) * hKmratio->Interpolate(std::abs(y)) / hKmratio->Interpolate(0);
-        }
-        else if(pid == 111){
-            float scaleplus = findcorrection(npart,211, pt) * hPipratio->Interpolate(std::abs(y)) / hPipratio->Interpolate(0);
-            float scaleminus = findcorrection(npart,-211, pt) * hPimratio->Interpolate(std::abs(y)) / hPimratio->Interpolate(0);
-            scale = (scaleplus + scaleminus) / 2.;
-        }
-        else if(pid == 130 || pid == 310 || pid == 311){
-            float scaleplus = findcorrection(npart,321, pt) * hKpratio->Interpolate(std::abs(y)) / hKpratio->Interpolate(0);
-            float scaleminus = findcorrection(npart,-321, pt) * hKmratio->Interpolate(std::abs(y)) / hKmratio->Interpolate(0);
-            scale = (scaleplus + scaleminus) / 2.;
-        }
-        //if proton or neutron
-        else if (pid == 2212 || pid == 2112)
-        {
-            scale = findcorrection(npart,2212, pt) * hPratio->Interpolate(std::abs(y)) / hPratio->Interpolate(0);
-        }
-        //if antiproton or antineutron
-        else if (pid == -2212 || pid == -2112)
-        {
-            scale = findcorrection(npart,-2212, pt) * hPbarratio->Interpolate(std::abs(y)) / hPratio->Interpolate(0);
-        }
-        //other baryons just use PHENIX and STAR data
-        else if(pid > 2000 && pid < 4000){
-            scale = findcorrection(npart,pid, pt);
-        }
-        else if(pid < -2000 && pid > -4000){
-            scale = findcorrection(npart,pid, pt);
-        }
-        //std::cout<<"PHENIX" <<findcorrection(npart,pid, pt) << "RAPIDITY" << scale << std::endl; 
-        return scale;
-    }
-
+        // batch entry of this primary
+        int slot = -1;
+    };
+    std::vector<PrimaryWeight> m_primaryweights;
+    unsigned int m_eventcounter = 0;
+    // every call of process_event, aborted events included, from 1; the
+    // event id of the sidecar entries
+    int m_inputevent = 0;
 
+    std::vector<PHG4HitContainer *> m_hitcontainers;
 
+    ReweightStats m_stats;
+    std::string m_statsdump;
 
+    bool m_modifyhits = true;
+    std::string m_sidecarname;
+    WeightSidecar m_sidecar;
 
-    
-    float avgcent[ncentbins] = {325.8, 236.1, 141.5, 61.6, 14.7};
-    float avgcentlambda[ncentbins] = {356.192, 238.602, 144.272, 64.9728, 23.566};
-    
-
-    float findcorrection(int npart, int pid, float pt)
+    struct Variant
     {
-        float weight[ncentbins] = {0};
-        float weightlambda[ncentbins] = {0};
-        float scale = 0;
-        if (npart > avgcentlambda[0] || npart < avgcentlambda[ncentbins - 1])
-        {
-            if (npart > avgcentlambda[0])
-                weightlambda[0] = 1;
-            if (npart < avgcentlambda[ncentbins - 1])
-                weightlambda[ncentbins - 1] = 1;           
-        }
-        else{
-
-             // use interpolation here
-            // first find which two bins the npart falls in between
-
-            int lowerBinlambda = -1;
-            int upperBinlambda = -1;
-
-
-            for (int i = 0; i < ncentbins - 1; i++)
-            {
-                if (npart <= avgcentlambda[i] && npart >= avgcentlambda[i + 1])
-                {
-                    lowerBinlambda = i;
-                    upperBinlambda = i + 1;
-                    break;
-                }
-            }
-
-            weightlambda[upperBinlambda] = (avgcentlambda[lowerBinlambda] - npart) / (avgcentlambda[lowerBinlambda] - avgcentlambda[upperBinlambda]);
-            weightlambda[lowerBinlambda] = (npart - avgcentlambda[upperBinlambda]) / (avgcentlambda[lowerBinlambda] - avgcentlambda[upperBinlambda]);
-            
-        }
-
-
-        if (npart > avgcent[0] || npart < avgcent[ncentbins - 1])
-        {
-            if (npart > avgcent[0])
-                weight[0] = 1;
-            if (npart < avgcent[ncentbins - 1])
-                weight[ncentbins - 1] = 1;
-        }
-        else
-        {
-            // use interpolation here
-            // first find which two bins the npart falls in between
-            int lowerBin = -1;
-            int upperBin = -1;
-
-        
-
-            for (int i = 0; i < ncentbins - 1; i++)
-            {
-                if (npart <= avgcent[i] && npart >= avgcent[i + 1])
-                {
-                    lowerBin = i;
-                    upperBin = i + 1;
-                    break;
-                }
-            }
-
-         
-            // interpolate
-            weight[upperBin] = (avgcent[lowerBin] - npart) / (avgcent[lowerBin] - avgcent[upperBin]);
-            weight[lowerBin] = (npart - avgcent[upperBin]) / (avgcent[lowerBin] - avgcent[upperBin]);
-
-           // print all weights and the sum
-        }
-        // if pi0 then use the average of pi+ and pi-
-        if (pid == 111)
-        {
-            for (int i = 0; i < ncentbins; i++)
-            {
-                scale += weight[i] * (h_pip[i]->Interpolate(pt) + h_pimi[i]->Interpolate(pt)) / 2.;
-            }
-        }
-        else if (pid == 130 || pid == 310 || pid == 311)
-        {
-            for (int i = 0; i < ncentbins; i++)
-            {
-                scale += weight[i] * (h_kmi[i]->Interpolate(pt) + h_kp[i]->Interpolate(pt)) / 2.;
-            }
-        }
-        else if (pid == 211)
-        {
-            // loop over cent bins
-            for (int i = 0; i < ncentbins; i++)
-            {
-
-                scale += weight[i] * h_pip[i]->Interpolate(pt);
-            }
-        }
-        else if (pid == -211)
-        {
-            // loop over cent bins
-            for (int i = 0; i < ncentbins; i++)
-            {
-                scale += weight[i] * h_pimi[i]->Interpolate(pt);
-            }
-        }
-      
-        // k+
-
-        else if (pid == 321)
-        {
-            // loop over cent bins
-            for (int i = 0; i < ncentbins; i++)
-            {
-                scale += weight[i] * h_kp[i]->Interpolate(pt);
-            }
-        }
-        // k-
-        else if (pid == -321)
-        {
-            // loop over cent bins
-            for (int i = 0; i < ncentbins; i++)
-            {
-
-                scale += weight[i] * h_kmi[i] -> Interpolate(pt);
-            }
-        }
-        //lambda and sigmas
-        else if (pid == 3122 || pid == 3222 || pid == 3212 || pid == 3112)
-        {
-            // loop over cent bins
-            for (int i = 0; i < ncentbins; i++)
-            {
-                scale += weightlambda[i] * h_lambda[i]->Interpolate(pt);
-            }
-            
-        }
-        //antilambda and antisigmas
-        else if (pid == -3122 || pid == -3222 || pid == -3212 || pid == -3112)
-        {
-            // loop over cent bins
-            for (int i = 0; i < ncentbins; i++)
-            {
-                scale += weightlambda[i] * h_lambdabar[i]->Interpolate(pt);
-            }
-        }
-
-        else if (pid > 2000 && pid < 4000)
-        {
-
-            // loop over cent bins
-            for (int i = 0; i < ncentbins; i++)
-            {
-                scale += weight[i] * h_p[i]->Interpolate(pt);
-            }
-            if (!reweightheavierbaryons)
-            {
-                scale = 1;
-            }
-        }
-        else if (pid < -2000 && pid > -4000)
-        {
-
-            // loop over cent bins
-            for (int i = 0; i < ncentbins; i++)
-            {
-                scale += weight[i] * h_pbar[i]->Interpolate(pt);
-            }
-            if (!reweightheavierbaryons)
-            {
-                scale = 1;
-            }
-        }
-        else
-        {
-            scale = 1;
-        }
-        return scale;
+        std::string name;
+        std::string generatortype;
+        bool rapidity = false;
+        bool heavierbaryons = true;
+        std::string tablefile;
+        std::unique_ptr<CorrectionEngine> engine;
+    };
+    std::vector<Variant> m_variants;
+    // primaries with hits in this event, m_index numbering
+    std::vector<int> m_eventprimaries;
+    // their variant weights, [event primary][variant]
+    std::vector<float> m_variantweights;
+    WeightBatch m_variantbatch;
+    bool initvariants();
+    void collecteventprimaries();
+    void evaluatevariants();
+    void storesidecar();
+    // ABORTEVENT, with an empty sidecar entry for the event
+    int abortevent();
+
+    std::string m_weighttablenode;
+    // owned by the node tree
+    PrimaryWeightTable *m_weighttable = nullptr;
+    void reweightprimaries();
+    void fillweighttable();
+
+    // version of the correction in use, tables and settings, and a tag of
+    // this instance for its own records on the RUN node
+    uint64_t m_version = 0;
+    std::string m_instance;
+    void fillrunrecord(PHParameters &record) const;
+
+    std::string m_provenancename;
+    ReweightProvenance m_provenance;
+    void storeprovenance();
+
+    std::string m_deltaname;
+    ReweightProvenance m_delta;
+    long long m_deltaentry = 0;
+    uint64_t m_deltaversion = 0;
+    // the recorded primaries of the event and their applied weights
+    std::vector<ShowerIndex::Primary> m_deltaprimaries;
+    std::vector<float> m_deltaweights;
+    bool readdelta();
+    void reweightdelta();
+
+    std::string m_snapshotname;
+    int m_snapshotprescale = 1;
+    int m_snapshotmaxevents = -1;
+    EventSnapshotFile m_snapshot;
+    EventSnapshot m_snapshotevent;
+    std::vector<int> m_snapshotprimaries;
+    void capturesnapshot(PHG4TruthInfoContainer *truthinfo);
+
+    std::string m_qaname;
+    WeightQA m_qa;
+    // edep of each container before and after the reweighting
+    std::vector<double> m_qaedep[2];
+    void sumedep(std::vector<double> &edep) const;
+    void fillqa();
+
+    void computeprimaryweight(double px, double py, double pz, double e, int pid, PrimaryWeight &entry) const
+    {
+        entry.accepted = m_engine.Weight(px, py, pz, e, pid, m_npart, entry.scale);
     }
+
+    void reweightscalar();
+    void reweightbatch();
+    void storeweights();
+    // weights of the primaries of m_batchprimary into m_batch and the table
+    void weighbatch(ReweightStats::Clock::time_point &start);
+
+    bool m_usebatchkernel = true;
+    // primaries of the event, the m_index primary of each batch entry
+    WeightBatch m_batch;
+    std::vector<int> m_batchprimary;
+    // number of hits of each batch entry
+    std::vector<unsigned int> m_slothits;
+    // hits of all containers and the batch entry of their primary, -1 for
+    // the hits of the threaded path that are not reweighted
+    std::vector<PHG4Hit *> m_hitbuffer;
+    std::vector<int> m_hitslot;
+
+    int m_nthreads = 1;
+    WorkStealingPool m_pool;
+    // indices per chunk of the parallel loops
+    static const int hitgrain = 4096;
+    static const int primarygrain = 256;
+    void reweightparallel();
+
+    bool m_benchmarkkernel = false;
+    double m_benchns[3] = {0};
+    unsigned long m_benchprimaries = 0;
+    unsigned long m_benchhits = 0;
+    void benchmarkkernel();
 };
 
 #endif // ENERGYCORRECTION_H
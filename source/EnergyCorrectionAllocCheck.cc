@@ -0,0 +1,288 @@
+//____________________________________________________________________________..
+//
+// Counts the memory allocations of EnergyCorrection::process_event once the
+// per-event buffers have their size. A synthetic HIJING-like event is put on
+// a node tree of its own for every configuration of the module and
+// processed repeatedly with changing Npart; every operator new after the
+// warm-up events is a failure. The correction tables are made-up curves
+// written to a table file first, as in EnergyCorrectionBench.
+//
+//   EnergyCorrectionAllocCheck [nprimaries] [nevents]
+//
+// Covered: histogram and weight grid scalar path, batch kernel, thread
+// pool, rapidity dependent correction, truth upweighting and the primary
+// weight table with and without the hit rewrite. The file outputs (sidecar,
+// provenance, snapshots, QA) are not, ROOT allocates when it writes a basket.
+// Returns non-zero if any configuration allocates in steady state.
+//____________________________________________________________________________..
+
+#include "CorrectionEngine.h"
+#include "EnergyCorrection.h"
+#include "SpeciesRegistry.h"
+
+#include <fun4all/Fun4AllReturnCodes.h>
+
+#include <phool/PHCompositeNode.h>
+#include <phool/PHIODataNode.h>
+#include <phool/PHObject.h>
+
+#include <g4main/PHG4HitContainer.h>
+#include <g4main/PHG4Hitv1.h>
+#include <g4main/PHG4Particlev2.h>
+#include <g4main/PHG4Showerv1.h>
+#include <g4main/PHG4TruthInfoContainer.h>
+
+#include <phhepmc/PHHepMCGenEvent.h>
+#include <phhepmc/PHHepMCGenEventMap.h>
+
+#include <HepMC/GenEvent.h>
+#include <HepMC/HeavyIon.h>
+
+#include <TH1.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+// every operator new of the process, the pool threads included
+std::atomic<unsigned long> g_allocations(0);
+} // namespace
+
+void *operator new(std::size_t size) {
+  g_allocations++;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+const std::string tablefile = "EnergyCorrectionAllocCheck_tables.bin";
+const std::vector<std::string> hitnodes = {"G4HIT_CEMC", "G4HIT_HCALIN",
+                                           "G4HIT_HCALOUT"};
+// Npart of the events in turn, the grid is collapsed at every change
+const int npartcycle[] = {350, 120, 30};
+const int ncycle = sizeof(npartcycle) / sizeof(npartcycle[0]);
+
+struct Config {
+  std::string name;
+  std::function<void(EnergyCorrection &)> setup;
+};
+
+//____________________________________________________________________________..
+TH1F *maketable(const std::string &name, int nbins, float max, float amp,
+                float slope) {
+  TH1F *h = new TH1F(name.c_str(), name.c_str(), nbins, 0, max);
+  h->SetDirectory(nullptr);
+  for (int ibin = 1; ibin <= h->GetNbinsX(); ibin++)
+    h->SetBinContent(ibin,
+                     1 + amp * std::exp(-h->GetBinCenter(ibin) / slope));
+  return h;
+}
+
+//____________________________________________________________________________..
+bool writetables() {
+  CorrectionEngine engine;
+  for (int table = 0; table < SpeciesRegistry::ntables; table++) {
+    for (int i = 0; i < CorrectionEngine::ncentbins; i++) {
+      std::string name = std::string("alloc_") +
+                         SpeciesRegistry::GetTableName(table) + "_" +
+                         std::to_string(i);
+      engine.SetPtTable(table, i,
+                        maketable(name, 100, 10, 0.1 + 0.03 * table, 1.5));
+    }
+  }
+  engine.SetGeneratorType("HIJING");
+  for (int raptable = 0; raptable < SpeciesRegistry::nraptables; raptable++) {
+    std::vector<TH1F *> intervals;
+    for (int i = 0; i < engine.GetNRapidityIntervals(raptable); i++)
+      intervals.push_back(maketable("alloc_rap" + std::to_string(raptable) +
+                                        "_" + std::to_string(i),
+                                    100, 10, 0.05 + 0.01 * i, 2));
+    engine.SetRapidityTable(
+        raptable,
+        maketable("alloc_rapratio" + std::to_string(raptable), 80, 4, -0.2,
+                  1.5),
+        intervals.data());
+  }
+  return engine.WriteTableFile(tablefile, "HIJING");
+}
+
+//____________________________________________________________________________..
+// the primaries with one shower each and hits in every calorimeter; every
+// 50th shower comes from a secondary, as for decays before the calorimeter
+PHCompositeNode *makeevent(int nprimaries, HepMC::HeavyIon *&heavyion) {
+  PHCompositeNode *topNode = new PHCompositeNode("TOP");
+  PHCompositeNode *dstNode = new PHCompositeNode("DST");
+  PHCompositeNode *runNode = new PHCompositeNode("RUN");
+  topNode->addNode(dstNode);
+  topNode->addNode(runNode);
+
+  PHHepMCGenEventMap *genevtmap = new PHHepMCGenEventMap();
+  PHHepMCGenEvent *genevt = genevtmap->insert_event(0);
+  HepMC::GenEvent *event = new HepMC::GenEvent();
+  event->set_heavy_ion(HepMC::HeavyIon(0, npartcycle[0] / 2,
+                                       npartcycle[0] - npartcycle[0] / 2, 0));
+  genevt->addEvent(event);
+  heavyion = genevt->getEvent()->heavy_ion();
+  dstNode->addNode(new PHIODataNode<PHObject>(genevtmap, "PHHepMCGenEventMap",
+                                              "PHObject"));
+
+  PHG4TruthInfoContainer *truthinfo = new PHG4TruthInfoContainer();
+  dstNode->addNode(
+      new PHIODataNode<PHObject>(truthinfo, "G4TruthInfo", "PHObject"));
+  std::vector<PHG4HitContainer *> hits;
+  for (const std::string &nodename : hitnodes) {
+    hits.push_back(new PHG4HitContainer(nodename));
+    dstNode->addNode(
+        new PHIODataNode<PHObject>(hits.back(), nodename, "PHObject"));
+  }
+
+  const int pids[] = {211, -211, 111, 321, -321, 2212, -2212, 2112, 3122, 22};
+  const int npids = sizeof(pids) / sizeof(pids[0]);
+  std::mt19937 rng(20);
+  std::exponential_distribution<float> ptdist(1 / 0.6);
+  std::uniform_real_distribution<float> etadist(-4, 4);
+  std::uniform_real_distribution<float> phidist(0, 2 * M_PI);
+  int nsecondaries = 0;
+  for (int trkid = 1; trkid <= nprimaries; trkid++) {
+    float pt = 0.1 + ptdist(rng);
+    float eta = etadist(rng);
+    float phi = phidist(rng);
+    PHG4Particle *particle = new PHG4Particlev2();
+    particle->set_track_id(trkid);
+    particle->set_pid(pids[trkid % npids]);
+    particle->set_px(pt * std::cos(phi));
+    particle->set_py(pt * std::sin(phi));
+    particle->set_pz(pt * std::sinh(eta));
+    particle->set_e(pt * std::cosh(eta));
+    truthinfo->AddParticle(trkid, particle);
+
+    int parent = trkid;
+    if (trkid % 50 == 0) {
+      parent = -(++nsecondaries);
+      PHG4Particle *secondary = new PHG4Particlev2();
+      secondary->set_track_id(parent);
+      secondary->set_parent_id(trkid);
+      secondary->set_pid(pids[(trkid + 1) % npids]);
+      secondary->set_px(0.5 * particle->get_px());
+      secondary->set_py(0.5 * particle->get_py());
+      secondary->set_pz(0.5 * particle->get_pz());
+      secondary->set_e(0.5 * particle->get_e());
+      truthinfo->AddParticle(parent, secondary);
+    }
+    PHG4Shower *shower = new PHG4Showerv1();
+    shower->set_id(trkid);
+    shower->set_parent_particle_id(parent);
+    truthinfo->AddShower(trkid, shower);
+
+    for (unsigned int i = 0; i < hits.size(); i++) {
+      for (int ihit = 0; ihit < 4; ihit++) {
+        PHG4Hit *hit = new PHG4Hitv1();
+        hit->set_trkid(parent);
+        hit->set_shower_id(trkid);
+        hit->set_edep(0.01 * (ihit + 1));
+        hit->set_light_yield(0.005 * (ihit + 1));
+        hits[i]->AddHit(0, hit);
+      }
+    }
+  }
+  return topNode;
+}
+
+//____________________________________________________________________________..
+// allocations of the events after the warm-up, -1 if the module fails
+long checkconfig(const Config &config, int nprimaries, int nevents) {
+  HepMC::HeavyIon *heavyion = nullptr;
+  PHCompositeNode *topNode = makeevent(nprimaries, heavyion);
+  EnergyCorrection *module = new EnergyCorrection("EnergyCorrection_" +
+                                                  config.name);
+  module->SetGeneratorType("HIJING");
+  module->SetTableFile(tablefile);
+  module->SetHitNodeNames(hitnodes);
+  config.setup(*module);
+
+  long steadyallocations = 0;
+  if (module->Init(topNode) != Fun4AllReturnCodes::EVENT_OK ||
+      module->InitRun(topNode) != Fun4AllReturnCodes::EVENT_OK)
+    steadyallocations = -1;
+  for (int ievent = 0; steadyallocations >= 0 && ievent < nevents;
+       ievent++) {
+    int npart = npartcycle[ievent % ncycle];
+    heavyion->set_Npart_proj(npart / 2);
+    heavyion->set_Npart_targ(npart - npart / 2);
+    const unsigned long allocations = g_allocations;
+    if (module->process_event(topNode) != Fun4AllReturnCodes::EVENT_OK) {
+      steadyallocations = -1;
+      break;
+    }
+    // every Npart once to size the buffers
+    if (ievent >= ncycle)
+      steadyallocations += g_allocations - allocations;
+  }
+  if (steadyallocations >= 0)
+    module->End(topNode);
+  delete module;
+  delete topNode;
+  return steadyallocations;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int nprimaries = argc > 1 ? std::atoi(argv[1]) : 2000;
+  int nevents = argc > 2 ? std::atoi(argv[2]) : 12;
+  if (nprimaries <= 0 || nevents <= ncycle) {
+    std::cout << "usage: " << argv[0] << " [nprimaries] [nevents > " << ncycle
+              << "]" << std::endl;
+    return 1;
+  }
+  if (!writetables()) {
+    std::cout << "EnergyCorrectionAllocCheck: cannot write " << tablefile
+              << std::endl;
+    return 1;
+  }
+
+  const std::vector<Config> configs = {
+      {"histogram", [](EnergyCorrection &m) { m.SetUseWeightGrid(false); }},
+      {"grid", [](EnergyCorrection &) {}},
+      {"kernel", [](EnergyCorrection &m) { m.SetUseBatchKernel(true); }},
+      {"rapidity", [](EnergyCorrection &m) { m.SetRapidityDep(true); }},
+      {"threads", [](EnergyCorrection &m) { m.SetNumThreads(4); }},
+      {"truth", [](EnergyCorrection &m) { m.SetUpweightTruth(true); }},
+      {"weighttable",
+       [](EnergyCorrection &m) {
+         m.SetWeightTableNode();
+         m.SetModifyHits(false);
+       }},
+      {"weighttablehits",
+       [](EnergyCorrection &m) { m.SetWeightTableNode(); }},
+  };
+  int nfailed = 0;
+  for (const Config &config : configs) {
+    long allocations = checkconfig(config, nprimaries, nevents);
+    std::cout << "EnergyCorrectionAllocCheck: " << config.name << ": ";
+    if (allocations < 0)
+      std::cout << "module failed";
+    else
+      std::cout << allocations << " allocations in " << nevents - ncycle
+                << " events";
+    std::cout << std::endl;
+    if (allocations != 0)
+      nfailed++;
+  }
+  std::remove(tablefile.c_str());
+  return nfailed > 0 ? 1 : 0;
+}
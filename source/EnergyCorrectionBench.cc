@@ -0,0 +1,400 @@
+//____________________________________________________________________________..
+//
+// Standalone timing of the correction weights on synthetic HIJING-like
+// primaries, no Fun4All or DST needed. The correction tables are smooth
+// made-up curves with the binning of the real ones, so the numbers measure
+// the lookup cost, not the physics.
+//
+//   EnergyCorrectionBench [nprimaries] [nrepeat]
+//
+// Returns non-zero if the grid and histogram paths disagree or the scalar
+// and AVX2 kernels are not identical.
+//____________________________________________________________________________..
+
+#include "CorrectionEngine.h"
+#include "SpeciesRegistry.h"
+#include "WeightKernel.h"
+
+#include <TH1.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Primary {
+  float px;
+  float py;
+  float pz;
+  float e;
+  int pid;
+};
+
+// one Npart per event, the grid is collapsed per event as in process_event
+struct Event {
+  int npart;
+  std::vector<Primary> primaries;
+};
+
+struct Population {
+  std::string name;
+  std::vector<Event> events;
+  int nprimaries = 0;
+};
+
+//____________________________________________________________________________..
+TH1F *makepttable(const std::string &name, int table, int centbin) {
+  // 0 - 10 GeV in 100 MeV bins like the fitted ratios
+  TH1F *h = new TH1F(name.c_str(), name.c_str(), 100, 0, 10);
+  h->SetDirectory(nullptr);
+  float amp = 0.1 + 0.03 * table + 0.02 * centbin;
+  for (int ibin = 1; ibin <= h->GetNbinsX(); ibin++) {
+    float pt = h->GetBinCenter(ibin);
+    h->SetBinContent(ibin, 1 + amp * std::exp(-pt / 1.5) +
+                               0.01 * table * std::log1p(pt));
+  }
+  return h;
+}
+
+//____________________________________________________________________________..
+TH1F *makerapshape(const std::string &name, float width) {
+  TH1F *h = new TH1F(name.c_str(), name.c_str(), 80, 0, 4);
+  h->SetDirectory(nullptr);
+  for (int ibin = 1; ibin <= h->GetNbinsX(); ibin++) {
+    float y = h->GetBinCenter(ibin);
+    h->SetBinContent(ibin, 0.8 + 0.4 * std::exp(-y * y / (2 * width * width)));
+  }
+  return h;
+}
+
+//____________________________________________________________________________..
+void filltables(CorrectionEngine &engine) {
+  for (int table = 0; table < SpeciesRegistry::ntables; table++) {
+    for (int i = 0; i < CorrectionEngine::ncentbins; i++) {
+      std::string name = std::string("bench_") +
+                         SpeciesRegistry::GetTableName(table) + "_" +
+                         std::to_string(i);
+      engine.SetPtTable(table, i, makepttable(name, table, i));
+    }
+  }
+  engine.SetGeneratorType("HIJING");
+  for (int raptable = 0; raptable < SpeciesRegistry::nraptables; raptable++) {
+    std::vector<TH1F *> intervals;
+    for (int i = 0; i < engine.GetNRapidityIntervals(raptable); i++) {
+      std::string name = "bench_rap" + std::to_string(raptable) + "_" +
+                         std::to_string(i);
+      intervals.push_back(makepttable(name, raptable, i % 5));
+    }
+    std::string name = "bench_rapratio" + std::to_string(raptable);
+    engine.SetRapidityTable(raptable, makerapshape(name, 1.5 + 0.2 * raptable),
+                            intervals.data());
+  }
+}
+
+//____________________________________________________________________________..
+float mass(int pid) {
+  switch (std::abs(pid)) {
+  case 211:
+  case 111:
+    return 0.1396;
+  case 321:
+  case 130:
+  case 310:
+    return 0.4937;
+  case 2212:
+  case 2112:
+    return 0.9383;
+  default:
+    return std::abs(pid) > 3000 ? 1.2 : 0.;
+  }
+}
+
+//____________________________________________________________________________..
+// Npart from a flat impact parameter distribution in 0 - 20 fm, pt from a
+// two-exponential spectrum with a mass dependent slope, eta flat in +-4
+Population makepopulation(const std::string &name,
+                          const std::vector<std::pair<int, float>> &mix,
+                          int nprimaries, unsigned int seed) {
+  Population population;
+  population.name = name;
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> flat(0, 1);
+  std::vector<float> cumulative;
+  float sum = 0;
+  for (const auto &species : mix) {
+    sum += species.second;
+    cumulative.push_back(sum);
+  }
+  const int perevent = 2000;
+  while (population.nprimaries < nprimaries) {
+    Event event;
+    float b = 20 * std::sqrt(flat(rng));
+    event.npart = std::max(2, (int) std::lround(394 * std::exp(-b * b / 80)));
+    int n = std::min(perevent, nprimaries - population.nprimaries);
+    for (int i = 0; i < n; i++) {
+      float r = flat(rng) * sum;
+      int k = std::lower_bound(cumulative.begin(), cumulative.end(), r) -
+              cumulative.begin();
+      int pid = mix[std::min(k, (int) mix.size() - 1)].first;
+      float m = mass(pid);
+      float slope = 0.25 + 0.3 * m;
+      float pt = -slope * std::log(std::max(flat(rng) * flat(rng), 1e-12f));
+      float eta = -4 + 8 * flat(rng);
+      float phi = 2 * M_PI * flat(rng);
+      Primary p;
+      p.px = pt * std::cos(phi);
+      p.py = pt * std::sin(phi);
+      p.pz = pt * std::sinh(eta);
+      p.e = std::sqrt(p.px * p.px + p.py * p.py + p.pz * p.pz + m * m);
+      p.pid = pid;
+      event.primaries.push_back(p);
+    }
+    population.nprimaries += n;
+    population.events.push_back(event);
+  }
+  return population;
+}
+
+struct Timing {
+  double mean = 0;
+  double rms = 0;
+  double min = 0;
+};
+
+//____________________________________________________________________________..
+template <typename Function>
+Timing timeit(const Population &population, int nrepeat, Function func) {
+  std::vector<double> nsperhit;
+  for (int irep = 0; irep < nrepeat; irep++) {
+    auto start = std::chrono::steady_clock::now();
+    func();
+    auto stop = std::chrono::steady_clock::now();
+    nsperhit.push_back(
+        std::chrono::duration<double, std::nano>(stop - start).count() /
+        population.nprimaries);
+  }
+  Timing timing;
+  timing.min = *std::min_element(nsperhit.begin(), nsperhit.end());
+  for (double t : nsperhit)
+    timing.mean += t / nrepeat;
+  for (double t : nsperhit)
+    timing.rms += (t - timing.mean) * (t - timing.mean) / nrepeat;
+  timing.rms = std::sqrt(timing.rms);
+  return timing;
+}
+
+//____________________________________________________________________________..
+void report(const std::string &population, const std::string &path,
+            const Timing &timing) {
+  std::cout << std::left << std::setw(14) << population << std::setw(26)
+            << path << std::right << std::fixed << std::setprecision(2)
+            << std::setw(10) << timing.mean << " +- " << std::setw(6)
+            << timing.rms << " (min " << timing.min << ") ns/hit"
+            << std::endl;
+}
+
+//____________________________________________________________________________..
+// one weight per hit, as without the per-primary memo
+double scalarpath(CorrectionEngine &engine, const Population &population) {
+  double sum = 0;
+  for (const Event &event : population.events) {
+    engine.SetNpart(event.npart);
+    for (const Primary &p : event.primaries) {
+      float scale;
+      engine.Weight(p.px, p.py, p.pz, p.e, p.pid, event.npart, scale);
+      sum += scale;
+    }
+  }
+  return sum;
+}
+
+//____________________________________________________________________________..
+void fillbatches(const CorrectionEngine &engine, const Population &population,
+                 std::vector<WeightBatch> &batches) {
+  const SpeciesRegistry &species = engine.GetSpeciesRegistry();
+  batches.resize(population.events.size());
+  for (unsigned int ievent = 0; ievent < population.events.size(); ievent++) {
+    WeightBatch &batch = batches[ievent];
+    batch.clear();
+    for (const Primary &p : population.events[ievent].primaries) {
+      int index = species.Index(p.pid);
+      batch.push_back(p.px, p.py, p.pz, p.e,
+                      index < 0 ? engine.GetKernel().GetUnitSpecies() : index);
+    }
+    batch.resizeoutputs();
+  }
+}
+
+//____________________________________________________________________________..
+double kernelpath(CorrectionEngine &engine, const Population &population,
+                  std::vector<WeightBatch> &batches) {
+  double sum = 0;
+  for (unsigned int ievent = 0; ievent < population.events.size(); ievent++) {
+    engine.SetNpart(population.events[ievent].npart);
+    engine.GetKernel().Evaluate(batches[ievent]);
+    sum += batches[ievent].weight[0];
+  }
+  return sum;
+}
+
+//____________________________________________________________________________..
+// largest relative difference between the grid and histogram weights
+float comparepaths(CorrectionEngine &histo, CorrectionEngine &grid,
+                   const Population &population) {
+  float maxrel = 0;
+  for (const Event &event : population.events) {
+    grid.SetNpart(event.npart);
+    for (const Primary &p : event.primaries) {
+      float ref, val;
+      histo.Weight(p.px, p.py, p.pz, p.e, p.pid, event.npart, ref);
+      grid.Weight(p.px, p.py, p.pz, p.e, p.pid, event.npart, val);
+      maxrel = std::max(maxrel, std::abs(val - ref) / std::max(std::abs(ref), 1e-6f));
+    }
+  }
+  return maxrel;
+}
+
+//____________________________________________________________________________..
+// number of entries where the AVX2 kernel differs from the scalar one
+int comparekernels(CorrectionEngine &engine, const Population &population,
+                   std::vector<WeightBatch> &batches) {
+  WeightKernel &kernel = engine.GetKernel();
+  if (!WeightKernel::HasAVX2())
+    return 0;
+  int ndiff = 0;
+  for (unsigned int ievent = 0; ievent < population.events.size(); ievent++) {
+    engine.SetNpart(population.events[ievent].npart);
+    WeightBatch &batch = batches[ievent];
+    kernel.SetIsa(WeightKernel::kScalar);
+    kernel.Evaluate(batch);
+    std::vector<float> weight(batch.weight.begin(), batch.weight.end());
+    std::vector<unsigned char> accepted(batch.accepted.begin(),
+                                        batch.accepted.end());
+    kernel.SetIsa(WeightKernel::kAVX2);
+    kernel.Evaluate(batch);
+    for (int i = 0; i < batch.size(); i++) {
+      if (batch.accepted[i] != accepted[i] ||
+          (accepted[i] && batch.weight[i] != weight[i]))
+        ndiff++;
+    }
+  }
+  return ndiff;
+}
+
+} // namespace
+
+//____________________________________________________________________________..
+int main(int argc, char **argv) {
+  int nprimaries = argc > 1 ? std::atoi(argv[1]) : 200000;
+  int nrepeat = argc > 2 ? std::atoi(argv[2]) : 5;
+  if (nprimaries <= 0 || nrepeat <= 0) {
+    std::cout << "usage: " << argv[0] << " [nprimaries] [nrepeat]"
+              << std::endl;
+    return 1;
+  }
+
+  // roughly the primary mix of a central HIJING event, photons and
+  // leptons are not corrected
+  const std::vector<Population> populations = {
+      makepopulation("hijing",
+                     {{211, 27}, {-211, 27}, {111, 27}, {321, 3}, {-321, 3},
+                      {130, 1.5}, {310, 1.5}, {2212, 2}, {-2212, 1.5},
+                      {2112, 2}, {-2112, 1.5}, {3122, 0.7}, {-3122, 0.5},
+                      {3312, 0.1}, {22, 2}, {11, 0.2}},
+                     nprimaries, 1),
+      makepopulation("pi0/K0", {{111, 1}, {130, 0.5}, {310, 0.5}},
+                     nprimaries, 2),
+      makepopulation("baryons",
+                     {{2212, 1}, {-2212, 1}, {2112, 1}, {-2112, 1}, {3122, 0.3},
+                      {-3122, 0.3}, {3312, 0.1}, {-3312, 0.1}},
+                     nprimaries, 3)};
+
+  std::cout << "EnergyCorrectionBench: " << nprimaries << " primaries x "
+            << nrepeat << " repetitions, AVX2 "
+            << (WeightKernel::HasAVX2() ? "available" : "not available")
+            << std::endl;
+
+  int status = 0;
+  const float tolerance = 1e-3;
+  for (bool rapidity : {false, true}) {
+    CorrectionEngine histo;
+    CorrectionEngine grid;
+    for (CorrectionEngine *engine : {&histo, &grid}) {
+      engine->SetRapidityDep(rapidity);
+      filltables(*engine);
+    }
+    histo.SetUseWeightGrid(false);
+    if (!histo.Init() || !grid.Init() || !grid.GetUseWeightGrid()) {
+      std::cout << "EnergyCorrectionBench: engine setup failed" << std::endl;
+      return 1;
+    }
+    const std::string mode = rapidity ? "rapidity " : "centrality ";
+
+    // the same tables through the binary table file must give the same weights
+    const std::string tablefile = "EnergyCorrectionBench_tables.bin";
+    CorrectionEngine mapped;
+    mapped.SetRapidityDep(rapidity);
+    mapped.SetUseWeightGrid(false);
+    std::chrono::steady_clock::time_point loadstart =
+        std::chrono::steady_clock::now();
+    if (!histo.WriteTableFile(tablefile, "HIJING") ||
+        !mapped.LoadTableFile(tablefile, "HIJING") || !mapped.Init()) {
+      std::cout << "EnergyCorrectionBench: table file round trip failed"
+                << std::endl;
+      return 1;
+    }
+    std::cout << std::left << std::setw(14) << "tables" << std::setw(26)
+              << mode + "file round trip" << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10)
+              << std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - loadstart)
+                     .count()
+              << " ms (write, map, Init)" << std::endl;
+
+    for (const Population &population : populations) {
+      volatile double sink = 0;
+      report(population.name, mode + "histogram", timeit(population, nrepeat, [&] {
+               sink = sink + scalarpath(histo, population);
+             }));
+      report(population.name, mode + "grid", timeit(population, nrepeat, [&] {
+               sink = sink + scalarpath(grid, population);
+             }));
+
+      std::vector<WeightBatch> batches;
+      fillbatches(grid, population, batches);
+      for (WeightKernel::Isa isa : {WeightKernel::kScalar, WeightKernel::kAVX2}) {
+        grid.GetKernel().SetIsa(isa);
+        if (grid.GetKernel().GetIsa() != isa)
+          continue;
+        report(population.name,
+               mode + WeightKernel::GetIsaName(isa) + " kernel",
+               timeit(population, nrepeat,
+                      [&] { sink = sink + kernelpath(grid, population, batches); }));
+      }
+
+      float maxrel = comparepaths(histo, grid, population);
+      int ndiff = comparekernels(grid, population, batches);
+      if (maxrel > tolerance || ndiff > 0) {
+        std::cout << "EnergyCorrectionBench: " << population.name << " "
+                  << mode << "grid deviates by " << maxrel << ", " << ndiff
+                  << " kernel differences" << std::endl;
+        status = 1;
+      }
+      float maxrelmapped = comparepaths(histo, mapped, population);
+      if (maxrelmapped > 0) {
+        std::cout << "EnergyCorrectionBench: " << population.name << " "
+                  << mode << "table file weights deviate by " << maxrelmapped
+                  << std::endl;
+        status = 1;
+      }
+    }
+  }
+  return status;
+}
@@ -0,0 +1,448 @@
+//____________________________________________________________________________..
+//
+// Reweights a whole production, e.g. macro/g4hits.list, on one node. The
+// list is split into size-balanced shards, one per worker; every worker
+// runs each file of its shard in a child process with its own Fun4All chain
+// (DST in, EnergyCorrection, DST out). Finished files are appended to a
+// journal in the output directory, so an interrupted or partly failed run
+// picks up where it stopped when started again with the same arguments.
+//
+//   EnergyCorrectionDriver -l <file list> -o <output directory>
+//       [-j workers] [-n events per file] [-g generator] [-t table file]
+//       [-c hit node,hit node,...] [-r] [-w] [-v]
+//
+//   -r  rapidity dependent correction
+//   -w  also write the weight sidecar of every file, <name>_weights.root
+//
+// Outputs are written as <name>.part and renamed when the file is done, the
+// exit code is non-zero if any file failed.
+//____________________________________________________________________________..
+
+#include "EnergyCorrection.h"
+#include "ReweightStats.h"
+
+#include <fun4all/Fun4AllDstInputManager.h>
+#include <fun4all/Fun4AllDstOutputManager.h>
+#include <fun4all/Fun4AllServer.h>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+  std::string list;
+  std::string outdir;
+  int nworkers = 0;
+  int nevents = 0;
+  std::string generatortype = "HIJING";
+  std::string tablefile;
+  std::vector<std::string> hitnodes = {"G4HIT_CEMC", "G4HIT_HCALIN",
+                                       "G4HIT_HCALOUT"};
+  bool rapidity = false;
+  bool sidecar = false;
+  bool verbose = false;
+};
+
+struct InputFile {
+  std::string name;
+  long long size = 0;
+};
+
+// what a finished file reports back through its pipe and the journal
+struct Result {
+  unsigned long events = 0;
+  double seconds = 0;
+};
+
+struct Worker {
+  std::vector<int> shard;
+  unsigned int next = 0;
+  pid_t pid = 0;
+  int fd = -1;
+  int file = -1;
+};
+
+const char *journalname = "EnergyCorrectionDriver.journal";
+
+volatile sig_atomic_t interrupted = 0;
+
+void onsignal(int) { interrupted = 1; }
+
+//____________________________________________________________________________..
+std::string basename(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+//____________________________________________________________________________..
+std::vector<std::string> split(const std::string &s, char sep) {
+  std::vector<std::string> parts;
+  std::stringstream ss(s);
+  std::string part;
+  while (std::getline(ss, part, sep)) {
+    if (!part.empty())
+      parts.push_back(part);
+  }
+  return parts;
+}
+
+//____________________________________________________________________________..
+bool readlist(const std::string &list, std::vector<InputFile> &files) {
+  std::ifstream in(list);
+  if (!in) {
+    std::cout << "EnergyCorrectionDriver: cannot read " << list << std::endl;
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    line.erase(0, line.find_first_not_of(" \t"));
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (line.empty() || line[0] == '#')
+      continue;
+    InputFile file;
+    file.name = line;
+    struct stat st;
+    // unreadable files are kept, their child process reports the failure
+    if (stat(line.c_str(), &st) == 0)
+      file.size = st.st_size;
+    files.push_back(file);
+  }
+  return true;
+}
+
+//____________________________________________________________________________..
+// largest file first onto the least loaded shard, which keeps the shards
+// within one file size of each other
+std::vector<std::vector<int>> makeshards(const std::vector<InputFile> &files,
+                                         const std::vector<int> &todo,
+                                         int nshards) {
+  std::vector<int> order = todo;
+  std::stable_sort(order.begin(), order.end(), [&files](int a, int b) {
+    return files[a].size > files[b].size;
+  });
+  std::vector<std::vector<int>> shards(nshards);
+  std::vector<long long> load(nshards, 0);
+  for (int i : order) {
+    int shard = std::min_element(load.begin(), load.end()) - load.begin();
+    shards[shard].push_back(i);
+    load[shard] += std::max(files[i].size, 1LL);
+  }
+  // list order within a shard, the files of one run stay together
+  for (std::vector<int> &shard : shards)
+    std::sort(shard.begin(), shard.end());
+  return shards;
+}
+
+//____________________________________________________________________________..
+// input file -> result of the files finished by earlier runs
+std::map<std::string, Result> readjournal(const std::string &journal) {
+  std::map<std::string, Result> done;
+  std::ifstream in(journal);
+  std::string line;
+  while (std::getline(in, line)) {
+    // done <events> <seconds> <file>, an interrupted last line is ignored
+    std::istringstream ss(line);
+    std::string tag;
+    Result result;
+    std::string name;
+    if (!(ss >> tag >> result.events >> result.seconds) || tag != "done")
+      continue;
+    std::getline(ss >> std::ws, name);
+    if (!name.empty())
+      done[name] = result;
+  }
+  return done;
+}
+
+//____________________________________________________________________________..
+// the Fun4All chain of one file, runs in the child process
+int runfile(const Options &opt, const std::string &input, Result &result) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  const std::string output = opt.outdir + "/" + basename(input);
+  const std::string partial = output + ".part";
+
+  Fun4AllServer *se = Fun4AllServer::instance();
+  se->Verbosity(opt.verbose ? 1 : 0);
+
+  Fun4AllDstInputManager *in = new Fun4AllDstInputManager("DSTin");
+  if (in->AddFile(input) != 0) {
+    std::cout << "EnergyCorrectionDriver: cannot open " << input << std::endl;
+    return 1;
+  }
+  se->registerInputManager(in);
+
+  EnergyCorrection *energycorrect = new EnergyCorrection();
+  energycorrect->SetHitNodeNames(opt.hitnodes);
+  energycorrect->SetUpweightTruth(true);
+  energycorrect->SetGeneratorType(opt.generatortype);
+  energycorrect->SetRapidityDep(opt.rapidity);
+  if (!opt.tablefile.empty())
+    energycorrect->SetTableFile(opt.tablefile);
+  if (opt.sidecar)
+    energycorrect->SetWeightSidecar(
+        output.substr(0, output.rfind(".root")) + "_weights.root");
+  if (se->registerSubsystem(energycorrect) != 0) {
+    std::cout << "EnergyCorrectionDriver: EnergyCorrection setup failed for "
+              << input << std::endl;
+    return 1;
+  }
+
+  Fun4AllDstOutputManager *out = new Fun4AllDstOutputManager("DSTout", partial);
+  se->registerOutputManager(out);
+
+  // an aborted run or a failing End() leaves the .part file, the file is
+  // not journaled and is redone on resume
+  int runstatus = se->run(opt.nevents);
+  int endstatus = se->End();
+  result.events = energycorrect->GetStats().GetNEvents();
+  delete se;
+  if (runstatus != 0 || endstatus != 0) {
+    std::cout << "EnergyCorrectionDriver: " << input << " failed, run "
+              << runstatus << ", End " << endstatus << ", leaving " << partial
+              << std::endl;
+    return 1;
+  }
+
+  if (std::rename(partial.c_str(), output.c_str()) != 0) {
+    std::cout << "EnergyCorrectionDriver: cannot rename " << partial
+              << std::endl;
+    return 1;
+  }
+  result.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return 0;
+}
+
+//____________________________________________________________________________..
+bool launch(const Options &opt, const std::vector<InputFile> &files,
+            Worker &worker) {
+  if (worker.next >= worker.shard.size())
+    return false;
+  worker.file = worker.shard[worker.next++];
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::perror("EnergyCorrectionDriver: pipe");
+    return false;
+  }
+  std::cout.flush();
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::perror("EnergyCorrectionDriver: fork");
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    // an interrupt stops the file, it is redone on resume
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    Result result;
+    int status = runfile(opt, files[worker.file].name, result);
+    std::string report = std::to_string(result.events) + " " +
+                         std::to_string(result.seconds) + "\n";
+    ssize_t written = write(fds[1], report.data(), report.size());
+    close(fds[1]);
+    std::cout.flush();
+    _exit(status != 0 || written != (ssize_t) report.size());
+  }
+  close(fds[1]);
+  worker.pid = pid;
+  worker.fd = fds[0];
+  return true;
+}
+
+//____________________________________________________________________________..
+bool collect(Worker &worker, int status, Result &result) {
+  char buffer[128] = {0};
+  ssize_t n = read(worker.fd, buffer, sizeof(buffer) - 1);
+  close(worker.fd);
+  worker.fd = -1;
+  worker.pid = 0;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || n <= 0)
+    return false;
+  std::istringstream ss(buffer);
+  return (bool) (ss >> result.events >> result.seconds);
+}
+
+//____________________________________________________________________________..
+void usage(const char *name) {
+  std::cout << "usage: " << name
+            << " -l <file list> -o <output directory> [-j workers]"
+               " [-n events per file] [-g generator] [-t table file]"
+               " [-c hit node,...] [-r] [-w] [-v]"
+            << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  int c;
+  while ((c = getopt(argc, argv, "l:o:j:n:g:t:c:rwv")) != -1) {
+    switch (c) {
+    case 'l':
+      opt.list = optarg;
+      break;
+    case 'o':
+      opt.outdir = optarg;
+      break;
+    case 'j':
+      opt.nworkers = std::atoi(optarg);
+      break;
+    case 'n':
+      opt.nevents = std::atoi(optarg);
+      break;
+    case 'g':
+      opt.generatortype = optarg;
+      break;
+    case 't':
+      opt.tablefile = optarg;
+      break;
+    case 'c':
+      opt.hitnodes = split(optarg, ',');
+      break;
+    case 'r':
+      opt.rapidity = true;
+      break;
+    case 'w':
+      opt.sidecar = true;
+      break;
+    case 'v':
+      opt.verbose = true;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (opt.list.empty() || opt.outdir.empty() || opt.nevents < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (opt.nworkers <= 0)
+    opt.nworkers = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+  mkdir(opt.outdir.c_str(), 0755);
+
+  std::vector<InputFile> files;
+  if (!readlist(opt.list, files))
+    return 1;
+
+  const std::string journal = opt.outdir + "/" + journalname;
+  std::map<std::string, Result> done = readjournal(journal);
+  std::vector<int> todo;
+  long long todobytes = 0;
+  for (unsigned int i = 0; i < files.size(); i++) {
+    if (done.count(files[i].name))
+      continue;
+    todo.push_back(i);
+    todobytes += files[i].size;
+  }
+  std::cout << "EnergyCorrectionDriver: " << files.size() << " files, "
+            << files.size() - todo.size() << " already done, " << todo.size()
+            << " (" << todobytes / 1048576 << " MB) on " << opt.nworkers
+            << " workers" << std::endl;
+  if (todo.empty())
+    return 0;
+
+  std::ofstream journalout(journal, std::ios::app);
+  if (!journalout) {
+    std::cout << "EnergyCorrectionDriver: cannot write " << journal
+              << std::endl;
+    return 1;
+  }
+
+  std::signal(SIGINT, onsignal);
+  std::signal(SIGTERM, onsignal);
+
+  std::vector<std::vector<int>> shards =
+      makeshards(files, todo, std::min<int>(opt.nworkers, todo.size()));
+  std::vector<Worker> workers(shards.size());
+  for (unsigned int i = 0; i < workers.size(); i++)
+    workers[i].shard = shards[i];
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  int nrunning = 0;
+  for (Worker &worker : workers)
+    nrunning += launch(opt, files, worker);
+
+  unsigned int ndone = 0;
+  unsigned long nevents = 0;
+  long long nbytes = 0;
+  std::vector<std::string> failed;
+  while (nrunning > 0) {
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0)
+      continue; // EINTR from the signal handler
+    std::vector<Worker>::iterator worker =
+        std::find_if(workers.begin(), workers.end(),
+                     [pid](const Worker &w) { return w.pid == pid; });
+    if (worker == workers.end())
+      continue;
+    nrunning--;
+    const InputFile &file = files[worker->file];
+    Result result;
+    if (collect(*worker, status, result)) {
+      journalout << "done " << result.events << " " << result.seconds << " "
+                 << file.name << std::endl;
+      ndone++;
+      nevents += result.events;
+      nbytes += file.size;
+      if (opt.verbose)
+        std::cout << "EnergyCorrectionDriver: " << file.name << " "
+                  << result.events << " events in " << result.seconds
+                  << " s" << std::endl;
+    } else {
+      failed.push_back(file.name);
+      std::cout << "EnergyCorrectionDriver: " << file.name << " failed"
+                << std::endl;
+    }
+    if ((ndone + failed.size()) % 100 == 0) {
+      double elapsed = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+      std::cout << "EnergyCorrectionDriver: " << ndone + failed.size()
+                << "/" << todo.size() << " files, " << nevents / elapsed
+                << " events/s" << std::endl;
+    }
+    if (!interrupted)
+      nrunning += launch(opt, files, *worker);
+  }
+
+  double elapsed =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  std::cout << "EnergyCorrectionDriver: " << ndone << " files, " << nevents
+            << " events, " << nbytes / 1048576 << " MB in " << std::fixed
+            << std::setprecision(1) << elapsed << " s: "
+            << (elapsed > 0 ? nevents / elapsed : 0) << " events/s, "
+            << (elapsed > 0 ? nbytes / 1048576. / elapsed : 0) << " MB/s"
+            << std::endl;
+  if (interrupted)
+    std::cout << "EnergyCorrectionDriver: interrupted, "
+              << todo.size() - ndone - failed.size()
+              << " files left, run again to resume" << std::endl;
+  if (!failed.empty())
+    std::cout << "EnergyCorrectionDriver: " << failed.size()
+              << " files failed, run again to retry them" << std::endl;
+  return (interrupted || !failed.empty()) ? 1 : 0;
+}
@@ -0,0 +1,717 @@
+//____________________________________________________________________________..
+//
+// Reweights one DST without Fun4All, with reading, reweighting and writing
+// as separate stages connected by bounded queues, so that ROOT
+// decompression and compression overlap with the correction instead of
+// alternating with it. A fixed set of event slots cycles through the
+// stages: the reader decodes an entry of the input tree into a free slot,
+// reweighting workers correct its hits with a shared CorrectionWeight, and
+// the writer fills the output tree in input order and frees the slot. The
+// other trees of the input file are copied at the end, the run tree with the
+// records EnergyCorrection puts on the RUN node; an input that already
+// carries them is refused. An unreadable entry stops the pipeline, the
+// incomplete output is removed.
+//
+//   EnergyCorrectionPipeline -i <input DST> -o <output DST>
+//       [-g generator] [-t table file | -d table directory -y rapidity file]
+//       [-c hit node,hit node,...] [-r] [-j reweight workers]
+//       [-s event slots] [-m ROOT I/O threads] [-n events] [-v]
+//
+//   -r  rapidity dependent correction
+//   -j  reweighting threads (default 2)
+//   -s  events in flight, bounds every queue (default 4 per worker + 4)
+//   -m  ROOT implicit multithreading for basket decompression and
+//       compression inside the read and write stages (default off)
+//
+// Only the hits are reweighted, the truth particles are copied unchanged.
+// At the end the busy fraction of every stage and the mean depth of the
+// queues in front of them are reported: a stage that is always busy with a
+// full queue in front of it is the bottleneck.
+//____________________________________________________________________________..
+
+#include "CorrectionEngine.h"
+#include "CorrectionWeight.h"
+#include "ShowerIndex.h"
+
+#include <g4main/PHG4Hit.h>
+#include <g4main/PHG4HitContainer.h>
+#include <g4main/PHG4TruthInfoContainer.h>
+
+#include <phhepmc/PHHepMCGenEvent.h>
+#include <phhepmc/PHHepMCGenEventMap.h>
+
+#include <phparameter/PHParameters.h>
+
+#include <pdbcalbase/PdbParameterMap.h>
+
+#include <phool/PHObject.h>
+
+#include <HepMC/GenEvent.h>
+#include <HepMC/HeavyIon.h>
+
+#include <TBranch.h>
+#include <TClass.h>
+#include <TFile.h>
+#include <TKey.h>
+#include <TObjArray.h>
+#include <TROOT.h>
+#include <TTree.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+  std::string input;
+  std::string output;
+  std::string generatortype = "HIJING";
+  std::string tablefile;
+  std::string tabledir = CorrectionTables::defaulttabledir;
+  std::string rapfile = CorrectionTables::defaultrapfile;
+  std::vector<std::string> hitnodes = {"G4HIT_CEMC", "G4HIT_HCALIN",
+                                       "G4HIT_HCALOUT"};
+  bool rapidity = false;
+  int nworkers = 2;
+  int nslots = 0;
+  int iothreads = 0;
+  long long nevents = 0;
+  bool verbose = false;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// the trees of Fun4AllDstOutputManager
+const std::string eventtreename = "T";
+const std::string runtreename = "R";
+
+// one event in flight, the objects of every branch of the event tree; the
+// addresses ROOT reads into and writes from, and the same objects as nodes
+struct Slot {
+  long long entry = -1;
+  std::vector<void *> objects;
+  std::vector<PHObject *> nodes;
+};
+
+// blocking FIFO of slot indices with room for all slots, so a push never
+// waits; the bound is the number of slots. Tracks how many entries were
+// waiting whenever a consumer asked for one.
+class SlotQueue
+{
+public:
+  void Push(int slot) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_slots.push_back(slot);
+    }
+    m_ready.notify_one();
+  }
+
+  // -1 once closed and drained
+  int Pop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_depthsum += m_slots.size();
+    m_npops++;
+    m_ready.wait(lock, [this] { return m_closed || !m_slots.empty(); });
+    if (m_slots.empty())
+      return -1;
+    int slot = m_slots.front();
+    m_slots.pop_front();
+    return slot;
+  }
+
+  void Close() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_closed = true;
+    }
+    m_ready.notify_all();
+  }
+
+  double GetMeanDepth() const { return m_npops ? (double) m_depthsum / m_npops : 0; }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_ready;
+  std::deque<int> m_slots;
+  bool m_closed = false;
+  unsigned long m_depthsum = 0;
+  unsigned long m_npops = 0;
+};
+
+// time a stage thread spent working, as opposed to waiting on its queue
+struct StageTimer {
+  double busy = 0;
+
+  Clock::time_point Start() const { return Clock::now(); }
+  void Stop(Clock::time_point start) {
+    busy += std::chrono::duration<double>(Clock::now() - start).count();
+  }
+};
+
+struct Counts {
+  unsigned long events = 0;
+  unsigned long hits = 0;
+  unsigned long hitsscaled = 0;
+  unsigned long failed = 0;
+};
+
+struct Pipeline {
+  const Options *opt = nullptr;
+  CorrectionWeight weight;
+  const SpeciesRegistry *registry = nullptr;
+
+  TTree *intree = nullptr;
+  TTree *outtree = nullptr;
+  long long nentries = 0;
+  std::vector<std::string> branchnames;
+  std::vector<TClass *> branchclasses;
+  int genevtbranch = -1;
+  int truthbranch = -1;
+  std::vector<int> hitbranches;
+
+  std::vector<Slot> slots;
+  SlotQueue freeslots;
+  SlotQueue toreweight;
+  SlotQueue towrite;
+
+  StageTimer readtimer;
+  std::vector<StageTimer> reweighttimers;
+  StageTimer writetimer;
+  std::vector<Counts> counts;
+  unsigned long written = 0;
+  // the unreadable entry the reader stopped at, -1 if none
+  long long readfailed = -1;
+};
+
+//____________________________________________________________________________..
+std::vector<std::string> split(const std::string &s, char sep) {
+  std::vector<std::string> parts;
+  std::stringstream ss(s);
+  std::string part;
+  while (std::getline(ss, part, sep)) {
+    if (!part.empty())
+      parts.push_back(part);
+  }
+  return parts;
+}
+
+//____________________________________________________________________________..
+bool setupweight(const Options &opt, CorrectionEngine &engine,
+                 CorrectionWeight &weight) {
+  engine.SetRapidityDep(opt.rapidity);
+  // the functor evaluates the histograms, never the event grid, and the
+  // version in the run records says so
+  engine.SetUseWeightGrid(false);
+  if (!opt.tablefile.empty()) {
+    if (!engine.LoadTableFile(opt.tablefile, opt.generatortype))
+      return false;
+  } else {
+    if (!engine.SetGeneratorType(opt.generatortype)) {
+      std::cout << "EnergyCorrectionPipeline: generator type "
+                << opt.generatortype << " not supported" << std::endl;
+      return false;
+    }
+    if (!engine.LoadPtTables(opt.generatortype, opt.tabledir))
+      return false;
+    if (opt.rapidity && !engine.LoadRapidityTables(opt.rapfile))
+      return false;
+  }
+  // the engine for the species lookup of the shower index, the weights come
+  // from the functor shared by all workers
+  return engine.Init() && weight.Init(engine);
+}
+
+//____________________________________________________________________________..
+// the branch of a node, DST branches are named after the node path,
+// e.g. DST#CEMC#G4HIT_CEMC
+int findbranch(const std::vector<std::string> &branchnames,
+               const std::string &nodename) {
+  for (unsigned int i = 0; i < branchnames.size(); i++) {
+    const std::string &name = branchnames[i];
+    if (name == nodename ||
+        (name.size() > nodename.size() &&
+         name.compare(name.size() - nodename.size() - 1, std::string::npos,
+                      "#" + nodename) == 0))
+      return i;
+  }
+  return -1;
+}
+
+//____________________________________________________________________________..
+bool setupbranches(Pipeline &p) {
+  TObjArray *branches = p.intree->GetListOfBranches();
+  for (int i = 0; i < branches->GetEntriesFast(); i++) {
+    TBranch *branch = (TBranch *) branches->At(i);
+    p.branchnames.push_back(branch->GetName());
+    p.branchclasses.push_back(TClass::GetClass(branch->GetClassName()));
+    if (!p.branchclasses.back() ||
+        !p.branchclasses.back()->InheritsFrom(PHObject::Class())) {
+      std::cout << "EnergyCorrectionPipeline: branch " << branch->GetName()
+                << " is not a PHObject branch" << std::endl;
+      return false;
+    }
+  }
+  p.genevtbranch = findbranch(p.branchnames, "PHHepMCGenEventMap");
+  p.truthbranch = findbranch(p.branchnames, "G4TruthInfo");
+  if (p.genevtbranch < 0 || p.truthbranch < 0) {
+    std::cout << "EnergyCorrectionPipeline: no PHHepMCGenEventMap or "
+                 "G4TruthInfo branch in "
+              << p.opt->input << std::endl;
+    return false;
+  }
+  for (const std::string &nodename : p.opt->hitnodes) {
+    int branch = findbranch(p.branchnames, nodename);
+    if (branch < 0) {
+      std::cout << "EnergyCorrectionPipeline: no branch of g4 hit node "
+                << nodename << " in " << p.opt->input << std::endl;
+      return false;
+    }
+    p.hitbranches.push_back(branch);
+  }
+  return true;
+}
+
+//____________________________________________________________________________..
+void readstage(Pipeline &p) {
+  for (long long entry = 0; entry < p.nentries; entry++) {
+    int islot = p.freeslots.Pop();
+    Clock::time_point start = p.readtimer.Start();
+    Slot &slot = p.slots[islot];
+    slot.entry = entry;
+    // emptied as PHNodeReset does between Fun4All events, reading an entry
+    // does not clear the hits and particles of the previous one
+    for (PHObject *node : slot.nodes)
+      node->Reset();
+    // the objects of this slot receive the entry
+    for (unsigned int i = 0; i < slot.objects.size(); i++)
+      p.intree->SetBranchAddress(p.branchnames[i].c_str(), &slot.objects[i]);
+    if (p.intree->GetEntry(entry) <= 0) {
+      // nothing from here on is written, the writer stops at this entry
+      p.readfailed = entry;
+      p.readtimer.Stop(start);
+      p.freeslots.Push(islot);
+      break;
+    }
+    p.readtimer.Stop(start);
+    p.toreweight.Push(islot);
+  }
+  p.toreweight.Close();
+}
+
+//____________________________________________________________________________..
+// Npart of the not embedded HepMC event as in EnergyCorrection, -1 if none
+int eventnpart(PHHepMCGenEventMap *genevtmap) {
+  int npart = -1;
+  for (PHHepMCGenEventMap::Iter iter = genevtmap->begin();
+       iter != genevtmap->end(); ++iter) {
+    PHHepMCGenEvent *genevt = iter->second;
+    if (genevt->get_embedding_id() != 0)
+      continue;
+    HepMC::GenEvent *event = genevt->getEvent();
+    if (!event || !event->heavy_ion())
+      continue;
+    HepMC::HeavyIon *hi = event->heavy_ion();
+    npart = hi->Npart_proj() + hi->Npart_targ();
+  }
+  return npart;
+}
+
+//____________________________________________________________________________..
+void reweightstage(Pipeline &p, int worker) {
+  StageTimer &timer = p.reweighttimers[worker];
+  Counts &counts = p.counts[worker];
+  // per worker scratch, keeps its capacity from one event to the next
+  ShowerIndex index;
+  std::vector<float> weights;
+  while (true) {
+    int islot = p.toreweight.Pop();
+    if (islot < 0)
+      break;
+    Clock::time_point start = timer.Start();
+    Slot &slot = p.slots[islot];
+    int npart = eventnpart(
+        static_cast<PHHepMCGenEventMap *>(slot.objects[p.genevtbranch]));
+    if (npart < 0) {
+      // written unchanged, like an event EnergyCorrection aborts
+      counts.failed++;
+      timer.Stop(start);
+      p.towrite.Push(islot);
+      continue;
+    }
+    index.Build(static_cast<PHG4TruthInfoContainer *>(
+                    slot.objects[p.truthbranch]),
+                *p.registry);
+    weights.resize(index.GetNPrimaries());
+    for (int i = 0; i < index.GetNPrimaries(); i++) {
+      const ShowerIndex::Primary &part = index.GetPrimary(i);
+      p.weight.Weight(part.px, part.py, part.pz, part.e, part.pid, npart,
+                      weights[i]);
+    }
+    for (int branch : p.hitbranches) {
+      PHG4HitContainer *hits =
+          static_cast<PHG4HitContainer *>(slot.objects[branch]);
+      PHG4HitContainer::ConstRange hit_range = hits->getHits();
+      for (PHG4HitContainer::ConstIterator hit_iter = hit_range.first;
+           hit_iter != hit_range.second; hit_iter++) {
+        PHG4Hit *hit = hit_iter->second;
+        counts.hits++;
+        int iprimary = index.Find(hit->get_shower_id());
+        if (iprimary < 0 || weights[iprimary] == 1)
+          continue;
+        float scale = weights[iprimary];
+        hit->set_edep(hit->get_edep() * scale);
+        hit->set_light_yield(hit->get_light_yield() * scale);
+        counts.hitsscaled++;
+      }
+    }
+    counts.events++;
+    timer.Stop(start);
+    p.towrite.Push(islot);
+  }
+}
+
+//____________________________________________________________________________..
+void writestage(Pipeline &p) {
+  // the workers finish out of order, slots wait here for their turn
+  std::vector<int> pending(p.slots.size(), -1);
+  long long next = 0;
+  while (true) {
+    int islot = p.towrite.Pop();
+    if (islot < 0)
+      break;
+    pending[p.slots[islot].entry % pending.size()] = islot;
+    Clock::time_point start = p.writetimer.Start();
+    while (next < p.nentries && pending[next % pending.size()] >= 0) {
+      int ready = pending[next % pending.size()];
+      pending[next % pending.size()] = -1;
+      Slot &slot = p.slots[ready];
+      for (unsigned int i = 0; i < slot.objects.size(); i++)
+        p.outtree->SetBranchAddress(p.branchnames[i].c_str(),
+                                    &slot.objects[i]);
+      p.outtree->Fill();
+      p.written++;
+      next++;
+      p.freeslots.Push(ready);
+    }
+    p.writetimer.Stop(start);
+  }
+}
+
+//____________________________________________________________________________..
+// the names of the records EnergyCorrection::InitRun puts on the RUN node,
+// one for every hit node it reweights and one for a weighted tower input
+std::vector<std::string> runrecordnames(const Options &opt) {
+  std::vector<std::string> names = {"EnergyCorrection_weighttable"};
+  for (const std::string &nodename : opt.hitnodes)
+    names.push_back("EnergyCorrection_" + nodename);
+  return names;
+}
+
+//____________________________________________________________________________..
+// refuses an input corrected before, as EnergyCorrection::InitRun does
+bool checkrunrecords(const Options &opt, TFile *infile) {
+  TTree *runtree = (TTree *) infile->Get(runtreename.c_str());
+  if (!runtree)
+    return true;
+  std::vector<std::string> branchnames;
+  TObjArray *branches = runtree->GetListOfBranches();
+  for (int i = 0; i < branches->GetEntriesFast(); i++)
+    branchnames.push_back(((TBranch *) branches->At(i))->GetName());
+  for (const std::string &recordname : runrecordnames(opt)) {
+    int branch = findbranch(branchnames, recordname);
+    if (branch >= 0) {
+      std::cout << "EnergyCorrectionPipeline: the run tree of " << opt.input
+                << " carries " << branchnames[branch]
+                << ", refusing to apply the correction twice" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+//____________________________________________________________________________..
+// the contents of EnergyCorrection::fillrunrecord() for the correction the
+// pipeline applies: the hits, no delta
+void fillrunrecord(PHParameters &record, const Options &opt,
+                   const CorrectionEngine &engine,
+                   const std::string &instance) {
+  char version[32];
+  snprintf(version, sizeof(version), "%016llx",
+           (unsigned long long) engine.GetVersion());
+  record.set_string_param("version", version);
+  record.set_string_param("generator", opt.generatortype);
+  record.set_int_param("rapidity", engine.GetRapidityDep());
+  record.set_int_param("heavierbaryons", engine.GetReweightHeavierBaryons());
+  record.set_int_param("weightgrid", engine.GetUseWeightGrid());
+  record.set_double_param("mineta", engine.GetMinEta());
+  record.set_double_param("maxeta", engine.GetMaxEta());
+  record.set_int_param("delta", 0);
+  record.set_string_param("instance", instance);
+}
+
+//____________________________________________________________________________..
+// the run tree of the input, or a new one with a single run, with the
+// record of every hit node in every run as Fun4AllDstOutputManager writes
+// the RUN node
+void writeruntree(const Options &opt, const CorrectionEngine &engine,
+                  TFile *infile, TFile *outfile) {
+  const std::string instance =
+      "EnergyCorrectionPipeline " + std::to_string(getpid()) + " " +
+      std::to_string(
+          std::chrono::system_clock::now().time_since_epoch().count());
+  TTree *intree = (TTree *) infile->Get(runtreename.c_str());
+  outfile->cd();
+  TTree *runtree = intree ? intree->CloneTree(-1, "fast")
+                          : new TTree(runtreename.c_str(), "RunTree");
+  std::vector<PdbParameterMap *> maps(opt.hitnodes.size(), nullptr);
+  std::vector<TBranch *> branches;
+  for (unsigned int i = 0; i < opt.hitnodes.size(); i++) {
+    const std::string recordname = "EnergyCorrection_" + opt.hitnodes[i];
+    PHParameters record(recordname);
+    fillrunrecord(record, opt, engine, instance);
+    maps[i] = new PdbParameterMap();
+    record.CopyToPdbParameterMap(maps[i]);
+    branches.push_back(
+        runtree->Branch(("RUN#" + recordname).c_str(), &maps[i]));
+  }
+  if (intree) {
+    for (long long run = 0; run < runtree->GetEntries(); run++) {
+      for (TBranch *branch : branches)
+        branch->Fill();
+    }
+  } else {
+    runtree->Fill();
+  }
+  runtree->Write();
+  runtree->ResetBranchAddresses();
+  for (PdbParameterMap *map : maps)
+    delete map;
+}
+
+//____________________________________________________________________________..
+// every tree of the input file but the event and the run tree
+void copyothertrees(TFile *infile, TFile *outfile) {
+  std::set<std::string> copied = {eventtreename, runtreename};
+  TIter next(infile->GetListOfKeys());
+  while (TKey *key = (TKey *) next()) {
+    // older cycles of a tree come after the newest one
+    TClass *cl = TClass::GetClass(key->GetClassName());
+    if (!cl || !cl->InheritsFrom(TTree::Class()) ||
+        !copied.insert(key->GetName()).second)
+      continue;
+    TTree *tree = (TTree *) infile->Get(key->GetName());
+    outfile->cd();
+    TTree *copy = tree->CloneTree(-1, "fast");
+    copy->Write();
+  }
+}
+
+//____________________________________________________________________________..
+void usage(const char *name) {
+  std::cout << "usage: " << name
+            << " -i <input DST> -o <output DST> [-g generator]"
+               " [-t table file | -d table directory -y rapidity file]"
+               " [-c hit node,...] [-r] [-j reweight workers]"
+               " [-s event slots] [-m ROOT I/O threads] [-n events] [-v]"
+            << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  int c;
+  while ((c = getopt(argc, argv, "i:o:g:t:d:y:c:rj:s:m:n:v")) != -1) {
+    switch (c) {
+    case 'i':
+      opt.input = optarg;
+      break;
+    case 'o':
+      opt.output = optarg;
+      break;
+    case 'g':
+      opt.generatortype = optarg;
+      break;
+    case 't':
+      opt.tablefile = optarg;
+      break;
+    case 'd':
+      opt.tabledir = optarg;
+      break;
+    case 'y':
+      opt.rapfile = optarg;
+      break;
+    case 'c':
+      opt.hitnodes = split(optarg, ',');
+      break;
+    case 'r':
+      opt.rapidity = true;
+      break;
+    case 'j':
+      opt.nworkers = std::atoi(optarg);
+      break;
+    case 's':
+      opt.nslots = std::atoi(optarg);
+      break;
+    case 'm':
+      opt.iothreads = std::atoi(optarg);
+      break;
+    case 'n':
+      opt.nevents = std::atoll(optarg);
+      break;
+    case 'v':
+      opt.verbose = true;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (opt.input.empty() || opt.output.empty() || opt.nworkers <= 0 ||
+      opt.nslots < 0 || opt.nevents < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (opt.nslots == 0)
+    opt.nslots = 4 * opt.nworkers + 4;
+
+  // the reader and the writer use their own file from their own thread
+  ROOT::EnableThreadSafety();
+  if (opt.iothreads > 0)
+    ROOT::EnableImplicitMT(opt.iothreads);
+
+  Pipeline p;
+  p.opt = &opt;
+  CorrectionEngine engine;
+  if (!setupweight(opt, engine, p.weight))
+    return 1;
+  p.registry = &engine.GetSpeciesRegistry();
+
+  TFile *infile = TFile::Open(opt.input.c_str(), "READ");
+  if (!infile || infile->IsZombie()) {
+    std::cout << "EnergyCorrectionPipeline: cannot open " << opt.input
+              << std::endl;
+    return 1;
+  }
+  p.intree = (TTree *) infile->Get(eventtreename.c_str());
+  if (!p.intree) {
+    std::cout << "EnergyCorrectionPipeline: no event tree in " << opt.input
+              << std::endl;
+    return 1;
+  }
+  if (!setupbranches(p) || !checkrunrecords(opt, infile))
+    return 1;
+  p.nentries = p.intree->GetEntries();
+  if (opt.nevents > 0)
+    p.nentries = std::min(p.nentries, opt.nevents);
+
+  TFile *outfile = TFile::Open(opt.output.c_str(), "RECREATE");
+  if (!outfile || outfile->IsZombie()) {
+    std::cout << "EnergyCorrectionPipeline: cannot create " << opt.output
+              << std::endl;
+    return 1;
+  }
+  outfile->cd();
+  p.outtree = p.intree->CloneTree(0);
+  // a clone follows the branch addresses of its source, but the reader and
+  // the writer point the two trees at different slots
+  p.intree->GetListOfClones()->Remove(p.outtree);
+
+  p.slots.resize(opt.nslots);
+  for (int i = 0; i < opt.nslots; i++) {
+    // owned by the slot, not by ROOT, for the lifetime of the pipeline
+    for (TClass *cl : p.branchclasses) {
+      p.slots[i].objects.push_back(cl->New());
+      p.slots[i].nodes.push_back(static_cast<PHObject *>(
+          cl->DynamicCast(PHObject::Class(), p.slots[i].objects.back())));
+    }
+    p.freeslots.Push(i);
+  }
+  p.reweighttimers.resize(opt.nworkers);
+  p.counts.resize(opt.nworkers);
+
+  std::cout << "EnergyCorrectionPipeline: " << p.nentries << " events of "
+            << opt.input << ", " << opt.nworkers << " reweighting workers, "
+            << opt.nslots << " event slots" << std::endl;
+  Clock::time_point start = Clock::now();
+  std::thread reader(readstage, std::ref(p));
+  std::vector<std::thread> workers;
+  for (int i = 0; i < opt.nworkers; i++)
+    workers.emplace_back(reweightstage, std::ref(p), i);
+  std::thread writer(writestage, std::ref(p));
+  reader.join();
+  for (std::thread &worker : workers)
+    worker.join();
+  p.towrite.Close();
+  writer.join();
+  double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  outfile->cd();
+  if (p.readfailed < 0) {
+    p.outtree->Write();
+    writeruntree(opt, engine, infile, outfile);
+    copyothertrees(infile, outfile);
+  }
+  outfile->Close();
+  infile->Close();
+  for (Slot &slot : p.slots) {
+    for (unsigned int i = 0; i < slot.objects.size(); i++)
+      p.branchclasses[i]->Destructor(slot.objects[i]);
+  }
+  if (p.readfailed >= 0) {
+    std::remove(opt.output.c_str());
+    std::cout << "EnergyCorrectionPipeline: cannot read entry "
+              << p.readfailed << " of " << opt.input << ", removed "
+              << opt.output << std::endl;
+    return 1;
+  }
+
+  Counts total;
+  double reweightbusy = 0;
+  for (int i = 0; i < opt.nworkers; i++) {
+    total.events += p.counts[i].events;
+    total.hits += p.counts[i].hits;
+    total.hitsscaled += p.counts[i].hitsscaled;
+    total.failed += p.counts[i].failed;
+    reweightbusy += p.reweighttimers[i].busy;
+  }
+  std::cout << "EnergyCorrectionPipeline: " << p.written << " events, "
+            << total.hitsscaled << " of " << total.hits
+            << " hits reweighted in " << std::fixed << std::setprecision(2)
+            << elapsed << " s, " << std::setprecision(1)
+            << (elapsed > 0 ? p.written / elapsed : 0) << " events/s"
+            << std::endl;
+  if (elapsed > 0)
+    std::cout << "EnergyCorrectionPipeline: busy read "
+              << 100 * p.readtimer.busy / elapsed << "%, reweight "
+              << 100 * reweightbusy / (elapsed * opt.nworkers) << "% of "
+              << opt.nworkers << " workers, write "
+              << 100 * p.writetimer.busy / elapsed
+              << "%; mean queue depth free slots "
+              << std::setprecision(2) << p.freeslots.GetMeanDepth()
+              << ", reweight " << p.toreweight.GetMeanDepth() << ", write "
+              << p.towrite.GetMeanDepth() << " of " << opt.nslots
+              << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+  if (total.failed > 0)
+    std::cout << "EnergyCorrectionPipeline: " << total.failed
+              << " events without Npart written unchanged"
+            << std::endl;
+  return (long long) p.written == p.nentries ? 0 : 1;
+}
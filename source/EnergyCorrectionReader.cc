@@ -0,0 +1,191 @@
+//____________________________________________________________________________..
+//
+//____________________________________________________________________________..
+
+#include "EnergyCorrectionReader.h"
+
+#include <fun4all/Fun4AllReturnCodes.h>
+
+#include <phool/PHCompositeNode.h>
+#include <phool/getClass.h>
+
+#include <g4main/PHG4Hit.h>
+#include <g4main/PHG4HitContainer.h>
+#include <g4main/PHG4Shower.h>
+#include <g4main/PHG4TruthInfoContainer.h>
+
+#include <phhepmc/PHHepMCGenEvent.h>
+#include <phhepmc/PHHepMCGenEventMap.h>
+
+#include <HepMC/GenEvent.h>
+#include <HepMC/HeavyIon.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+//____________________________________________________________________________..
+EnergyCorrectionReader::EnergyCorrectionReader(const std::string &name)
+    : SubsysReco(name) {}
+
+//____________________________________________________________________________..
+EnergyCorrectionReader::~EnergyCorrectionReader() {}
+
+//____________________________________________________________________________..
+int EnergyCorrectionReader::Init(PHCompositeNode *topNode) {
+  if (!m_sidecar.OpenRead(m_filename, m_variant))
+    return Fun4AllReturnCodes::ABORTRUN;
+  if (Verbosity() > 0)
+    std::cout << "EnergyCorrectionReader::Init(PHCompositeNode *topNode) "
+              << m_sidecar.GetEntries() << " events in " << m_filename
+              << std::endl;
+  m_entry = 0;
+  return Fun4AllReturnCodes::EVENT_OK;
+}
+
+//____________________________________________________________________________..
+int EnergyCorrectionReader::process_event(PHCompositeNode *topNode) {
+  // weights of the previous event back to 1
+  for (int trkid : m_settrkids)
+    m_weights[trkid] = 1;
+  m_settrkids.clear();
+  m_otherweights.clear();
+
+  if (!m_sidecar.Read(m_entry)) {
+    std::cout << "EnergyCorrectionReader::process_event(PHCompositeNode "
+                 "*topNode) no weights for event "
+              << m_entry << " in " << m_filename << std::endl;
+    return Fun4AllReturnCodes::ABORTRUN;
+  }
+  m_entry++;
+  // one entry per input event of EnergyCorrection, a gap means entries were
+  // lost or the file was written by more than one job
+  if (m_sidecar.GetEvent() != m_entry) {
+    std::cout << "EnergyCorrectionReader::process_event(PHCompositeNode "
+                 "*topNode) entry "
+              << m_entry - 1 << " in " << m_filename << " holds event "
+              << m_sidecar.GetEvent() << ", expected " << m_entry
+              << std::endl;
+    return Fun4AllReturnCodes::ABORTRUN;
+  }
+  // EnergyCorrection dropped this event from its output
+  if (m_sidecar.GetNpart() == WeightSidecar::abortednpart)
+    return Fun4AllReturnCodes::ABORTEVENT;
+  // entries are matched by position, a different Npart means the sidecar
+  // belongs to another file or is out of step with it
+  int npart = eventnpart(topNode);
+  if (npart != m_sidecar.GetNpart()) {
+    std::cout << "EnergyCorrectionReader::process_event(PHCompositeNode "
+                 "*topNode) weights of entry "
+              << m_entry - 1 << " in " << m_filename
+              << " do not belong to this event, Npart " << npart
+              << " recorded " << m_sidecar.GetNpart() << std::endl;
+    return Fun4AllReturnCodes::ABORTRUN;
+  }
+  for (int i = 0; i < m_sidecar.GetNPrimaries(); i++) {
+    int trkid = m_sidecar.GetTrackId(i);
+    if (trkid <= 0 || trkid > maxtrkid) {
+      m_otherweights.push_back(std::make_pair(trkid, m_sidecar.GetWeight(i)));
+      continue;
+    }
+    if (trkid >= (int) m_weights.size())
+      m_weights.resize(trkid + 1, 1);
+    m_weights[trkid] = m_sidecar.GetWeight(i);
+    m_settrkids.push_back(trkid);
+  }
+  std::sort(m_otherweights.begin(), m_otherweights.end());
+
+  if (m_HitNodeNames.empty())
+    return Fun4AllReturnCodes::EVENT_OK;
+
+  PHG4TruthInfoContainer *truthinfo =
+      findNode::getClass<PHG4TruthInfoContainer>(topNode, "G4TruthInfo");
+  if (!truthinfo) {
+    std::cout << "EnergyCorrectionReader::process_event(PHCompositeNode "
+                 "*topNode) Could not locate G4TruthInfo node"
+              << std::endl;
+    return Fun4AllReturnCodes::ABORTEVENT;
+  }
+  for (const std::string &nodename : m_HitNodeNames) {
+    PHG4HitContainer *hits =
+        findNode::getClass<PHG4HitContainer>(topNode, nodename);
+    if (!hits) {
+      std::cout << "EnergyCorrectionReader::process_event(PHCompositeNode "
+                   "*topNode) Could not locate g4 hit node "
+                << nodename << std::endl;
+      return Fun4AllReturnCodes::ABORTEVENT;
+    }
+    PHG4HitContainer::ConstRange hit_range = hits->getHits();
+    for (PHG4HitContainer::ConstIterator hit_iter = hit_range.first;
+         hit_iter != hit_range.second; hit_iter++) {
+      PHG4Hit *hit = hit_iter->second;
+      m_nhits++;
+      float scale = GetHitWeight(hit, truthinfo);
+      if (scale == 1)
+        continue;
+      hit->set_edep(hit->get_edep() * scale);
+      hit->set_light_yield(hit->get_light_yield() * scale);
+      m_nhitsscaled++;
+    }
+  }
+  return Fun4AllReturnCodes::EVENT_OK;
+}
+
+//____________________________________________________________________________..
+int EnergyCorrectionReader::eventnpart(PHCompositeNode *topNode) const {
+  // as EnergyCorrection::process_event(), -1 without a heavy ion record
+  PHHepMCGenEventMap *genevtmap =
+      findNode::getClass<PHHepMCGenEventMap>(topNode, "PHHepMCGenEventMap");
+  if (!genevtmap)
+    return -1;
+  int npart = -1;
+  for (PHHepMCGenEventMap::Iter iter = genevtmap->begin();
+       iter != genevtmap->end(); ++iter) {
+    PHHepMCGenEvent *genevt = iter->second;
+    if (genevt->get_embedding_id() != 0)
+      continue;
+    HepMC::GenEvent *event = genevt->getEvent();
+    if (!event || !event->heavy_ion())
+      continue;
+    HepMC::HeavyIon *hi = event->heavy_ion();
+    npart = hi->Npart_proj() + hi->Npart_targ();
+  }
+  return npart;
+}
+
+//____________________________________________________________________________..
+float EnergyCorrectionReader::GetWeight(int trkid) const {
+  if (trkid > 0 && trkid < (int) m_weights.size())
+    return m_weights[trkid];
+  if (trkid > 0 && trkid <= maxtrkid)
+    return 1;
+  std::vector<std::pair<int, float>>::const_iterator iter =
+      std::lower_bound(m_otherweights.begin(), m_otherweights.end(),
+                       std::make_pair(trkid, -HUGE_VALF));
+  if (iter == m_otherweights.end() || iter->first != trkid)
+    return 1;
+  return iter->second;
+}
+
+//____________________________________________________________________________..
+float EnergyCorrectionReader::GetHitWeight(
+    const PHG4Hit *hit, PHG4TruthInfoContainer *truthinfo) const {
+  PHG4Shower *shower = truthinfo->GetPrimaryShower(hit->get_shower_id());
+  if (!shower)
+    return 1;
+  return GetWeight(shower->get_parent_particle_id());
+}
+
+//____________________________________________________________________________..
+int EnergyCorrectionReader::End(PHCompositeNode *topNode) {
+  if (m_entry != m_sidecar.GetEntries())
+    std::cout << "EnergyCorrectionReader::End(PHCompositeNode *topNode) "
+              << m_entry << " events processed, " << m_sidecar.GetEntries()
+              << " in " << m_filename << std::endl;
+  if (Verbosity() > 0)
+    std::cout << "EnergyCorrectionReader::End(PHCompositeNode *topNode) "
+              << m_nhitsscaled << " of " << m_nhits << " hits reweighted"
+              << std::endl;
+  m_sidecar.Close();
+  return Fun4AllReturnCodes::EVENT_OK;
+}
@@ -0,0 +1,76 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef ENERGYCORRECTIONREADER_H
+#define ENERGYCORRECTIONREADER_H
+
+#include "WeightSidecar.h"
+
+#include <fun4all/SubsysReco.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class PHCompositeNode;
+class PHG4Hit;
+class PHG4TruthInfoContainer;
+
+// Reads the weight sidecar written by EnergyCorrection::SetWeightSidecar(),
+// one entry per event in the same order as the DST; the event id and the
+// Npart of every entry are checked against the event. The weights are applied
+// to the configured hit containers, or with none configured only looked up
+// on demand, e.g. by a tower builder through GetHitWeight().
+class EnergyCorrectionReader : public SubsysReco
+{
+public:
+    EnergyCorrectionReader(const std::string &name = "EnergyCorrectionReader");
+
+    ~EnergyCorrectionReader() override;
+
+    int Init(PHCompositeNode *topNode) override;
+
+    int process_event(PHCompositeNode *topNode) override;
+
+    int End(PHCompositeNode *topNode) override;
+
+    void SetSidecarFile(const std::string &filename) { m_filename = filename; }
+    // apply the weights of a systematic variant stored by
+    // EnergyCorrection::AddVariant() instead of the nominal ones
+    void SetVariant(const std::string &variant) { m_variant = variant; }
+
+    // hit containers scaled in process_event()
+    void SetHitNodeName(const std::string &name) { m_HitNodeNames.assign(1, name); }
+    void AddHitNodeName(const std::string &name) { m_HitNodeNames.push_back(name); }
+    void SetHitNodeNames(const std::vector<std::string> &names) { m_HitNodeNames = names; }
+
+    // Npart the weights of this event were computed with
+    int GetNpart() const { return m_sidecar.GetNpart(); }
+
+    // weight of a primary in this event, 1 if it is not listed
+    float GetWeight(int trkid) const;
+    // weight of the primary whose shower a hit belongs to
+    float GetHitWeight(const PHG4Hit *hit, PHG4TruthInfoContainer *truthinfo) const;
+
+private:
+    int eventnpart(PHCompositeNode *topNode) const;
+
+    std::string m_filename;
+    std::string m_variant;
+    std::vector<std::string> m_HitNodeNames;
+
+    WeightSidecar m_sidecar;
+    long long m_entry = 0;
+
+    // dense track id -> weight table, only the listed entries are reset
+    static const int maxtrkid = 1 << 22;
+    std::vector<float> m_weights;
+    std::vector<int> m_settrkids;
+    // the other listed track ids, sorted: secondaries with non-positive ids
+    // that ShowerIndex weights as shower parents, and ids beyond maxtrkid
+    std::vector<std::pair<int, float>> m_otherweights;
+
+    unsigned long m_nhits = 0;
+    unsigned long m_nhitsscaled = 0;
+};
+
+#endif // ENERGYCORRECTIONREADER_H
@@ -0,0 +1,420 @@
+//____________________________________________________________________________..
+//
+// Replays event snapshots written by EnergyCorrection::SetSnapshotFile()
+// through the correction engine, without Fun4All or DSTs. Reports the
+// reweighting throughput and writes or checks a golden file with the weight
+// of every hit, so engine changes can be timed and validated off the cluster.
+//
+//   EnergyCorrectionReplay -s <snapshot file>
+//       [-t table file | -g generator -d table directory -y rapidity file]
+//       [-r] [-H] [-k] [-a] [-n repeat] [-w golden] [-c golden]
+//       [-e tolerance]
+//
+//   -r  rapidity dependent correction
+//   -H  histogram path instead of the weight grid
+//   -k  batch kernel instead of one Weight() per primary, needs the grid
+//   -a  returns non-zero if the replay passes after the first allocate any
+//       memory, the buffers have to be reused from one event to the next
+//   -w  write the hit weights to a golden file
+//   -c  compare the hit weights with a golden file, relative tolerance -e
+//       (default 0, identical); returns non-zero on any difference
+//____________________________________________________________________________..
+
+#include "CorrectionEngine.h"
+#include "EventSnapshot.h"
+#include "WeightKernel.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+// every operator new of the process, see the replacements below
+unsigned long g_allocations = 0;
+} // namespace
+
+void *operator new(std::size_t size) {
+  g_allocations++;
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct Options {
+  std::string snapshot;
+  std::string tablefile;
+  std::string generatortype = "HIJING";
+  std::string tabledir = CorrectionTables::defaulttabledir;
+  std::string rapfile = CorrectionTables::defaultrapfile;
+  bool rapidity = false;
+  bool histogram = false;
+  bool kernel = false;
+  bool checkallocations = false;
+  int repeat = 5;
+  std::string writegolden;
+  std::string comparegolden;
+  double tolerance = 0;
+};
+
+// snapshot with the hits resolved to primary indices, -1 for no primary
+struct ReplayEvent {
+  EventSnapshot snapshot;
+  std::vector<int> hitprimary;
+  WeightBatch batch;
+};
+
+// per hit weights of all events, the replay output
+typedef std::vector<std::vector<float>> HitWeights;
+
+const char goldenmagic[8] = {'E', 'C', 'G', 'O', 'L', 'D', 'E', 'N'};
+const uint32_t goldenversion = 1;
+
+//____________________________________________________________________________..
+bool setupengine(const Options &opt, CorrectionEngine &engine) {
+  engine.SetRapidityDep(opt.rapidity);
+  engine.SetUseWeightGrid(!opt.histogram);
+  if (!opt.tablefile.empty()) {
+    if (!engine.LoadTableFile(opt.tablefile, opt.generatortype))
+      return false;
+  } else {
+    if (!engine.SetGeneratorType(opt.generatortype)) {
+      std::cout << "EnergyCorrectionReplay: generator type "
+                << opt.generatortype << " not supported" << std::endl;
+      return false;
+    }
+    if (!engine.LoadPtTables(opt.generatortype, opt.tabledir))
+      return false;
+    if (opt.rapidity && !engine.LoadRapidityTables(opt.rapfile))
+      return false;
+  }
+  if (!engine.Init())
+    return false;
+  if (opt.kernel && !engine.GetUseWeightGrid()) {
+    std::cout << "EnergyCorrectionReplay: the batch kernel needs the weight "
+                 "grid"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//____________________________________________________________________________..
+bool readsnapshots(const Options &opt, const CorrectionEngine &engine,
+                   std::vector<ReplayEvent> &events) {
+  EventSnapshotFile file;
+  if (!file.OpenRead(opt.snapshot))
+    return false;
+  const SpeciesRegistry &species = engine.GetSpeciesRegistry();
+  std::unordered_map<int, int> primaryindex;
+  ReplayEvent event;
+  while (file.Read(event.snapshot)) {
+    // the truth lookups of the module, done once outside the timing
+    primaryindex.clear();
+    event.batch.clear();
+    for (unsigned int i = 0; i < event.snapshot.primaries.size(); i++) {
+      const EventSnapshot::Primary &p = event.snapshot.primaries[i];
+      primaryindex[p.trkid] = i;
+      int index = species.Index(p.pid);
+      event.batch.push_back(p.px, p.py, p.pz, p.e,
+                            index < 0 ? engine.GetKernel().GetUnitSpecies()
+                                      : index);
+    }
+    event.batch.resizeoutputs();
+    event.hitprimary.resize(event.snapshot.hits.size());
+    for (unsigned int i = 0; i < event.snapshot.hits.size(); i++) {
+      std::unordered_map<int, int>::const_iterator it =
+          primaryindex.find(event.snapshot.hits[i].trkid);
+      event.hitprimary[i] = it == primaryindex.end() ? -1 : it->second;
+    }
+    events.push_back(event);
+  }
+  std::cout << "EnergyCorrectionReplay: " << events.size() << " events from "
+            << opt.snapshot << std::endl;
+  return !events.empty();
+}
+
+//____________________________________________________________________________..
+// weights of all hits of one event, returns the reweighted energy sum
+double replayevent(CorrectionEngine &engine, ReplayEvent &event, bool kernel,
+                   std::vector<float> &primaryweight,
+                   std::vector<float> &hitweight) {
+  const EventSnapshot &snapshot = event.snapshot;
+  engine.SetNpart(snapshot.npart);
+  primaryweight.resize(snapshot.primaries.size());
+  if (kernel) {
+    engine.GetKernel().Evaluate(event.batch);
+    for (unsigned int i = 0; i < snapshot.primaries.size(); i++)
+      primaryweight[i] = event.batch.accepted[i] ? event.batch.weight[i] : 1;
+  } else {
+    for (unsigned int i = 0; i < snapshot.primaries.size(); i++) {
+      const EventSnapshot::Primary &p = snapshot.primaries[i];
+      engine.Weight(p.px, p.py, p.pz, p.e, p.pid, snapshot.npart,
+                    primaryweight[i]);
+    }
+  }
+  hitweight.resize(snapshot.hits.size());
+  double esum = 0;
+  for (unsigned int i = 0; i < snapshot.hits.size(); i++) {
+    int primary = event.hitprimary[i];
+    hitweight[i] = primary < 0 ? 1 : primaryweight[primary];
+    esum += snapshot.hits[i].edep * hitweight[i];
+  }
+  return esum;
+}
+
+//____________________________________________________________________________..
+bool writegolden(const std::string &filename,
+                 const std::vector<ReplayEvent> &events,
+                 const HitWeights &weights) {
+  FILE *f = fopen(filename.c_str(), "wb");
+  if (!f) {
+    std::cout << "EnergyCorrectionReplay: cannot write " << filename
+              << std::endl;
+    return false;
+  }
+  uint32_t nevents = events.size();
+  fwrite(goldenmagic, sizeof(goldenmagic), 1, f);
+  fwrite(&goldenversion, sizeof(goldenversion), 1, f);
+  fwrite(&nevents, sizeof(nevents), 1, f);
+  for (unsigned int i = 0; i < events.size(); i++) {
+    int32_t event = events[i].snapshot.event;
+    uint32_t nhits = weights[i].size();
+    fwrite(&event, sizeof(event), 1, f);
+    fwrite(&nhits, sizeof(nhits), 1, f);
+    fwrite(weights[i].data(), sizeof(float), nhits, f);
+  }
+  bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
+
+//____________________________________________________________________________..
+// 0 if every hit weight agrees within the relative tolerance
+int comparegolden(const std::string &filename,
+                  const std::vector<ReplayEvent> &events,
+                  const HitWeights &weights, double tolerance) {
+  FILE *f = fopen(filename.c_str(), "rb");
+  if (!f) {
+    std::cout << "EnergyCorrectionReplay: cannot read " << filename
+              << std::endl;
+    return 1;
+  }
+  char magic[8];
+  uint32_t version = 0;
+  uint32_t nevents = 0;
+  if (fread(magic, sizeof(magic), 1, f) != 1 ||
+      std::memcmp(magic, goldenmagic, sizeof(magic)) != 0 ||
+      fread(&version, sizeof(version), 1, f) != 1 ||
+      version != goldenversion || fread(&nevents, sizeof(nevents), 1, f) != 1) {
+    std::cout << "EnergyCorrectionReplay: " << filename
+              << " is not a golden file" << std::endl;
+    fclose(f);
+    return 1;
+  }
+  if (nevents != events.size()) {
+    std::cout << "EnergyCorrectionReplay: golden file has " << nevents
+              << " events, the snapshots " << events.size() << std::endl;
+    fclose(f);
+    return 1;
+  }
+  unsigned long nhitstotal = 0;
+  unsigned long ndiff = 0;
+  double maxrel = 0;
+  std::vector<float> golden;
+  int status = 0;
+  for (unsigned int i = 0; i < events.size() && status == 0; i++) {
+    int32_t event = 0;
+    uint32_t nhits = 0;
+    if (fread(&event, sizeof(event), 1, f) != 1 ||
+        fread(&nhits, sizeof(nhits), 1, f) != 1 ||
+        event != events[i].snapshot.event || nhits != weights[i].size()) {
+      std::cout << "EnergyCorrectionReplay: golden event " << i
+                << " does not match snapshot event "
+                << events[i].snapshot.event << std::endl;
+      status = 1;
+      break;
+    }
+    golden.resize(nhits);
+    if (fread(golden.data(), sizeof(float), nhits, f) != nhits) {
+      std::cout << "EnergyCorrectionReplay: golden file truncated"
+                << std::endl;
+      status = 1;
+      break;
+    }
+    for (unsigned int ihit = 0; ihit < nhits; ihit++) {
+      double ref = golden[ihit];
+      double val = weights[i][ihit];
+      double rel = std::abs(val - ref) / std::max(std::abs(ref), 1e-6);
+      maxrel = std::max(maxrel, rel);
+      if (rel > tolerance) {
+        if (ndiff < 5)
+          std::cout << "EnergyCorrectionReplay: event "
+                    << events[i].snapshot.event << " hit " << ihit
+                    << std::setprecision(9) << " weight " << val
+                    << ", golden " << ref << std::setprecision(6)
+                    << std::endl;
+        ndiff++;
+      }
+    }
+    nhitstotal += nhits;
+  }
+  fclose(f);
+  if (status == 0) {
+    std::cout << "EnergyCorrectionReplay: " << nhitstotal
+              << " hit weights compared, " << ndiff
+              << " differ beyond tolerance " << tolerance
+              << ", max rel deviation " << maxrel << std::endl;
+    status = ndiff > 0;
+  }
+  return status;
+}
+
+//____________________________________________________________________________..
+void usage(const char *name) {
+  std::cout << "usage: " << name
+            << " -s <snapshot file> [-t table file | -g generator"
+               " -d table directory -y rapidity file] [-r] [-H] [-k] [-a]"
+               " [-n repeat] [-w golden] [-c golden] [-e tolerance]"
+            << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  int c;
+  while ((c = getopt(argc, argv, "s:t:g:d:y:rHkan:w:c:e:")) != -1) {
+    switch (c) {
+    case 's':
+      opt.snapshot = optarg;
+      break;
+    case 't':
+      opt.tablefile = optarg;
+      break;
+    case 'g':
+      opt.generatortype = optarg;
+      break;
+    case 'd':
+      opt.tabledir = optarg;
+      break;
+    case 'y':
+      opt.rapfile = optarg;
+      break;
+    case 'r':
+      opt.rapidity = true;
+      break;
+    case 'H':
+      opt.histogram = true;
+      break;
+    case 'k':
+      opt.kernel = true;
+      break;
+    case 'a':
+      opt.checkallocations = true;
+      break;
+    case 'n':
+      opt.repeat = std::atoi(optarg);
+      break;
+    case 'w':
+      opt.writegolden = optarg;
+      break;
+    case 'c':
+      opt.comparegolden = optarg;
+      break;
+    case 'e':
+      opt.tolerance = std::atof(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (opt.snapshot.empty() || opt.repeat <= 0 ||
+      (opt.checkallocations && opt.repeat < 2)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  CorrectionEngine engine;
+  if (!setupengine(opt, engine))
+    return 1;
+  std::vector<ReplayEvent> events;
+  if (!readsnapshots(opt, engine, events))
+    return 1;
+
+  unsigned long nhits = 0;
+  unsigned long nprimaries = 0;
+  for (const ReplayEvent &event : events) {
+    nhits += event.snapshot.hits.size();
+    nprimaries += event.snapshot.primaries.size();
+  }
+
+  HitWeights weights(events.size());
+  std::vector<float> primaryweight;
+  double best = 0;
+  volatile double sink = 0;
+  // the first pass sizes the buffers
+  unsigned long steadyallocations = 0;
+  for (int irepeat = 0; irepeat < opt.repeat; irepeat++) {
+    const unsigned long allocations = g_allocations;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < events.size(); i++)
+      sink = sink + replayevent(engine, events[i], opt.kernel, primaryweight,
+                                weights[i]);
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    if (irepeat > 0)
+      steadyallocations += g_allocations - allocations;
+    if (irepeat == 0 || seconds < best)
+      best = seconds;
+  }
+  std::cout << "EnergyCorrectionReplay: "
+            << (opt.histogram ? "histogram" : "grid")
+            << (opt.kernel ? std::string(" ") +
+                                 WeightKernel::GetIsaName(
+                                     engine.GetKernel().GetIsa()) +
+                                 " kernel"
+                           : std::string(" scalar"))
+            << (opt.rapidity ? ", rapidity dependent" : "") << ": "
+            << events.size() << " events, " << nprimaries << " primaries, "
+            << nhits << " hits in " << std::fixed << std::setprecision(3)
+            << best * 1e3 << " ms (best of " << opt.repeat << "), "
+            << std::setprecision(1) << events.size() / best << " events/s, "
+            << nhits / best * 1e-6 << " Mhits/s" << std::endl;
+  std::cout.unsetf(std::ios::fixed);
+  if (opt.repeat > 1)
+    std::cout << "EnergyCorrectionReplay: " << steadyallocations
+              << " allocations after the first pass" << std::endl;
+  if (opt.checkallocations && steadyallocations > 0)
+    return 1;
+
+  if (!opt.writegolden.empty()) {
+    if (!writegolden(opt.writegolden, events, weights))
+      return 1;
+    std::cout << "EnergyCorrectionReplay: wrote " << opt.writegolden
+              << std::endl;
+  }
+  if (!opt.comparegolden.empty())
+    return comparegolden(opt.comparegolden, events, weights, opt.tolerance);
+  return 0;
+}
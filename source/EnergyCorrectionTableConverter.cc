@@ -0,0 +1,57 @@
+//____________________________________________________________________________..
+//
+// Compiles the ROOT correction tables of one generator into the binary table
+// file read by EnergyCorrection::SetTableFile(), so reconstruction jobs map
+// one small file instead of opening the ROOT files.
+//
+//   EnergyCorrectionTableConverter <generator> <output> [table directory]
+//                                  [rapidity file | none]
+//
+// The directory holds fitratio<generator>.root and fitratioLambda<generator>.root,
+// "none" leaves the rapidity tables out.
+//____________________________________________________________________________..
+
+#include "CorrectionTableFile.h"
+#include "CorrectionTables.h"
+
+#include <iostream>
+#include <string>
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cout << "usage: " << argv[0]
+              << " <generator> <output> [table directory] [rapidity file | none]"
+              << std::endl;
+    return 1;
+  }
+  const std::string generatortype = argv[1];
+  const std::string output = argv[2];
+  const std::string directory =
+      argc > 3 ? argv[3] : CorrectionTables::defaulttabledir;
+  const std::string rapfile =
+      argc > 4 ? argv[4] : CorrectionTables::defaultrapfile;
+
+  CorrectionTables tables;
+  if (!tables.SetGeneratorType(generatortype)) {
+    std::cout << argv[0] << ": generator type " << generatortype
+              << " not supported" << std::endl;
+    return 1;
+  }
+  if (!tables.LoadPtTables(generatortype, directory))
+    return 1;
+  if (rapfile != "none" && !tables.LoadRapidityTables(rapfile))
+    return 1;
+  if (!tables.WriteTableFile(output, generatortype))
+    return 1;
+
+  // read it back through the same checks the module does
+  CorrectionTableFile check;
+  if (!check.Map(output))
+    return 1;
+  std::cout << argv[0] << ": wrote " << output << ", "
+            << check.GetMappedSize() << " bytes, checksum " << std::hex
+            << check.GetChecksum() << std::dec
+            << (tables.HasRapidityTables() ? ", with" : ", without")
+            << " rapidity tables" << std::endl;
+  return 0;
+}
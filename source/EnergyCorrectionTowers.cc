@@ -0,0 +1,112 @@
+//____________________________________________________________________________..
+//
+//____________________________________________________________________________..
+
+#include "EnergyCorrectionTowers.h"
+
+#include "PrimaryWeightTable.h"
+
+#include <fun4all/Fun4AllReturnCodes.h>
+
+#include <phool/PHCompositeNode.h>
+#include <phool/getClass.h>
+
+#include <calobase/RawTower.h>
+#include <calobase/RawTowerContainer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+// relative difference of a tower energy and the sum of its shower energies
+// that is still float rounding
+const double maxedepmismatch = 1e-4;
+} // namespace
+
+//____________________________________________________________________________..
+EnergyCorrectionTowers::EnergyCorrectionTowers(const std::string &name)
+    : SubsysReco(name), m_weighttablenode(PrimaryWeightTable::defaultnode) {}
+
+//____________________________________________________________________________..
+EnergyCorrectionTowers::~EnergyCorrectionTowers() {}
+
+//____________________________________________________________________________..
+int EnergyCorrectionTowers::Init(PHCompositeNode *topNode) {
+  m_towernodes.clear();
+  for (const std::string &detector : m_detectors)
+    m_towernodes.push_back("TOWER_" + m_prefix + "_" + detector);
+  return Fun4AllReturnCodes::EVENT_OK;
+}
+
+//____________________________________________________________________________..
+int EnergyCorrectionTowers::process_event(PHCompositeNode *topNode) {
+  PrimaryWeightTable *weights =
+      findNode::getClass<PrimaryWeightTable>(topNode, m_weighttablenode);
+  if (!weights) {
+    std::cout << "EnergyCorrectionTowers::process_event(PHCompositeNode "
+                 "*topNode) Could not locate weight table node "
+              << m_weighttablenode << std::endl;
+    return Fun4AllReturnCodes::ABORTRUN;
+  }
+  if (weights->GetHitsReweighted()) {
+    std::cout << "EnergyCorrectionTowers::process_event(PHCompositeNode "
+                 "*topNode) the hits are reweighted already, "
+                 "EnergyCorrection needs SetModifyHits(false)"
+              << std::endl;
+    return Fun4AllReturnCodes::ABORTRUN;
+  }
+  for (const std::string &nodename : m_towernodes) {
+    RawTowerContainer *towers =
+        findNode::getClass<RawTowerContainer>(topNode, nodename);
+    if (!towers) {
+      std::cout << "EnergyCorrectionTowers::process_event(PHCompositeNode "
+                   "*topNode) Could not locate tower node "
+                << nodename << std::endl;
+      return Fun4AllReturnCodes::ABORTEVENT;
+    }
+    RawTowerContainer::ConstRange tower_range = towers->getTowers();
+    for (RawTowerContainer::ConstIterator tower_iter = tower_range.first;
+         tower_iter != tower_range.second; tower_iter++) {
+      RawTower *tower = tower_iter->second;
+      m_ntowers++;
+      double edep = 0;
+      double weighted = 0;
+      RawTower::ShowerConstRange shower_range = tower->get_g4showers();
+      for (RawTower::ShowerConstIterator shower_iter = shower_range.first;
+           shower_iter != shower_range.second; shower_iter++) {
+        edep += shower_iter->second;
+        weighted +=
+            weights->GetShowerWeight(shower_iter->first) * shower_iter->second;
+      }
+      double energy = tower->get_energy();
+      if (std::abs(energy - edep) >
+          maxedepmismatch * std::max(std::abs(energy), edep)) {
+        std::cout << "EnergyCorrectionTowers::process_event(PHCompositeNode "
+                     "*topNode) tower energy "
+                  << energy << " of " << nodename
+                  << " is not the deposited energy " << edep
+                  << " of its showers, only towers built from edep can be "
+                     "weighted"
+                  << std::endl;
+        return Fun4AllReturnCodes::ABORTRUN;
+      }
+      if (weighted == edep)
+        continue;
+      tower->set_energy(weighted);
+      m_ntowersscaled++;
+    }
+    if (std::isfinite(m_emin))
+      towers->compress(m_emin);
+  }
+  return Fun4AllReturnCodes::EVENT_OK;
+}
+
+//____________________________________________________________________________..
+int EnergyCorrectionTowers::End(PHCompositeNode *topNode) {
+  if (Verbosity() > 0)
+    std::cout << "EnergyCorrectionTowers::End(PHCompositeNode *topNode) "
+              << m_ntowersscaled << " of " << m_ntowers << " towers reweighted"
+              << std::endl;
+  return Fun4AllReturnCodes::EVENT_OK;
+}
@@ -0,0 +1,63 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef ENERGYCORRECTIONTOWERS_H
+#define ENERGYCORRECTIONTOWERS_H
+
+#include <fun4all/SubsysReco.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+class PHCompositeNode;
+
+// Weighted sim towers for EnergyCorrection::SetWeightTableNode() with
+// SetModifyHits(false): the cells and sim towers are built from the
+// unmodified hits, then the energy of every tower is accumulated again as
+// sum(w edep) over the per-shower deposited energies the tower builders
+// keep, w the weight of the primary of the shower. Register it after the
+// tower builders.
+//
+// This is not a replacement for rewriting the hits. Only the towers of the
+// detectors given here are weighted; the hits, the cells and everything
+// else built from them stay as simulated. Only towers whose energy is the deposited energy can be weighted this way,
+// e.g. HcalRawTowerBuilder with the default tower_energy_source. Towers from
+// the light yield or with a light collection model, like the CEMC towers of
+// PHG4FullProjSpacalCellReco, are not proportional to edep per primary; a
+// tower whose energy differs from the sum of its shower energies ends the
+// run. The emin of the tower builders cuts before the weights, so keep it
+// low there and set the threshold here, it is applied to the weighted towers.
+class EnergyCorrectionTowers : public SubsysReco
+{
+public:
+    EnergyCorrectionTowers(const std::string &name = "EnergyCorrectionTowers");
+
+    ~EnergyCorrectionTowers() override;
+
+    int Init(PHCompositeNode *topNode) override;
+
+    int process_event(PHCompositeNode *topNode) override;
+
+    int End(PHCompositeNode *topNode) override;
+
+    // towers of TOWER_<prefix>_<detector>, e.g. Detector("CEMC") with the
+    // default prefix SIM of the tower builders in the macro
+    void Detector(const std::string &detector) { m_detectors.push_back(detector); }
+    void SetTowerNodePrefix(const std::string &prefix) { m_prefix = prefix; }
+    void SetWeightTableNode(const std::string &nodename) { m_weighttablenode = nodename; }
+    // towers below emin after the weighting are removed, none by default
+    void SetEnergyThreshold(double emin) { m_emin = emin; }
+
+private:
+    std::vector<std::string> m_detectors;
+    std::string m_prefix {"SIM"};
+    std::string m_weighttablenode;
+    double m_emin = NAN;
+    // tower node names, built at Init()
+    std::vector<std::string> m_towernodes;
+
+    unsigned long m_ntowers = 0;
+    unsigned long m_ntowersscaled = 0;
+};
+
+#endif // ENERGYCORRECTIONTOWERS_H
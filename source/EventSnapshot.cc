@@ -0,0 +1,149 @@
+#include "EventSnapshot.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+const char snapshotmagic[8] = {'E', 'C', 'S', 'N', 'A', 'P', '\0', '\0'};
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t ncontainers;
+};
+
+struct EventHeader {
+  int32_t event;
+  int32_t npart;
+  uint32_t nprimaries;
+  uint32_t nhits;
+};
+
+static_assert(sizeof(EventSnapshot::Primary) == 40,
+              "snapshot primary layout changed");
+static_assert(sizeof(EventSnapshot::Hit) == 20, "snapshot hit layout changed");
+
+// sanity limit against reading garbage as a huge record
+const uint32_t maxentries = 1u << 28;
+} // namespace
+
+//____________________________________________________________________________..
+EventSnapshotFile::~EventSnapshotFile() {
+  Close();
+}
+
+//____________________________________________________________________________..
+bool EventSnapshotFile::OpenWrite(const std::string &filename,
+                                  const std::vector<std::string> &containers) {
+  Close();
+  m_file = fopen(filename.c_str(), "wb");
+  if (!m_file) {
+    std::cout << "EventSnapshotFile::OpenWrite() cannot open " << filename
+              << std::endl;
+    return false;
+  }
+  m_filename = filename;
+  m_writing = true;
+  m_containers = containers;
+  FileHeader header;
+  std::memcpy(header.magic, snapshotmagic, sizeof(snapshotmagic));
+  header.version = version;
+  header.ncontainers = containers.size();
+  fwrite(&header, sizeof(header), 1, m_file);
+  // names as length + characters
+  for (const std::string &name : containers) {
+    uint32_t length = name.size();
+    fwrite(&length, sizeof(length), 1, m_file);
+    fwrite(name.data(), 1, length, m_file);
+  }
+  return !ferror(m_file);
+}
+
+//____________________________________________________________________________..
+bool EventSnapshotFile::OpenRead(const std::string &filename) {
+  Close();
+  m_file = fopen(filename.c_str(), "rb");
+  if (!m_file) {
+    std::cout << "EventSnapshotFile::OpenRead() cannot open " << filename
+              << std::endl;
+    return false;
+  }
+  m_filename = filename;
+  m_writing = false;
+  FileHeader header;
+  bool ok = fread(&header, sizeof(header), 1, m_file) == 1 &&
+            std::memcmp(header.magic, snapshotmagic, sizeof(snapshotmagic)) ==
+                0 &&
+            header.version == version && header.ncontainers < 1024;
+  for (uint32_t i = 0; ok && i < header.ncontainers; i++) {
+    uint32_t length = 0;
+    ok = fread(&length, sizeof(length), 1, m_file) == 1 && length < 4096;
+    std::string name(length, ' ');
+    ok = ok && fread(&name[0], 1, length, m_file) == length;
+    m_containers.push_back(name);
+  }
+  if (!ok) {
+    std::cout << "EventSnapshotFile::OpenRead() " << filename
+              << " is not a snapshot file of version " << version
+              << std::endl;
+    Close();
+  }
+  return ok;
+}
+
+//____________________________________________________________________________..
+void EventSnapshotFile::Close() {
+  if (m_file)
+    fclose(m_file);
+  m_file = nullptr;
+  m_writing = false;
+  m_containers.clear();
+  m_nevents = 0;
+}
+
+//____________________________________________________________________________..
+bool EventSnapshotFile::Write(const EventSnapshot &snapshot) {
+  EventHeader header;
+  header.event = snapshot.event;
+  header.npart = snapshot.npart;
+  header.nprimaries = snapshot.primaries.size();
+  header.nhits = snapshot.hits.size();
+  fwrite(&header, sizeof(header), 1, m_file);
+  fwrite(snapshot.primaries.data(), sizeof(EventSnapshot::Primary),
+         snapshot.primaries.size(), m_file);
+  fwrite(snapshot.hits.data(), sizeof(EventSnapshot::Hit),
+         snapshot.hits.size(), m_file);
+  if (ferror(m_file)) {
+    std::cout << "EventSnapshotFile::Write() cannot write " << m_filename
+              << std::endl;
+    return false;
+  }
+  m_nevents++;
+  return true;
+}
+
+//____________________________________________________________________________..
+bool EventSnapshotFile::Read(EventSnapshot &snapshot) {
+  EventHeader header;
+  if (fread(&header, sizeof(header), 1, m_file) != 1)
+    return false;
+  if (header.nprimaries > maxentries || header.nhits > maxentries) {
+    std::cout << "EventSnapshotFile::Read() damaged record in " << m_filename
+              << std::endl;
+    return false;
+  }
+  snapshot.event = header.event;
+  snapshot.npart = header.npart;
+  snapshot.primaries.resize(header.nprimaries);
+  snapshot.hits.resize(header.nhits);
+  if (fread(snapshot.primaries.data(), sizeof(EventSnapshot::Primary),
+            header.nprimaries, m_file) != header.nprimaries ||
+      fread(snapshot.hits.data(), sizeof(EventSnapshot::Hit), header.nhits,
+            m_file) != header.nhits) {
+    std::cout << "EventSnapshotFile::Read() truncated record in "
+              << m_filename << std::endl;
+    return false;
+  }
+  m_nevents++;
+  return true;
+}
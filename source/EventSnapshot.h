@@ -0,0 +1,87 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef EVENTSNAPSHOT_H
+#define EVENTSNAPSHOT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Inputs of the reweighting of one event, enough to replay it without
+// Fun4All: the Npart, the primaries referenced by the hits and every hit
+// with the track id of its primary shower.
+struct EventSnapshot
+{
+    // track id of hits without a primary shower
+    static const int noshower = -2147483647 - 1;
+
+    struct Primary
+    {
+        int32_t trkid;
+        int32_t pid;
+        double px;
+        double py;
+        double pz;
+        double e;
+    };
+
+    struct Hit
+    {
+        // index into EventSnapshotFile::GetContainers()
+        int32_t container;
+        int32_t showerid;
+        // parent particle of the primary shower, noshower if there is none;
+        // track ids without a primary were not found in the truth container
+        int32_t trkid;
+        float edep;
+        float lightyield;
+    };
+
+    int event = 0;
+    int npart = 0;
+    std::vector<Primary> primaries;
+    std::vector<Hit> hits;
+
+    void clear()
+    {
+        primaries.clear();
+        hits.clear();
+    }
+};
+
+// Flat file of event snapshots in host byte order: a header with magic,
+// version and hit container names, then per event a fixed size record
+// header followed by the primary and hit arrays as they are in memory.
+class EventSnapshotFile
+{
+public:
+    static const uint32_t version = 1;
+
+    EventSnapshotFile() = default;
+    ~EventSnapshotFile();
+
+    EventSnapshotFile(const EventSnapshotFile &) = delete;
+    EventSnapshotFile &operator=(const EventSnapshotFile &) = delete;
+
+    bool OpenWrite(const std::string &filename, const std::vector<std::string> &containers);
+    bool OpenRead(const std::string &filename);
+    void Close();
+
+    bool IsWriting() const { return m_file && m_writing; }
+    const std::vector<std::string> &GetContainers() const { return m_containers; }
+    unsigned long GetNEvents() const { return m_nevents; }
+
+    bool Write(const EventSnapshot &snapshot);
+    // false at the end of the file or for a damaged record
+    bool Read(EventSnapshot &snapshot);
+
+private:
+    std::string m_filename;
+    FILE *m_file = nullptr;
+    bool m_writing = false;
+    std::vector<std::string> m_containers;
+    unsigned long m_nevents = 0;
+};
+
+#endif // EVENTSNAPSHOT_H
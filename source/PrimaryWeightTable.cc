@@ -0,0 +1,27 @@
+#include "PrimaryWeightTable.h"
+
+#include "ShowerIndex.h"
+
+const std::string PrimaryWeightTable::defaultnode = "EnergyCorrectionWeights";
+
+//____________________________________________________________________________..
+void PrimaryWeightTable::Reset(const ShowerIndex *index, unsigned int event,
+                               int npart, bool hitsreweighted) {
+  m_index = index;
+  m_event = event;
+  m_npart = npart;
+  m_hitsreweighted = hitsreweighted;
+  m_weights.assign(index ? index->GetNPrimaries() : 0, 1);
+}
+
+//____________________________________________________________________________..
+float PrimaryWeightTable::GetShowerWeight(int showerid) const {
+  int iprimary = m_index ? m_index->Find(showerid) : -1;
+  return iprimary < 0 ? 1 : m_weights[iprimary];
+}
+
+//____________________________________________________________________________..
+float PrimaryWeightTable::GetTrackWeight(int trkid) const {
+  int iprimary = m_index ? m_index->FindTrack(trkid) : -1;
+  return iprimary < 0 ? 1 : m_weights[iprimary];
+}
@@ -0,0 +1,49 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef PRIMARYWEIGHTTABLE_H
+#define PRIMARYWEIGHTTABLE_H
+
+#include <string>
+#include <vector>
+
+class ShowerIndex;
+
+// Per-event weight of every primary, published by EnergyCorrection as a
+// PHDataNode (SetWeightTableNode()) so that cell and tower building can
+// weight each hit or shower contribution while accumulating instead of
+// EnergyCorrection rewriting all hits first. Lookups are by the shower id
+// of a hit or of a cell/tower shower contribution, or by track id; anything
+// that is not a reweighted primary has weight 1. The table refers to the
+// shower index of the module that fills it and is valid for the event it
+// was filled in.
+class PrimaryWeightTable
+{
+public:
+    static const std::string defaultnode;
+
+    PrimaryWeightTable() = default;
+    ~PrimaryWeightTable() = default;
+
+    // all weights 1, keeps the capacity
+    void Reset(const ShowerIndex *index, unsigned int event, int npart, bool hitsreweighted);
+    void SetWeight(int iprimary, float weight) { m_weights[iprimary] = weight; }
+
+    unsigned int GetEvent() const { return m_event; }
+    int GetNpart() const { return m_npart; }
+    // true if the hits carry the weights already, applying them again
+    // would count them twice
+    bool GetHitsReweighted() const { return m_hitsreweighted; }
+
+    float GetShowerWeight(int showerid) const;
+    float GetTrackWeight(int trkid) const;
+
+private:
+    const ShowerIndex *m_index = nullptr;
+    unsigned int m_event = 0;
+    int m_npart = -1;
+    bool m_hitsreweighted = false;
+    // ShowerIndex primary numbering
+    std::vector<float> m_weights;
+};
+
+#endif // PRIMARYWEIGHTTABLE_H
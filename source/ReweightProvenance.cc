@@ -0,0 +1,134 @@
+#include "ReweightProvenance.h"
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <iostream>
+
+//____________________________________________________________________________..
+ReweightProvenance::~ReweightProvenance() {
+  Close();
+}
+
+//____________________________________________________________________________..
+bool ReweightProvenance::OpenWrite(const std::string &filename) {
+  Close();
+  m_file = TFile::Open(filename.c_str(), "RECREATE");
+  if (!m_file || m_file->IsZombie()) {
+    std::cout << "ReweightProvenance::OpenWrite() cannot create " << filename
+              << std::endl;
+    delete m_file;
+    m_file = nullptr;
+    return false;
+  }
+  m_writing = true;
+  m_tree = new TTree("provenance", "EnergyCorrection applied weights");
+  m_tree->Branch("event", &m_event, "event/I");
+  m_tree->Branch("npart", &m_npart, "npart/I");
+  m_tree->Branch("version", &m_version, "version/l");
+  m_tree->Branch("trkid", &m_trkid);
+  m_tree->Branch("pid", &m_pid);
+  m_tree->Branch("px", &m_px);
+  m_tree->Branch("py", &m_py);
+  m_tree->Branch("pz", &m_pz);
+  m_tree->Branch("e", &m_e);
+  m_tree->Branch("weight", &m_weight);
+  return true;
+}
+
+//____________________________________________________________________________..
+bool ReweightProvenance::OpenRead(const std::string &filename) {
+  Close();
+  m_file = TFile::Open(filename.c_str(), "READ");
+  if (!m_file || m_file->IsZombie()) {
+    std::cout << "ReweightProvenance::OpenRead() cannot open " << filename
+              << std::endl;
+    delete m_file;
+    m_file = nullptr;
+    return false;
+  }
+  m_tree = (TTree *) m_file->Get("provenance");
+  if (!m_tree) {
+    std::cout << "ReweightProvenance::OpenRead() no provenance tree in "
+              << filename << std::endl;
+    Close();
+    return false;
+  }
+  m_trkidptr = &m_trkid;
+  m_pidptr = &m_pid;
+  m_pxptr = &m_px;
+  m_pyptr = &m_py;
+  m_pzptr = &m_pz;
+  m_eptr = &m_e;
+  m_weightptr = &m_weight;
+  m_tree->SetBranchAddress("event", &m_event);
+  m_tree->SetBranchAddress("npart", &m_npart);
+  m_tree->SetBranchAddress("version", &m_version);
+  m_tree->SetBranchAddress("trkid", &m_trkidptr);
+  m_tree->SetBranchAddress("pid", &m_pidptr);
+  m_tree->SetBranchAddress("px", &m_pxptr);
+  m_tree->SetBranchAddress("py", &m_pyptr);
+  m_tree->SetBranchAddress("pz", &m_pzptr);
+  m_tree->SetBranchAddress("e", &m_eptr);
+  m_tree->SetBranchAddress("weight", &m_weightptr);
+  return true;
+}
+
+//____________________________________________________________________________..
+void ReweightProvenance::Close() {
+  if (!m_file)
+    return;
+  if (m_writing) {
+    m_file->cd();
+    m_tree->Write();
+  }
+  m_file->Close();
+  delete m_file;
+  m_file = nullptr;
+  m_tree = nullptr;
+  m_writing = false;
+}
+
+//____________________________________________________________________________..
+void ReweightProvenance::BeginEvent() {
+  m_trkid.clear();
+  m_pid.clear();
+  m_px.clear();
+  m_py.clear();
+  m_pz.clear();
+  m_e.clear();
+  m_weight.clear();
+}
+
+//____________________________________________________________________________..
+void ReweightProvenance::Add(int trkid, int pid, double px, double py,
+                             double pz, double e, float weight) {
+  m_trkid.push_back(trkid);
+  m_pid.push_back(pid);
+  m_px.push_back(px);
+  m_py.push_back(py);
+  m_pz.push_back(pz);
+  m_e.push_back(e);
+  m_weight.push_back(weight);
+}
+
+//____________________________________________________________________________..
+void ReweightProvenance::Fill(int event, int npart, uint64_t version) {
+  m_event = event;
+  m_npart = npart;
+  m_version = version;
+  m_tree->Fill();
+}
+
+//____________________________________________________________________________..
+long long ReweightProvenance::GetEntries() const {
+  return m_tree ? m_tree->GetEntries() : 0;
+}
+
+//____________________________________________________________________________..
+bool ReweightProvenance::Read(long long entry) {
+  if (!m_tree || entry < 0 || entry >= m_tree->GetEntries())
+    return false;
+  m_tree->GetEntry(entry);
+  return true;
+}
@@ -0,0 +1,81 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef REWEIGHTPROVENANCE_H
+#define REWEIGHTPROVENANCE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class TFile;
+class TTree;
+
+// What EnergyCorrection applied to the hits of each event, one tree entry per
+// event in processing order: the version of the correction, the Npart
+// used and the track id, pid, kinematics and applied weight of every primary
+// with hits. A later job can rescale the corrected hits to other tables with
+// the new/old weight ratio from these records alone, see
+// EnergyCorrection::SetDeltaProvenance().
+class ReweightProvenance
+{
+public:
+    ReweightProvenance() = default;
+    ~ReweightProvenance();
+
+    ReweightProvenance(const ReweightProvenance &) = delete;
+    ReweightProvenance &operator=(const ReweightProvenance &) = delete;
+
+    bool OpenWrite(const std::string &filename);
+    bool OpenRead(const std::string &filename);
+    void Close();
+
+    bool IsWriting() const { return m_writing; }
+    bool IsOpen() const { return m_file != nullptr; }
+
+    // writing
+    void BeginEvent();
+    void Add(int trkid, int pid, double px, double py, double pz, double e, float weight);
+    void Fill(int event, int npart, uint64_t version);
+
+    // reading, false past the last entry
+    long long GetEntries() const;
+    bool Read(long long entry);
+
+    int GetEvent() const { return m_event; }
+    int GetNpart() const { return m_npart; }
+    uint64_t GetVersion() const { return m_version; }
+    int GetNPrimaries() const { return m_trkidptr->size(); }
+    int GetTrackId(int i) const { return (*m_trkidptr)[i]; }
+    int GetPid(int i) const { return (*m_pidptr)[i]; }
+    double GetPx(int i) const { return (*m_pxptr)[i]; }
+    double GetPy(int i) const { return (*m_pyptr)[i]; }
+    double GetPz(int i) const { return (*m_pzptr)[i]; }
+    double GetE(int i) const { return (*m_eptr)[i]; }
+    float GetWeight(int i) const { return (*m_weightptr)[i]; }
+
+private:
+    TFile *m_file = nullptr;
+    TTree *m_tree = nullptr;
+    bool m_writing = false;
+
+    int m_event = 0;
+    int m_npart = -1;
+    unsigned long long m_version = 0;
+    std::vector<int> m_trkid;
+    std::vector<int> m_pid;
+    std::vector<double> m_px;
+    std::vector<double> m_py;
+    std::vector<double> m_pz;
+    std::vector<double> m_e;
+    std::vector<float> m_weight;
+    // branch addresses of the reader
+    std::vector<int> *m_trkidptr = &m_trkid;
+    std::vector<int> *m_pidptr = &m_pid;
+    std::vector<double> *m_pxptr = &m_px;
+    std::vector<double> *m_pyptr = &m_py;
+    std::vector<double> *m_pzptr = &m_pz;
+    std::vector<double> *m_eptr = &m_e;
+    std::vector<float> *m_weightptr = &m_weight;
+};
+
+#endif // REWEIGHTPROVENANCE_H
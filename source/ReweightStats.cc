@@ -0,0 +1,164 @@
+#include "ReweightStats.h"
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <iomanip>
+
+//____________________________________________________________________________..
+ReweightStats::~ReweightStats() {
+  CloseDump();
+}
+
+//____________________________________________________________________________..
+void ReweightStats::SetSpecies(const std::vector<std::string> &names) {
+  m_speciesnames = names;
+  m_eventspecies.assign(names.size() + 1, 0);
+  m_totalspecies.assign(names.size() + 1, 0);
+}
+
+//____________________________________________________________________________..
+bool ReweightStats::OpenDump(const std::string &filename) {
+  CloseDump();
+  const std::string ext = ".root";
+  if (filename.size() > ext.size() &&
+      filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0) {
+    m_dumpfile = new TFile(filename.c_str(), "RECREATE");
+    if (m_dumpfile->IsZombie()) {
+      delete m_dumpfile;
+      m_dumpfile = nullptr;
+      return false;
+    }
+    // fixed size arrays, the branch addresses stay valid for the whole job
+    m_dumpnspecies = m_eventspecies.size();
+    m_dumptree = new TTree("reweightstats", "EnergyCorrection per-event counters");
+    m_dumptree->Branch("event", &m_eventid, "event/I");
+    m_dumptree->Branch("npart", &m_npart, "npart/I");
+    m_dumptree->Branch("counters", m_event,
+                       Form("counters[%d]/i", (int) ncounters));
+    m_dumptree->Branch("nspecies", &m_dumpnspecies, "nspecies/I");
+    m_dumptree->Branch("species", m_eventspecies.data(), "species[nspecies]/i");
+    m_dumptree->Branch("stagens", m_eventns, Form("stagens[%d]/D", (int) nstages));
+    return true;
+  }
+  m_dumpjson.open(filename);
+  return m_dumpjson.good();
+}
+
+//____________________________________________________________________________..
+void ReweightStats::CloseDump() {
+  if (m_dumpfile) {
+    m_dumpfile->cd();
+    m_dumptree->Write();
+    m_dumpfile->Close();
+    delete m_dumpfile;
+    m_dumpfile = nullptr;
+    m_dumptree = nullptr;
+  }
+  if (m_dumpjson.is_open())
+    m_dumpjson.close();
+}
+
+//____________________________________________________________________________..
+void ReweightStats::BeginEvent() {
+  for (int i = 0; i < ncounters; i++)
+    m_event[i] = 0;
+  for (unsigned int &count : m_eventspecies)
+    count = 0;
+  for (int i = 0; i < nstages; i++)
+    m_eventns[i] = 0;
+}
+
+//____________________________________________________________________________..
+void ReweightStats::EndEvent(int event, int npart) {
+  m_eventid = event;
+  m_npart = npart;
+  m_nevents++;
+  for (int i = 0; i < ncounters; i++)
+    m_total[i] += m_event[i];
+  for (unsigned int i = 0; i < m_eventspecies.size(); i++)
+    m_totalspecies[i] += m_eventspecies[i];
+  for (int i = 0; i < nstages; i++)
+    m_totalns[i] += m_eventns[i];
+  if (m_dumptree)
+    m_dumptree->Fill();
+  if (m_dumpjson.is_open())
+    writejson();
+}
+
+//____________________________________________________________________________..
+void ReweightStats::writejson() {
+  m_dumpjson << "{\"event\": " << m_eventid << ", \"npart\": " << m_npart;
+  for (int i = 0; i < ncounters; i++)
+    m_dumpjson << ", \"" << GetCounterName(i) << "\": " << m_event[i];
+  m_dumpjson << ", \"species\": {";
+  for (unsigned int i = 0; i < m_eventspecies.size(); i++) {
+    m_dumpjson << (i ? ", " : "") << "\""
+               << (i ? m_speciesnames[i - 1] : "uncorrected")
+               << "\": " << m_eventspecies[i];
+  }
+  m_dumpjson << "}";
+  if (m_timers) {
+    m_dumpjson << ", \"ns\": {";
+    for (int i = 0; i < nstages; i++)
+      m_dumpjson << (i ? ", " : "") << "\"" << GetStageName(i)
+                 << "\": " << m_eventns[i];
+    m_dumpjson << "}";
+  }
+  m_dumpjson << "}" << std::endl;
+}
+
+//____________________________________________________________________________..
+const char *ReweightStats::GetStageName(int stage) {
+  static const char *names[nstages] = {"node_lookup", "truth_lookup",
+                                       "kinematics", "weight", "hit_update"};
+  return (stage >= 0 && stage < nstages) ? names[stage] : "none";
+}
+
+//____________________________________________________________________________..
+const char *ReweightStats::GetCounterName(int counter) {
+  static const char *names[ncounters] = {
+      "hits",        "hits_no_shower",    "hits_no_particle",
+      "hits_eta_rejected", "hits_passthrough", "primaries",
+      "primaries_eta_rejected"};
+  return (counter >= 0 && counter < ncounters) ? names[counter] : "none";
+}
+
+//____________________________________________________________________________..
+void ReweightStats::Print(std::ostream &os) const {
+  os << "ReweightStats: " << m_nevents << " events" << std::endl;
+  for (int i = 0; i < ncounters; i++) {
+    os << "  " << std::left << std::setw(24) << GetCounterName(i) << std::right
+       << std::setw(14) << m_total[i];
+    if (i != kHits && i < kPrimaries && m_total[kHits] > 0)
+      os << "  (" << 100. * m_total[i] / m_total[kHits] << "% of hits)";
+    os << std::endl;
+  }
+  if (m_total[kPrimaries] > 0)
+    os << "  hits per primary weight " << (double) m_total[kHits] / m_total[kPrimaries]
+       << std::endl;
+  os << "  primaries per species:";
+  for (unsigned int i = 0; i < m_totalspecies.size(); i++) {
+    if (m_totalspecies[i] == 0)
+      continue;
+    os << " " << (i ? m_speciesnames[i - 1] : "uncorrected") << " "
+       << m_totalspecies[i];
+  }
+  os << std::endl;
+  if (!m_timers)
+    return;
+  double sum = 0;
+  for (int i = 0; i < nstages; i++)
+    sum += m_totalns[i];
+  for (int i = 0; i < nstages; i++) {
+    os << "  " << std::left << std::setw(24) << GetStageName(i) << std::right
+       << std::setw(14) << m_totalns[i] * 1e-6 << " ms";
+    if (m_nevents > 0)
+      os << std::setw(12) << m_totalns[i] * 1e-3 / m_nevents << " us/event";
+    if (m_total[kHits] > 0)
+      os << std::setw(10) << m_totalns[i] / m_total[kHits] << " ns/hit";
+    if (sum > 0)
+      os << "  " << 100. * m_totalns[i] / sum << "%";
+    os << std::endl;
+  }
+}
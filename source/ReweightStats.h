@@ -0,0 +1,112 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef REWEIGHTSTATS_H
+#define REWEIGHTSTATS_H
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class TFile;
+class TTree;
+
+// Counters and stage timers of the hit reweighting. The counters are plain
+// integer increments and always on; the timers read the clock at every stage
+// change, per hit on the scalar path, so they are enabled separately.
+// Totals are printed at the end, each event can also be written to a TTree
+// (file name ending in .root) or as one JSON object per line.
+class ReweightStats
+{
+public:
+    enum Stage
+    {
+        kNodeLookup = 0,
+        kTruthLookup,
+        kKinematics,
+        kWeight,
+        kHitUpdate,
+        nstages
+    };
+
+    enum Counter
+    {
+        kHits = 0,
+        kHitsNoShower,
+        kHitsNoParticle,
+        kHitsEtaRejected,
+        // accepted hits with a weight of exactly 1, left untouched
+        kHitsPassthrough,
+        kPrimaries,
+        kPrimariesEtaRejected,
+        ncounters
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    ReweightStats() = default;
+    ~ReweightStats();
+
+    void SetTimers(bool timers) { m_timers = timers; }
+    bool GetTimers() const { return m_timers; }
+
+    // species names for the per-species counts, index -1 is "uncorrected"
+    void SetSpecies(const std::vector<std::string> &names);
+
+    // per-event output, false if the file cannot be opened
+    bool OpenDump(const std::string &filename);
+    void CloseDump();
+
+    void BeginEvent();
+    void EndEvent(int event, int npart);
+
+    void Count(Counter counter, unsigned int n = 1) { m_event[counter] += n; }
+    void CountSpecies(int species) { m_eventspecies[species + 1]++; }
+
+    // start of a timed section, a default time point if the timers are off
+    Clock::time_point Start() const { return m_timers ? Clock::now() : Clock::time_point(); }
+    // charge the time since start to a stage and restart from now
+    void Lap(Stage stage, Clock::time_point &start)
+    {
+        if (!m_timers)
+            return;
+        Clock::time_point now = Clock::now();
+        m_eventns[stage] += std::chrono::duration<double, std::nano>(now - start).count();
+        start = now;
+    }
+
+    unsigned long GetNEvents() const { return m_nevents; }
+    unsigned long GetEventCount(Counter counter) const { return m_event[counter]; }
+    unsigned long GetTotal(Counter counter) const { return m_total[counter]; }
+
+    static const char *GetStageName(int stage);
+    static const char *GetCounterName(int counter);
+
+    void Print(std::ostream &os = std::cout) const;
+
+private:
+    void writejson();
+
+    bool m_timers = false;
+
+    std::vector<std::string> m_speciesnames;
+
+    int m_eventid = 0;
+    int m_npart = 0;
+    unsigned long m_nevents = 0;
+
+    unsigned int m_event[ncounters] = {0};
+    unsigned long m_total[ncounters] = {0};
+    std::vector<unsigned int> m_eventspecies;
+    std::vector<unsigned long> m_totalspecies;
+    double m_eventns[nstages] = {0};
+    double m_totalns[nstages] = {0};
+
+    TFile *m_dumpfile = nullptr;
+    TTree *m_dumptree = nullptr;
+    int m_dumpnspecies = 0;
+    std::ofstream m_dumpjson;
+};
+
+#endif // REWEIGHTSTATS_H
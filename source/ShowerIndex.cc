@@ -0,0 +1,134 @@
+#include "ShowerIndex.h"
+
+#include "SpeciesRegistry.h"
+
+#include <g4main/PHG4Particle.h>
+#include <g4main/PHG4Shower.h>
+#include <g4main/PHG4TruthInfoContainer.h>
+
+#include <algorithm>
+
+namespace {
+ShowerIndex::Primary makeprimary(int trkid, PHG4Particle *part,
+                                 const SpeciesRegistry &registry) {
+  ShowerIndex::Primary primary;
+  primary.trkid = trkid;
+  primary.pid = part->get_pid();
+  primary.species = registry.Index(primary.pid);
+  primary.px = part->get_px();
+  primary.py = part->get_py();
+  primary.pz = part->get_pz();
+  primary.e = part->get_e();
+  return primary;
+}
+} // namespace
+
+//____________________________________________________________________________..
+void ShowerIndex::Build(PHG4TruthInfoContainer *truthinfo,
+                        const SpeciesRegistry &registry) {
+  m_primaries.clear();
+  m_missingparents.clear();
+  m_othertracks.clear();
+
+  // the primary particles, in track id order
+  m_entries.clear();
+  PHG4TruthInfoContainer::Range particles = truthinfo->GetPrimaryParticleRange();
+  for (PHG4TruthInfoContainer::Iterator iter = particles.first;
+       iter != particles.second; ++iter) {
+    m_entries.push_back(std::make_pair(iter->first, (int) m_primaries.size()));
+    m_primaries.push_back(makeprimary(iter->first, iter->second, registry));
+  }
+  m_tracks.Build(m_entries);
+  indexshowers(truthinfo, &registry);
+}
+
+//____________________________________________________________________________..
+void ShowerIndex::Build(PHG4TruthInfoContainer *truthinfo,
+                        const std::vector<Primary> &primaries) {
+  m_primaries = primaries;
+  m_missingparents.clear();
+  m_othertracks.clear();
+  m_entries.clear();
+  for (int i = 0; i < (int) m_primaries.size(); i++)
+    m_entries.push_back(std::make_pair(m_primaries[i].trkid, i));
+  m_tracks.Build(m_entries);
+  indexshowers(truthinfo, nullptr);
+}
+
+//____________________________________________________________________________..
+void ShowerIndex::indexshowers(PHG4TruthInfoContainer *truthinfo,
+                               const SpeciesRegistry *registry) {
+  // the primary showers with their parent track id, parents that are not
+  // primary particles are collected
+  m_entries.clear();
+  PHG4TruthInfoContainer::ShowerRange showers =
+      truthinfo->GetPrimaryShowerRange();
+  for (PHG4TruthInfoContainer::ShowerIterator iter = showers.first;
+       iter != showers.second; ++iter) {
+    int trkid = iter->second->get_parent_particle_id();
+    m_entries.push_back(std::make_pair(iter->first, trkid));
+    if (m_tracks.Find(trkid) < 0)
+      m_othertracks.push_back(trkid);
+  }
+  m_nshowers = m_entries.size();
+
+  // every other parent is looked up once and becomes a track id too
+  if (!m_othertracks.empty()) {
+    std::sort(m_othertracks.begin(), m_othertracks.end());
+    m_othertracks.erase(
+        std::unique(m_othertracks.begin(), m_othertracks.end()),
+        m_othertracks.end());
+    const int nprimaries = m_primaries.size();
+    for (int trkid : m_othertracks) {
+      PHG4Particle *part = registry ? truthinfo->GetParticle(trkid) : nullptr;
+      if (part)
+        m_primaries.push_back(makeprimary(trkid, part, *registry));
+      else
+        m_missingparents.push_back(trkid);
+    }
+    if ((int) m_primaries.size() > nprimaries) {
+      m_trackentries.clear();
+      for (int i = 0; i < (int) m_primaries.size(); i++)
+        m_trackentries.push_back(std::make_pair(m_primaries[i].trkid, i));
+      m_tracks.Build(m_trackentries);
+    }
+  }
+
+  // parent track id -> primary
+  for (std::pair<int, int> &entry : m_entries) {
+    int iprimary = m_tracks.Find(entry.second);
+    entry.second = iprimary >= 0 ? iprimary : noparticle;
+  }
+  m_showers.Build(m_entries);
+}
+
+//____________________________________________________________________________..
+void ShowerIndex::IdTable::Build(std::vector<std::pair<int, int>> &entries) {
+  m_dense.clear();
+  m_sparse.clear();
+  m_isdense = true;
+  if (entries.empty())
+    return;
+  std::sort(entries.begin(), entries.end());
+  // the ids of an event are nearly contiguous, a few holes are cheaper than
+  // a search
+  long long span = (long long) entries.back().first - entries.front().first + 1;
+  if (span > 4 * (long long) entries.size() + 1024) {
+    m_isdense = false;
+    m_sparse = entries;
+    return;
+  }
+  m_first = entries.front().first;
+  m_dense.assign(span, m_notfound);
+  for (const std::pair<int, int> &entry : entries)
+    m_dense[entry.first - m_first] = entry.second;
+}
+
+//____________________________________________________________________________..
+int ShowerIndex::IdTable::findsparse(int id) const {
+  std::vector<std::pair<int, int>>::const_iterator iter = std::lower_bound(
+      m_sparse.begin(), m_sparse.end(), std::make_pair(id, -2147483647 - 1));
+  if (iter == m_sparse.end() || iter->first != id)
+    return m_notfound;
+  return iter->second;
+}
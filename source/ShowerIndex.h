@@ -0,0 +1,109 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef SHOWERINDEX_H
+#define SHOWERINDEX_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+class PHG4TruthInfoContainer;
+class SpeciesRegistry;
+
+// Flat per-event index of the truth container: one walk over the primary
+// particles and primary showers gives a contiguous table of the primaries
+// (kinematics and species) and a shower id -> primary table, so a hit is
+// resolved with one array access instead of two map lookups. Showers whose
+// parent particle is missing are found during the walk, not in the hit loop.
+// The tables keep their capacity from one event to the next.
+class ShowerIndex
+{
+public:
+    // Find() of hits that cannot be reweighted
+    static const int noshower = -1;
+    static const int noparticle = -2;
+
+    struct Primary
+    {
+        int trkid = 0;
+        int pid = 0;
+        // SpeciesRegistry index, -1 for pids without a species
+        int species = -1;
+        double px = 0;
+        double py = 0;
+        double pz = 0;
+        double e = 0;
+    };
+
+    ShowerIndex() = default;
+
+    // registry has to be compiled
+    void Build(PHG4TruthInfoContainer *truthinfo, const SpeciesRegistry &registry);
+    // with primaries known from elsewhere, e.g. a provenance record, only the
+    // showers are read from truthinfo; parents not among them are missing
+    void Build(PHG4TruthInfoContainer *truthinfo, const std::vector<Primary> &primaries);
+
+    // primary of the shower of a hit, noshower if showerid is not a primary
+    // shower, noparticle if the parent particle of the shower is missing
+    int Find(int showerid) const { return m_showers.Find(showerid); }
+    // primary with track id trkid, -1 if there is none
+    int FindTrack(int trkid) const { return m_tracks.Find(trkid); }
+
+    int GetNPrimaries() const { return m_primaries.size(); }
+    const Primary &GetPrimary(int i) const { return m_primaries[i]; }
+    int GetNShowers() const { return m_nshowers; }
+    // parent track ids of primary showers missing from the truth container,
+    // each once
+    const std::vector<int> &GetMissingParents() const { return m_missingparents; }
+
+private:
+    // shower table on top of the primaries, registry null if parents outside
+    // the primaries are not looked up
+    void indexshowers(PHG4TruthInfoContainer *truthinfo, const SpeciesRegistry *registry);
+
+    // id -> value, a dense array over the id range unless the ids are too
+    // sparse for it, then a sorted list
+    class IdTable
+    {
+    public:
+        explicit IdTable(int notfound)
+          : m_notfound(notfound)
+        {
+        }
+
+        // entries are sorted in place
+        void Build(std::vector<std::pair<int, int>> &entries);
+
+        int Find(int id) const
+        {
+            if (m_isdense)
+            {
+                // ids below m_first wrap around to large offsets
+                std::size_t i = (unsigned int) id - (unsigned int) m_first;
+                return i < m_dense.size() ? m_dense[i] : m_notfound;
+            }
+            return findsparse(id);
+        }
+
+    private:
+        int findsparse(int id) const;
+
+        int m_notfound;
+        bool m_isdense = true;
+        int m_first = 0;
+        std::vector<int> m_dense;
+        std::vector<std::pair<int, int>> m_sparse;
+    };
+
+    std::vector<Primary> m_primaries;
+    IdTable m_tracks {-1};
+    IdTable m_showers {noshower};
+    int m_nshowers = 0;
+    std::vector<int> m_missingparents;
+    // scratch of Build()
+    std::vector<std::pair<int, int>> m_entries;
+    std::vector<std::pair<int, int>> m_trackentries;
+    std::vector<int> m_othertracks;
+};
+
+#endif // SHOWERINDEX_H
@@ -0,0 +1,196 @@
+#include "SpeciesRegistry.h"
+
+#include <algorithm>
+#include <cassert>
+
+//____________________________________________________________________________..
+void SpeciesRegistry::SetDefaults() {
+  Clear();
+
+  AddSpecies("pi+", kPip, kRapPip);
+  AddSpecies("pi-", kPimi, kRapPim);
+  // pi0 uses the average of pi+ and pi-
+  AddSpecies("pi0", kPip, kRapPip, kPimi, kRapPim);
+  AddSpecies("K+", kKp, kRapKp);
+  AddSpecies("K-", kKmi, kRapKm);
+  // K0L, K0S and K0 use the average of K+ and K-
+  AddSpecies("K0", kKp, kRapKp, kKmi, kRapKm);
+  AddSpecies("p", kP, kRapP, true);
+  // the antiproton |y| shape is normalised to the proton one at y = 0
+  Species pbar;
+  pbar.name = "pbar";
+  pbar.ncomponents = 1;
+  pbar.components[0].table = kPbar;
+  pbar.components[0].raptable = kRapPbar;
+  pbar.components[0].rapnorm = kRapP;
+  pbar.heavierbaryon = true;
+  AddSpecies(pbar);
+  // Lambda and Sigma, no rapidity dependence
+  AddSpecies("Lambda", kLambda);
+  AddSpecies("Lambdabar", kLambdabar);
+  // other baryons just use PHENIX and STAR data
+  AddSpecies("baryon", kP, -1, true);
+  AddSpecies("antibaryon", kPbar, -1, true);
+
+  MapRange(2001, 3999, "baryon");
+  MapRange(-3999, -2001, "antibaryon");
+  Map(211, "pi+");
+  Map(-211, "pi-");
+  Map(111, "pi0");
+  Map(321, "K+");
+  Map(-321, "K-");
+  Map(130, "K0");
+  Map(310, "K0");
+  Map(311, "K0");
+  Map(2212, "p");
+  Map(2112, "p");
+  Map(-2212, "pbar");
+  Map(-2112, "pbar");
+  for (int pid : {3122, 3222, 3212, 3112}) {
+    Map(pid, "Lambda");
+    Map(-pid, "Lambdabar");
+  }
+}
+
+//____________________________________________________________________________..
+void SpeciesRegistry::Clear() {
+  m_species.clear();
+  m_rules.clear();
+  m_lookup.clear();
+}
+
+//____________________________________________________________________________..
+int SpeciesRegistry::AddSpecies(const Species &species) {
+  assert(species.ncomponents > 0 && species.ncomponents <= maxcomponents);
+  for (int i = 0; i < species.ncomponents; i++) {
+    const Component &comp = species.components[i];
+    assert(comp.table >= 0 && comp.table < ntables);
+    assert(comp.raptable < nraptables);
+    assert(comp.rapnorm < nraptables);
+    (void) comp;
+  }
+  int index = FindSpecies(species.name);
+  if (index >= 0) {
+    m_species[index] = species;
+    return index;
+  }
+  // the dense lookup stores signed chars
+  assert(m_species.size() < 127);
+  m_species.push_back(species);
+  return m_species.size() - 1;
+}
+
+//____________________________________________________________________________..
+int SpeciesRegistry::AddSpecies(const std::string &name, int table,
+                                int raptable, bool heavierbaryon) {
+  Species species;
+  species.name = name;
+  species.ncomponents = 1;
+  species.components[0].table = table;
+  species.components[0].raptable = raptable;
+  species.components[0].rapnorm = raptable;
+  species.heavierbaryon = heavierbaryon;
+  return AddSpecies(species);
+}
+
+//____________________________________________________________________________..
+int SpeciesRegistry::AddSpecies(const std::string &name, int table1,
+                                int raptable1, int table2, int raptable2,
+                                bool heavierbaryon) {
+  Species species;
+  species.name = name;
+  species.ncomponents = 2;
+  species.components[0].table = table1;
+  species.components[0].fraction = 0.5;
+  species.components[0].raptable = raptable1;
+  species.components[0].rapnorm = raptable1;
+  species.components[1].table = table2;
+  species.components[1].fraction = 0.5;
+  species.components[1].raptable = raptable2;
+  species.components[1].rapnorm = raptable2;
+  species.heavierbaryon = heavierbaryon;
+  return AddSpecies(species);
+}
+
+//____________________________________________________________________________..
+void SpeciesRegistry::MapRange(int pidmin, int pidmax,
+                               const std::string &name) {
+  m_rules.push_back({pidmin, pidmax, name});
+}
+
+//____________________________________________________________________________..
+bool SpeciesRegistry::Build() {
+  m_lookup.assign(2 * maxpdg + 1, -1);
+  bool ok = true;
+  for (const Rule &rule : m_rules) {
+    int index = -1;
+    if (!rule.name.empty()) {
+      index = FindSpecies(rule.name);
+      if (index < 0) {
+        std::cout << "SpeciesRegistry::Build() unknown species " << rule.name
+                  << " for pid " << rule.pidmin << " - " << rule.pidmax
+                  << std::endl;
+        ok = false;
+        continue;
+      }
+    }
+    if (rule.pidmin < -maxpdg || rule.pidmax > maxpdg) {
+      std::cout << "SpeciesRegistry::Build() pid range " << rule.pidmin
+                << " - " << rule.pidmax << " exceeds +-" << maxpdg
+                << ", codes outside are not corrected" << std::endl;
+    }
+    for (int pid = std::max(rule.pidmin, -maxpdg);
+         pid <= std::min(rule.pidmax, (int) maxpdg); pid++) {
+      m_lookup[pid + maxpdg] = index;
+    }
+  }
+  return ok;
+}
+
+//____________________________________________________________________________..
+int SpeciesRegistry::FindSpecies(const std::string &name) const {
+  for (unsigned int i = 0; i < m_species.size(); i++) {
+    if (m_species[i].name == name)
+      return i;
+  }
+  return -1;
+}
+
+//____________________________________________________________________________..
+const char *SpeciesRegistry::GetTableName(int table) {
+  static const char *names[ntables] = {"pi+", "pi-", "K+", "K-",
+                                       "p", "pbar", "Lambda", "Lambdabar"};
+  return (table >= 0 && table < ntables) ? names[table] : "none";
+}
+
+//____________________________________________________________________________..
+void SpeciesRegistry::identify(std::ostream &os) const {
+  os << "SpeciesRegistry: " << m_species.size() << " species" << std::endl;
+  for (const Species &species : m_species) {
+    os << "  " << species.name << " =";
+    for (int i = 0; i < species.ncomponents; i++) {
+      const Component &comp = species.components[i];
+      os << (i ? " +" : "") << " " << comp.fraction << " x "
+         << GetTableName(comp.table);
+      if (comp.raptable >= 0)
+        os << " (y shape " << comp.raptable << "/" << comp.rapnorm << ")";
+    }
+    if (species.heavierbaryon)
+      os << " [heavier baryon]";
+    // print the mapped codes as ranges
+    os << ", pid:";
+    int index = FindSpecies(species.name);
+    for (int pid = -maxpdg; pid <= maxpdg; pid++) {
+      if (Index(pid) != index)
+        continue;
+      int last = pid;
+      while (last < maxpdg && Index(last + 1) == index)
+        last++;
+      os << " " << pid;
+      if (last > pid)
+        os << ".." << last;
+      pid = last;
+    }
+    os << std::endl;
+  }
+}
@@ -0,0 +1,122 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef SPECIESREGISTRY_H
+#define SPECIESREGISTRY_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Maps PDG codes to the correction species and describes how each species is
+// built from the correction tables, e.g. pi0 = average of pi+ and pi-.
+// Mapping rules are applied in the order they were given, later rules win,
+// and Build() compiles them into a dense pid -> species index table.
+class SpeciesRegistry
+{
+public:
+    // pt correction tables, each a set of centrality histograms
+    enum Table
+    {
+        kPip = 0,
+        kPimi,
+        kKp,
+        kKmi,
+        kP,
+        kPbar,
+        kLambda,
+        kLambdabar,
+        ntables
+    };
+
+    // |y| shape tables of the rapidity dependent correction
+    enum RapTable
+    {
+        kRapPip = 0,
+        kRapPim,
+        kRapKp,
+        kRapKm,
+        kRapP,
+        kRapPbar,
+        nraptables
+    };
+
+    // Npart averages of the centrality classes a table was measured in
+    enum CentClass
+    {
+        kCentDefault = 0,
+        kCentLambda,
+        ncentclasses
+    };
+
+    static const int maxcomponents = 2;
+    // largest |pid| that can be mapped, covers all light baryons
+    static const int maxpdg = 4000;
+
+    struct Component
+    {
+        int table = -1;
+        float fraction = 1;
+        // |y| shape normalised by rapnorm at y = 0, -1 if the table has no rapidity dependence
+        int raptable = -1;
+        int rapnorm = -1;
+    };
+
+    struct Species
+    {
+        std::string name;
+        int ncomponents = 0;
+        Component components[maxcomponents];
+        // switched off by SetReweightHeavierBaryons(false)
+        bool heavierbaryon = false;
+    };
+
+    SpeciesRegistry() { SetDefaults(); }
+    ~SpeciesRegistry() = default;
+
+    // the PHENIX/STAR based rules of the original correction
+    void SetDefaults();
+    void Clear();
+
+    // add a species or replace the one with the same name, returns its index
+    int AddSpecies(const Species &species);
+    // a species averaging up to two tables with equal fractions
+    int AddSpecies(const std::string &name, int table, int raptable = -1, bool heavierbaryon = false);
+    int AddSpecies(const std::string &name, int table1, int raptable1, int table2, int raptable2, bool heavierbaryon = false);
+
+    // an empty name removes the correction for these codes
+    void Map(int pid, const std::string &name) { MapRange(pid, pid, name); }
+    void MapRange(int pidmin, int pidmax, const std::string &name);
+
+    // compile the mapping rules, false if a rule names an unknown species
+    bool Build();
+
+    // species index of a PDG code, -1 if it is not corrected
+    int Index(int pid) const
+    {
+        unsigned int key = pid + maxpdg;
+        return key < m_lookup.size() ? m_lookup[key] : -1;
+    }
+
+    int FindSpecies(const std::string &name) const;
+    int GetNSpecies() const { return m_species.size(); }
+    const Species &GetSpecies(int index) const { return m_species[index]; }
+
+    static int GetCentClass(int table) { return (table == kLambda || table == kLambdabar) ? kCentLambda : kCentDefault; }
+    static const char *GetTableName(int table);
+
+    void identify(std::ostream &os = std::cout) const;
+
+private:
+    struct Rule
+    {
+        int pidmin;
+        int pidmax;
+        std::string name;
+    };
+
+    std::vector<Species> m_species;
+    std::vector<Rule> m_rules;
+    std::vector<signed char> m_lookup;
+};
+
+#endif // SPECIESREGISTRY_H
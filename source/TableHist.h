@@ -0,0 +1,94 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef TABLEHIST_H
+#define TABLEHIST_H
+
+#include <algorithm>
+
+// Read-only view of a 1D correction histogram, bins 1..nbins without under-
+// and overflow. The memory belongs to whoever filled the view, e.g. a mapped
+// table file. Bin centers, bin lookup and Interpolate() follow TH1/TAxis so
+// the weights do not change when the tables come from a ROOT file.
+class TableHist
+{
+public:
+    TableHist() = default;
+    // edges (nbins + 1) is null for fixed binning in [xmin, xmax]
+    TableHist(int nbins, double xmin, double xmax, const double *edges, const float *contents)
+        : m_nbins(nbins), m_xmin(xmin), m_xmax(xmax), m_edges(edges), m_contents(contents)
+    {
+    }
+
+    int GetNbinsX() const { return m_nbins; }
+    double GetXmin() const { return m_xmin; }
+    double GetXmax() const { return m_xmax; }
+    const double *GetEdges() const { return m_edges; }
+    const float *GetContents() const { return m_contents; }
+
+    double GetBinContent(int bin) const { return (bin < 1 || bin > m_nbins) ? 0 : m_contents[bin - 1]; }
+
+    double GetBinCenter(int bin) const
+    {
+        if (!m_edges)
+        {
+            double binwidth = (m_xmax - m_xmin) / double(m_nbins);
+            return m_xmin + (bin - 1) * binwidth + 0.5 * binwidth;
+        }
+        double binwidth = m_edges[bin] - m_edges[bin - 1];
+        return m_edges[bin - 1] + 0.5 * binwidth;
+    }
+
+    double GetBinWidth(int bin) const
+    {
+        if (!m_edges)
+            return (m_xmax - m_xmin) / double(m_nbins);
+        return m_edges[bin] - m_edges[bin - 1];
+    }
+
+    // TAxis::FindFixBin
+    int FindBin(double x) const
+    {
+        if (x < m_xmin)
+            return 0;
+        if (!(x < m_xmax))
+            return m_nbins + 1;
+        if (!m_edges)
+            return 1 + int(m_nbins * (x - m_xmin) / (m_xmax - m_xmin));
+        return std::upper_bound(m_edges, m_edges + m_nbins + 1, x) - m_edges;
+    }
+
+    // TH1::Interpolate, linear between bin centers and the edge bin content outside
+    double Interpolate(double x) const
+    {
+        if (x <= GetBinCenter(1))
+            return GetBinContent(1);
+        if (x >= GetBinCenter(m_nbins))
+            return GetBinContent(m_nbins);
+        int xbin = FindBin(x);
+        double x0, x1, y0, y1;
+        if (x <= GetBinCenter(xbin))
+        {
+            y0 = GetBinContent(xbin - 1);
+            x0 = GetBinCenter(xbin - 1);
+            y1 = GetBinContent(xbin);
+            x1 = GetBinCenter(xbin);
+        }
+        else
+        {
+            y0 = GetBinContent(xbin);
+            x0 = GetBinCenter(xbin);
+            y1 = GetBinContent(xbin + 1);
+            x1 = GetBinCenter(xbin + 1);
+        }
+        return y0 + (x - x0) * ((y1 - y0) / (x1 - x0));
+    }
+
+private:
+    int m_nbins = 0;
+    double m_xmin = 0;
+    double m_xmax = 0;
+    const double *m_edges = nullptr;
+    const float *m_contents = nullptr;
+};
+
+#endif // TABLEHIST_H
@@ -0,0 +1,39 @@
+#include "WeightGrid.h"
+
+#include <cassert>
+
+//____________________________________________________________________________..
+void WeightGrid::Build(int nrows, float ptmin, float ptmax, int nptnodes,
+                       const Sampler &sampler) {
+  assert(nrows > 0);
+  assert(nptnodes > 1);
+  assert(ptmax > ptmin);
+
+  m_nrows = nrows;
+  m_npt = nptnodes;
+  m_ptmin = ptmin;
+  m_ptmax = ptmax;
+
+  const double step = ((double) ptmax - ptmin) / (nptnodes - 1);
+  m_invstep = 1. / step;
+
+  m_table.assign((size_t) nrows * nptnodes, 0);
+  if (!sampler)
+    return;
+  float *node = m_table.data();
+  for (int row = 0; row < nrows; row++) {
+    for (int ipt = 0; ipt < nptnodes; ipt++) {
+      *node++ = sampler(row, ptmin + ipt * step);
+    }
+  }
+}
+
+//____________________________________________________________________________..
+void WeightGrid::Reset() {
+  m_nrows = 0;
+  m_npt = 0;
+  m_ptmin = 0;
+  m_ptmax = 0;
+  m_invstep = 0;
+  std::vector<float>().swap(m_table);
+}
@@ -0,0 +1,63 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef WEIGHTGRID_H
+#define WEIGHTGRID_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Flat table of correction curves sampled on one uniform pt axis. A lookup
+// is an O(1) index computation plus a linear interpolation between two
+// neighbouring nodes; the rows sit next to each other in memory.
+class WeightGrid
+{
+public:
+    typedef std::function<float(int row, float pt)> Sampler;
+
+    WeightGrid() = default;
+    ~WeightGrid() = default;
+
+    // sample every row at nptnodes equidistant points in [ptmin, ptmax],
+    // without a sampler the rows are zeroed to be filled through GetRow()
+    void Build(int nrows, float ptmin, float ptmax, int nptnodes, const Sampler &sampler = nullptr);
+
+    void Reset();
+
+    bool IsBuilt() const { return !m_table.empty(); }
+
+    int GetNRows() const { return m_nrows; }
+    int GetNPtNodes() const { return m_npt; }
+    float GetPtMin() const { return m_ptmin; }
+    float GetPtMax() const { return m_ptmax; }
+    float GetInvStep() const { return m_invstep; }
+    size_t GetMemorySize() const { return m_table.size() * sizeof(float); }
+
+    float *GetRow(int row) { return &m_table[(size_t) row * m_npt]; }
+    const float *GetRow(int row) const { return &m_table[(size_t) row * m_npt]; }
+
+    // outside [ptmin, ptmax] the first/last node is returned, like TH1::Interpolate
+    float Value(int row, float pt) const
+    {
+        const float *nodes = GetRow(row);
+        float x = (pt - m_ptmin) * m_invstep;
+        if (!(x > 0))
+            return nodes[0];
+        if (x >= m_npt - 1)
+            return nodes[m_npt - 1];
+        int i = (int) x;
+        float f = x - i;
+        return nodes[i] + f * (nodes[i + 1] - nodes[i]);
+    }
+
+private:
+    int m_nrows = 0;
+    int m_npt = 0;
+    float m_ptmin = 0;
+    float m_ptmax = 0;
+    float m_invstep = 0;
+
+    std::vector<float> m_table;
+};
+
+#endif // WEIGHTGRID_H
@@ -0,0 +1,304 @@
+#include "WeightKernel.h"
+
+#include "WeightGrid.h"
+
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WEIGHTKERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+// Cephes logf, accurate to about 1 ulp for the x >= 1 seen here; written out
+// so the scalar and AVX2 kernels do the same operations
+const float logsqrthf = 0.707106781186547524f;
+const float logp[9] = {7.0376836292E-2f, -1.1514610310E-1f, 1.1676998740E-1f,
+                       -1.2420140846E-1f, 1.4249322787E-1f, -1.6668057665E-1f,
+                       2.0000714765E-1f, -2.4999993993E-1f, 3.3333331174E-1f};
+const float logq1 = -2.12194440e-4f;
+const float logq2 = 0.693359375f;
+
+inline float kernellog(float x) {
+  uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  float e = (float) ((int) (bits >> 23) - 126);
+  bits = (bits & 0x807fffffu) | 0x3f000000u;
+  float m;
+  std::memcpy(&m, &bits, sizeof(m));
+  if (m < logsqrthf) {
+    e = e - 1.f;
+    m = m + m;
+  }
+  m = m - 1.f;
+  float z = m * m;
+  float y = logp[0];
+  for (int i = 1; i < 9; i++)
+    y = y * m + logp[i];
+  y = y * m;
+  y = y * z;
+  y = y + e * logq1;
+  y = y - 0.5f * z;
+  float r = m + y;
+  r = r + e * logq2;
+  return r;
+}
+
+// |y| from e and |pz|, FLT_MAX if the energy does not exceed |pz|
+inline float kernelabsy(float e, float pz) {
+  float apz = std::fabs(pz);
+  float ratio = (e + apz) / (e - apz);
+  if (!(ratio > 0.f && ratio <= FLT_MAX))
+    return FLT_MAX;
+  return 0.5f * kernellog(ratio);
+}
+
+// linear interpolation on a uniform axis, clamped to the first/last node
+inline float kernellookup(const float *nodes, int last, float x) {
+  x = x > 0.f ? x : 0.f;
+  x = x < (float) last ? x : (float) last;
+  int i = (int) x;
+  i = i < last - 1 ? i : last - 1;
+  float f = x - (float) i;
+  return nodes[i] + f * (nodes[i + 1] - nodes[i]);
+}
+} // namespace
+
+//____________________________________________________________________________..
+bool WeightKernel::HasAVX2() {
+#ifdef WEIGHTKERNEL_X86
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+//____________________________________________________________________________..
+void WeightKernel::SetIsa(Isa isa) {
+  m_isa = (isa == kAVX2 && HasAVX2()) ? kAVX2 : kScalar;
+}
+
+//____________________________________________________________________________..
+void WeightKernel::SetEtaRange(float mineta, float maxeta) {
+  m_etaratiomin = std::exp(2.f * mineta);
+  m_etaratiomax = std::exp(2.f * maxeta);
+}
+
+//____________________________________________________________________________..
+void WeightKernel::Compile(int unitptrow, int unityrow) {
+  assert(m_ptcurves && m_ptcurves->IsBuilt());
+  m_nspecies = m_terms[0].size();
+  const int npt = m_ptcurves->GetNPtNodes();
+  const int ny = m_yshapes ? m_yshapes->GetNPtNodes() : 0;
+  for (int k = 0; k < 2; k++) {
+    m_ptoffset[k].resize(m_nspecies + 1);
+    m_yoffset[k].resize(m_nspecies + 1);
+    m_fraction[k].resize(m_nspecies + 1);
+    m_invnorm[k].resize(m_nspecies + 1);
+    for (int sp = 0; sp <= m_nspecies; sp++) {
+      Term term;
+      if (sp < m_nspecies) {
+        term = m_terms[k][sp];
+      } else {
+        // the unit species, 1 x (row of ones) + 0
+        term.ptrow = unitptrow;
+        term.yrow = unityrow;
+        term.fraction = k == 0 ? 1 : 0;
+      }
+      if (!m_yshapes) {
+        term.yrow = 0;
+        term.invnorm = 1;
+      }
+      m_ptoffset[k][sp] = term.ptrow * npt;
+      m_yoffset[k][sp] = term.yrow * ny;
+      m_fraction[k][sp] = term.fraction;
+      m_invnorm[k][sp] = term.invnorm;
+    }
+  }
+}
+
+//____________________________________________________________________________..
+void WeightKernel::Evaluate(WeightBatch &batch) const {
+  batch.resizeoutputs();
+  Evaluate(batch, 0, batch.size());
+}
+
+//____________________________________________________________________________..
+void WeightKernel::Evaluate(WeightBatch &batch, int begin, int end) const {
+  assert((int) batch.weight.size() >= end);
+#ifdef WEIGHTKERNEL_X86
+  if (m_isa == kAVX2) {
+    int blockend = begin + (end - begin) / 8 * 8;
+    evaluateavx2(batch, begin, blockend);
+    begin = blockend;
+  }
+#endif
+  evaluatescalar(batch, begin, end);
+}
+
+//____________________________________________________________________________..
+void WeightKernel::evaluatescalar(WeightBatch &batch, int begin,
+                                  int end) const {
+  const float *ptnodes = m_ptcurves->GetRow(0);
+  const int ptlast = m_ptcurves->GetNPtNodes() - 1;
+  const float ptmin = m_ptcurves->GetPtMin();
+  const float ptscale = m_ptcurves->GetInvStep();
+  const float *ynodes = m_yshapes ? m_yshapes->GetRow(0) : nullptr;
+  const int ylast = m_yshapes ? m_yshapes->GetNPtNodes() - 1 : 0;
+  const float ymin = m_yshapes ? m_yshapes->GetPtMin() : 0;
+  const float yscale = m_yshapes ? m_yshapes->GetInvStep() : 0;
+
+  for (int i = begin; i < end; i++) {
+    float px = batch.px[i];
+    float py = batch.py[i];
+    float pz = batch.pz[i];
+    float pt = std::sqrt(px * px + py * py);
+    float p = std::sqrt(pt * pt + pz * pz);
+    float a = p + pz;
+    float b = p - pz;
+    batch.accepted[i] = (a >= b * m_etaratiomin) && (a <= b * m_etaratiomax);
+
+    float ptx = (pt - ptmin) * ptscale;
+    float yx = 0;
+    if (ynodes)
+      yx = (kernelabsy(batch.e[i], pz) - ymin) * yscale;
+
+    int sp = batch.species[i];
+    float weight = 0;
+    for (int k = 0; k < 2; k++) {
+      float t = kernellookup(ptnodes + m_ptoffset[k][sp], ptlast, ptx);
+      if (ynodes)
+        t = t * kernellookup(ynodes + m_yoffset[k][sp], ylast, yx);
+      t = t * m_invnorm[k][sp];
+      weight = weight + m_fraction[k][sp] * t;
+    }
+    batch.weight[i] = weight;
+  }
+}
+
+#ifdef WEIGHTKERNEL_X86
+namespace {
+__attribute__((target("avx2"))) inline __m256 avx2log(__m256 x) {
+  const __m256 one = _mm256_set1_ps(1.f);
+  __m256i bits = _mm256_castps_si256(x);
+  __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(
+      _mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+  bits = _mm256_or_si256(
+      _mm256_and_si256(bits, _mm256_set1_epi32((int) 0x807fffffu)),
+      _mm256_set1_epi32(0x3f000000));
+  __m256 m = _mm256_castsi256_ps(bits);
+  __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(logsqrthf), _CMP_LT_OQ);
+  e = _mm256_blendv_ps(e, _mm256_sub_ps(e, one), small);
+  m = _mm256_blendv_ps(m, _mm256_add_ps(m, m), small);
+  m = _mm256_sub_ps(m, one);
+  __m256 z = _mm256_mul_ps(m, m);
+  __m256 y = _mm256_set1_ps(logp[0]);
+  for (int i = 1; i < 9; i++)
+    y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(logp[i]));
+  y = _mm256_mul_ps(y, m);
+  y = _mm256_mul_ps(y, z);
+  y = _mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(logq1)));
+  y = _mm256_sub_ps(y, _mm256_mul_ps(_mm256_set1_ps(0.5f), z));
+  __m256 r = _mm256_add_ps(m, y);
+  r = _mm256_add_ps(r, _mm256_mul_ps(e, _mm256_set1_ps(logq2)));
+  return r;
+}
+
+__attribute__((target("avx2"))) inline __m256
+avx2lookup(const float *nodes, __m256i offset, int last, __m256 x) {
+  x = _mm256_max_ps(x, _mm256_setzero_ps());
+  x = _mm256_min_ps(x, _mm256_set1_ps((float) last));
+  __m256i i = _mm256_cvttps_epi32(x);
+  i = _mm256_min_epi32(i, _mm256_set1_epi32(last - 1));
+  __m256 f = _mm256_sub_ps(x, _mm256_cvtepi32_ps(i));
+  __m256i index = _mm256_add_epi32(offset, i);
+  __m256 lo = _mm256_i32gather_ps(nodes, index, 4);
+  __m256 hi = _mm256_i32gather_ps(nodes + 1, index, 4);
+  return _mm256_add_ps(lo, _mm256_mul_ps(f, _mm256_sub_ps(hi, lo)));
+}
+} // namespace
+
+//____________________________________________________________________________..
+__attribute__((target("avx2"))) void
+WeightKernel::evaluateavx2(WeightBatch &batch, int begin, int end) const {
+  const float *ptnodes = m_ptcurves->GetRow(0);
+  const int ptlast = m_ptcurves->GetNPtNodes() - 1;
+  const float ptmin = m_ptcurves->GetPtMin();
+  const float ptscale = m_ptcurves->GetInvStep();
+  const float *ynodes = m_yshapes ? m_yshapes->GetRow(0) : nullptr;
+  const int ylast = m_yshapes ? m_yshapes->GetNPtNodes() - 1 : 0;
+  const float ymin = m_yshapes ? m_yshapes->GetPtMin() : 0;
+  const float yscale = m_yshapes ? m_yshapes->GetInvStep() : 0;
+
+  const __m256 vptmin = _mm256_set1_ps(ptmin);
+  const __m256 vptscale = _mm256_set1_ps(ptscale);
+  const __m256 vymin = _mm256_set1_ps(ymin);
+  const __m256 vyscale = _mm256_set1_ps(yscale);
+  const __m256 vetamin = _mm256_set1_ps(m_etaratiomin);
+  const __m256 vetamax = _mm256_set1_ps(m_etaratiomax);
+  const __m256 vzero = _mm256_setzero_ps();
+  const __m256 vhalf = _mm256_set1_ps(0.5f);
+  const __m256 vfltmax = _mm256_set1_ps(FLT_MAX);
+  const __m256 vsign = _mm256_set1_ps(-0.f);
+
+  for (int i = begin; i < end; i += 8) {
+    __m256 px = _mm256_loadu_ps(&batch.px[i]);
+    __m256 py = _mm256_loadu_ps(&batch.py[i]);
+    __m256 pz = _mm256_loadu_ps(&batch.pz[i]);
+    __m256 pt = _mm256_sqrt_ps(
+        _mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py)));
+    __m256 p = _mm256_sqrt_ps(
+        _mm256_add_ps(_mm256_mul_ps(pt, pt), _mm256_mul_ps(pz, pz)));
+    __m256 a = _mm256_add_ps(p, pz);
+    __m256 b = _mm256_sub_ps(p, pz);
+    __m256 acc = _mm256_and_ps(
+        _mm256_cmp_ps(a, _mm256_mul_ps(b, vetamin), _CMP_GE_OQ),
+        _mm256_cmp_ps(a, _mm256_mul_ps(b, vetamax), _CMP_LE_OQ));
+    int mask = _mm256_movemask_ps(acc);
+    for (int k = 0; k < 8; k++)
+      batch.accepted[i + k] = (mask >> k) & 1;
+
+    __m256 ptx = _mm256_mul_ps(_mm256_sub_ps(pt, vptmin), vptscale);
+    __m256 yx = vzero;
+    if (ynodes) {
+      __m256 e = _mm256_loadu_ps(&batch.e[i]);
+      __m256 apz = _mm256_andnot_ps(vsign, pz);
+      __m256 ratio =
+          _mm256_div_ps(_mm256_add_ps(e, apz), _mm256_sub_ps(e, apz));
+      __m256 valid =
+          _mm256_and_ps(_mm256_cmp_ps(ratio, vzero, _CMP_GT_OQ),
+                        _mm256_cmp_ps(ratio, vfltmax, _CMP_LE_OQ));
+      // keep the log argument finite in the masked lanes
+      __m256 absy = _mm256_mul_ps(
+          vhalf, avx2log(_mm256_blendv_ps(_mm256_set1_ps(1.f), ratio, valid)));
+      absy = _mm256_blendv_ps(vfltmax, absy, valid);
+      yx = _mm256_mul_ps(_mm256_sub_ps(absy, vymin), vyscale);
+    }
+
+    __m256i sp = _mm256_loadu_si256((const __m256i *) &batch.species[i]);
+    __m256 weight = vzero;
+    for (int k = 0; k < 2; k++) {
+      __m256i ptoffset = _mm256_i32gather_epi32(m_ptoffset[k].data(), sp, 4);
+      __m256 t = avx2lookup(ptnodes, ptoffset, ptlast, ptx);
+      if (ynodes) {
+        __m256i yoffset = _mm256_i32gather_epi32(m_yoffset[k].data(), sp, 4);
+        t = _mm256_mul_ps(t, avx2lookup(ynodes, yoffset, ylast, yx));
+      }
+      t = _mm256_mul_ps(t, _mm256_i32gather_ps(m_invnorm[k].data(), sp, 4));
+      weight = _mm256_add_ps(
+          weight,
+          _mm256_mul_ps(_mm256_i32gather_ps(m_fraction[k].data(), sp, 4), t));
+    }
+    _mm256_storeu_ps(&batch.weight[i], weight);
+  }
+}
+#else
+//____________________________________________________________________________..
+void WeightKernel::evaluateavx2(WeightBatch &batch, int begin, int end) const {
+  evaluatescalar(batch, begin, end);
+}
+#endif
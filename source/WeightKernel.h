@@ -0,0 +1,149 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef WEIGHTKERNEL_H
+#define WEIGHTKERNEL_H
+
+#include <vector>
+
+class WeightGrid;
+
+// structure-of-arrays kinematics of the primaries of one event and the
+// kernel results; clear() keeps the capacity for the next event
+struct WeightBatch
+{
+    std::vector<float> px;
+    std::vector<float> py;
+    std::vector<float> pz;
+    std::vector<float> e;
+    // compiled species index, WeightKernel::GetUnitSpecies() for no correction
+    std::vector<int> species;
+
+    std::vector<float> weight;
+    std::vector<unsigned char> accepted;
+
+    int size() const { return px.size(); }
+
+    void clear()
+    {
+        px.clear();
+        py.clear();
+        pz.clear();
+        e.clear();
+        species.clear();
+    }
+
+    // outputs only grow, so a batch no larger than a previous one does not allocate
+    void resizeoutputs()
+    {
+        if (weight.size() < px.size())
+        {
+            weight.resize(px.size());
+            accepted.resize(px.size());
+        }
+    }
+
+    // inputs and outputs sized for n entries, to be filled by index
+    void resize(int n)
+    {
+        px.resize(n);
+        py.resize(n);
+        pz.resize(n);
+        e.resize(n);
+        species.resize(n);
+        resizeoutputs();
+    }
+
+    void push_back(float x, float y, float z, float energy, int sp)
+    {
+        px.push_back(x);
+        py.push_back(y);
+        pz.push_back(z);
+        e.push_back(energy);
+        species.push_back(sp);
+    }
+};
+
+// Evaluates eta acceptance, |y| and the correction weight of a whole batch
+// from the per-event pt curves and the |y| shapes. Each species is compiled
+// into at most two (pt row, |y| row, fraction, 1/norm) terms; rows that do
+// not apply point to a row of ones, so every lane runs the same code. The
+// AVX2 version does 8 primaries at a time and is picked at runtime when the
+// CPU supports it; both versions do the same float operations in the same
+// order and give identical results.
+class WeightKernel
+{
+public:
+    enum Isa
+    {
+        kScalar = 0,
+        kAVX2
+    };
+
+    struct Term
+    {
+        int ptrow = 0;
+        int yrow = 0;
+        float fraction = 0;
+        float invnorm = 1;
+    };
+
+    WeightKernel() = default;
+    ~WeightKernel() = default;
+
+    static bool HasAVX2();
+    static const char *GetIsaName(Isa isa) { return isa == kAVX2 ? "AVX2" : "scalar"; }
+
+    // best supported instruction set unless forced to scalar
+    void SetIsa(Isa isa);
+    Isa GetIsa() const { return m_isa; }
+
+    // curves are referenced, not copied, and must outlive the kernel calls
+    void SetPtCurves(const WeightGrid *curves) { m_ptcurves = curves; }
+    void SetRapidityShapes(const WeightGrid *shapes) { m_yshapes = shapes; }
+    void SetEtaRange(float mineta, float maxeta);
+
+    // per species terms, the unit species (weight 1) is appended by Compile()
+    void ClearSpecies()
+    {
+        m_terms[0].clear();
+        m_terms[1].clear();
+    }
+    void AddSpecies(const Term &term1, const Term &term2)
+    {
+        m_terms[0].push_back(term1);
+        m_terms[1].push_back(term2);
+    }
+    // call after the curves are built, unitptrow/unityrow are the rows of ones
+    void Compile(int unitptrow, int unityrow);
+
+    int GetUnitSpecies() const { return m_nspecies; }
+
+    // fills batch.weight and batch.accepted for all entries
+    void Evaluate(WeightBatch &batch) const;
+    // only entries [begin, end), the outputs must already be sized
+    void Evaluate(WeightBatch &batch, int begin, int end) const;
+
+private:
+    void evaluatescalar(WeightBatch &batch, int begin, int end) const;
+    void evaluateavx2(WeightBatch &batch, int begin, int end) const;
+
+    Isa m_isa = kScalar;
+
+    const WeightGrid *m_ptcurves = nullptr;
+    const WeightGrid *m_yshapes = nullptr;
+
+    // eta in [min, max] <=> (p + pz) / (p - pz) in [exp(2 min), exp(2 max)]
+    float m_etaratiomin = 0;
+    float m_etaratiomax = 0;
+
+    std::vector<Term> m_terms[2];
+    int m_nspecies = 0;
+
+    // compiled terms, indexed by species, offsets in units of floats
+    std::vector<int> m_ptoffset[2];
+    std::vector<int> m_yoffset[2];
+    std::vector<float> m_fraction[2];
+    std::vector<float> m_invnorm[2];
+};
+
+#endif // WEIGHTKERNEL_H
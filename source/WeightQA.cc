@@ -0,0 +1,227 @@
+#include "WeightQA.h"
+
+#include <TFile.h>
+#include <TH1.h>
+
+#include <cmath>
+#include <fstream>
+
+namespace {
+const float ptmax = 10;
+const float weightmax = 2;
+const float ratiomin = 0.5;
+const float ratiomax = 1.5;
+
+// bin of x in [lo, hi), 0 and nbins + 1 for under- and overflow
+int findbin(double x, float lo, float hi, int nbins) {
+  if (!(x >= lo))
+    return 0;
+  if (x >= hi)
+    return nbins + 1;
+  int bin = 1 + (int) (nbins * (x - lo) / (hi - lo));
+  return bin > nbins ? nbins : bin;
+}
+} // namespace
+
+//____________________________________________________________________________..
+void WeightQA::Setup(const std::vector<std::string> &speciesnames,
+                     const std::vector<std::string> &containernames,
+                     const float *centavg) {
+  m_speciesnames = speciesnames;
+  m_containernames = containernames;
+  for (int i = 0; i < ncentbins; i++)
+    m_centavg[i] = centavg[i];
+  const int nspecies = speciesnames.size();
+  m_ptentries.assign(nspecies * ncentbins * nptbins, 0);
+  m_ptsumw.assign(nspecies * ncentbins * nptbins, 0);
+  m_ptsumw2.assign(nspecies * ncentbins * nptbins, 0);
+  m_weights.assign(nspecies * (nweightbins + 2), 0);
+  m_edep.assign(containernames.size(), RatioSum());
+  m_truth = RatioSum();
+  m_nevents = 0;
+  m_truthevents = 0;
+}
+
+//____________________________________________________________________________..
+void WeightQA::BeginEvent(int npart) {
+  m_nevents++;
+  m_centbin = 0;
+  for (int i = 1; i < ncentbins; i++) {
+    if (std::fabs(npart - m_centavg[i]) < std::fabs(npart - m_centavg[m_centbin]))
+      m_centbin = i;
+  }
+}
+
+//____________________________________________________________________________..
+void WeightQA::FillPrimary(int species, double px, double py, float weight) {
+  if (species < 0)
+    return;
+  int ptbin = findbin(std::sqrt(px * px + py * py), 0, ptmax, nptbins);
+  if (ptbin >= 1 && ptbin <= nptbins) {
+    int i = (species * ncentbins + m_centbin) * nptbins + ptbin - 1;
+    m_ptentries[i]++;
+    m_ptsumw[i] += weight;
+    m_ptsumw2[i] += (double) weight * weight;
+  }
+  m_weights[species * (nweightbins + 2) +
+            findbin(weight, 0, weightmax, nweightbins)]++;
+}
+
+//____________________________________________________________________________..
+void WeightQA::FillEdep(int container, double before, double after) {
+  fillratio(m_edep[container], before, after);
+}
+
+//____________________________________________________________________________..
+void WeightQA::FillTruth(double before, double after) {
+  m_truthevents++;
+  fillratio(m_truth, before, after);
+}
+
+//____________________________________________________________________________..
+void WeightQA::fillratio(RatioSum &sum, double before, double after) {
+  sum.before += before;
+  sum.after += after;
+  if (before > 0)
+    sum.ratio[findbin(after / before, ratiomin, ratiomax, nratiobins)]++;
+}
+
+//____________________________________________________________________________..
+bool WeightQA::Write(const std::string &filename) const {
+  const std::string ext = ".root";
+  if (filename.size() > ext.size() &&
+      filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0)
+    return writeroot(filename);
+  return writejson(filename);
+}
+
+//____________________________________________________________________________..
+bool WeightQA::writeroot(const std::string &filename) const {
+  TFile *file = new TFile(filename.c_str(), "RECREATE");
+  if (file->IsZombie()) {
+    std::cout << "WeightQA::Write() cannot create " << filename << std::endl;
+    delete file;
+    return false;
+  }
+  // the histograms belong to the file and are deleted with it
+  for (unsigned int species = 0; species < m_speciesnames.size(); species++) {
+    const char *name = m_speciesnames[species].c_str();
+    for (int cent = 0; cent < ncentbins; cent++) {
+      TH1D *h = new TH1D(Form("hweightpt_%s_cent%d", name, cent),
+                         Form("mean weight, %s, centrality bin %d;p_{T} "
+                              "[GeV];weight",
+                              name, cent),
+                         nptbins, 0, ptmax);
+      for (int bin = 1; bin <= nptbins; bin++) {
+        int i = (species * ncentbins + cent) * nptbins + bin - 1;
+        unsigned long n = m_ptentries[i];
+        if (n == 0)
+          continue;
+        double mean = m_ptsumw[i] / n;
+        double var = m_ptsumw2[i] / n - mean * mean;
+        h->SetBinContent(bin, mean);
+        h->SetBinError(bin, var > 0 ? std::sqrt(var / n) : 0);
+      }
+      h->Write();
+    }
+    TH1D *h = new TH1D(Form("hweight_%s", name),
+                       Form("weight, %s;weight;primaries", name), nweightbins,
+                       0, weightmax);
+    for (int bin = 0; bin <= nweightbins + 1; bin++)
+      h->SetBinContent(bin, m_weights[species * (nweightbins + 2) + bin]);
+    h->Write();
+  }
+
+  for (unsigned int icont = 0; icont <= m_edep.size(); icont++) {
+    // the truth energy after the containers
+    bool truth = icont == m_edep.size();
+    if (truth && m_truthevents == 0)
+      continue;
+    const RatioSum &sum = truth ? m_truth : m_edep[icont];
+    const char *name = truth ? "truth" : m_containernames[icont].c_str();
+    TH1D *h = new TH1D(Form("hratio_%s", name),
+                       Form("after/before per event, %s;ratio;events", name),
+                       nratiobins, ratiomin, ratiomax);
+    for (int bin = 0; bin <= nratiobins + 1; bin++)
+      h->SetBinContent(bin, sum.ratio[bin]);
+    h->Write();
+    TH1D *htotal = new TH1D(Form("htotal_%s", name),
+                            Form("total energy before (1) and after (2), %s",
+                                 name),
+                            2, 0.5, 2.5);
+    htotal->SetBinContent(1, sum.before);
+    htotal->SetBinContent(2, sum.after);
+    htotal->Write();
+  }
+  TH1D *hevents = new TH1D("hevents", "sampled events", 1, 0.5, 1.5);
+  hevents->SetBinContent(1, m_nevents);
+  hevents->Write();
+  file->Close();
+  delete file;
+  return true;
+}
+
+//____________________________________________________________________________..
+bool WeightQA::writejson(const std::string &filename) const {
+  std::ofstream out(filename);
+  if (!out.good()) {
+    std::cout << "WeightQA::Write() cannot create " << filename << std::endl;
+    return false;
+  }
+  out << "{\"events\": " << m_nevents << ", \"prescale\": " << m_prescale
+      << ", \"ptmax\": " << ptmax << ", \"weightmax\": " << weightmax
+      << ", \"ratiomin\": " << ratiomin << ", \"ratiomax\": " << ratiomax;
+  // per species and centrality bin the entries and mean weight of each pt bin
+  out << ", \"weight_pt\": {";
+  for (unsigned int species = 0; species < m_speciesnames.size(); species++) {
+    out << (species ? ", " : "") << "\"" << m_speciesnames[species] << "\": [";
+    for (int cent = 0; cent < ncentbins; cent++) {
+      out << (cent ? ", " : "") << "[";
+      for (int bin = 0; bin < nptbins; bin++) {
+        int i = (species * ncentbins + cent) * nptbins + bin;
+        unsigned long n = m_ptentries[i];
+        out << (bin ? ", " : "") << "[" << n << ", "
+            << (n ? m_ptsumw[i] / n : 0.) << "]";
+      }
+      out << "]";
+    }
+    out << "]";
+  }
+  out << "}, \"weight\": {";
+  for (unsigned int species = 0; species < m_speciesnames.size(); species++) {
+    out << (species ? ", " : "") << "\"" << m_speciesnames[species] << "\": [";
+    for (int bin = 0; bin <= nweightbins + 1; bin++)
+      out << (bin ? ", " : "") << m_weights[species * (nweightbins + 2) + bin];
+    out << "]";
+  }
+  out << "}, \"energy\": {";
+  for (unsigned int icont = 0; icont <= m_edep.size(); icont++) {
+    bool truth = icont == m_edep.size();
+    if (truth && m_truthevents == 0)
+      continue;
+    const RatioSum &sum = truth ? m_truth : m_edep[icont];
+    out << (icont ? ", " : "") << "\""
+        << (truth ? "truth" : m_containernames[icont])
+        << "\": {\"before\": " << sum.before << ", \"after\": " << sum.after
+        << ", \"ratio\": [";
+    for (int bin = 0; bin <= nratiobins + 1; bin++)
+      out << (bin ? ", " : "") << sum.ratio[bin];
+    out << "]}";
+  }
+  out << "}}" << std::endl;
+  return out.good();
+}
+
+//____________________________________________________________________________..
+void WeightQA::Print(std::ostream &os) const {
+  os << "WeightQA: " << m_nevents << " sampled events, 1 in " << m_prescale
+     << std::endl;
+  for (unsigned int icont = 0; icont < m_edep.size(); icont++) {
+    if (m_edep[icont].before > 0)
+      os << "  " << m_containernames[icont] << " edep after/before "
+         << m_edep[icont].after / m_edep[icont].before << std::endl;
+  }
+  if (m_truthevents > 0 && m_truth.before > 0)
+    os << "  truth energy after/before " << m_truth.after / m_truth.before
+       << std::endl;
+}
@@ -0,0 +1,85 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef WEIGHTQA_H
+#define WEIGHTQA_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// QA summaries of the applied weights for production monitoring: the mean
+// weight vs pt per species and centrality bin, the weight distribution per
+// species, the total edep of each hit container before and after the
+// reweighting and the energy of the primaries before and after the truth
+// upweighting. Only every prescale-th event is filled, from the primary
+// weights and the hits of that event, so the reweighting loops themselves
+// are untouched. While running these are plain fixed-bin counters, pt in
+// [0, 10) GeV, weights in [0, 2) and after/before ratios in [0.5, 1.5);
+// Write() turns them into histograms (file name ending in .root) or one JSON
+// object.
+class WeightQA
+{
+public:
+    static const int ncentbins = 5;
+    static const int nptbins = 40;
+    static const int nweightbins = 100;
+    static const int nratiobins = 100;
+
+    WeightQA() = default;
+    ~WeightQA() = default;
+
+    // centavg: Npart averages of the centrality bins, an event goes to the
+    // bin with the closest average
+    void Setup(const std::vector<std::string> &speciesnames, const std::vector<std::string> &containernames, const float *centavg);
+    void SetPrescale(int prescale) { m_prescale = prescale > 0 ? prescale : 1; }
+    int GetPrescale() const { return m_prescale; }
+
+    // event counter starting at 1
+    bool Sample(unsigned int event) const { return (event - 1) % m_prescale == 0; }
+
+    // all Fill() calls until the next BeginEvent() belong to this event
+    void BeginEvent(int npart);
+    // weight of one accepted primary, species -1 is not filled
+    void FillPrimary(int species, double px, double py, float weight);
+    void FillEdep(int container, double before, double after);
+    void FillTruth(double before, double after);
+
+    unsigned long GetNEvents() const { return m_nevents; }
+    int GetCentBin() const { return m_centbin; }
+
+    bool Write(const std::string &filename) const;
+    void Print(std::ostream &os = std::cout) const;
+
+private:
+    // totals and the binned per-event after/before ratio of one quantity
+    struct RatioSum
+    {
+        double before = 0;
+        double after = 0;
+        unsigned long ratio[nratiobins + 2] = {0};
+    };
+    static void fillratio(RatioSum &sum, double before, double after);
+
+    bool writeroot(const std::string &filename) const;
+    bool writejson(const std::string &filename) const;
+
+    int m_prescale = 1;
+    unsigned long m_nevents = 0;
+    int m_centbin = 0;
+
+    std::vector<std::string> m_speciesnames;
+    std::vector<std::string> m_containernames;
+    float m_centavg[ncentbins] = {0};
+
+    // [species][centbin][ptbin], filled with accepted primaries
+    std::vector<unsigned long> m_ptentries;
+    std::vector<double> m_ptsumw;
+    std::vector<double> m_ptsumw2;
+    // [species][weight bin], with under- and overflow
+    std::vector<unsigned long> m_weights;
+    std::vector<RatioSum> m_edep;
+    RatioSum m_truth;
+    unsigned long m_truthevents = 0;
+};
+
+#endif // WEIGHTQA_H
@@ -0,0 +1,107 @@
+#include "WeightSidecar.h"
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <iostream>
+
+//____________________________________________________________________________..
+WeightSidecar::~WeightSidecar() {
+  Close();
+}
+
+//____________________________________________________________________________..
+bool WeightSidecar::OpenWrite(const std::string &filename,
+                              const std::vector<std::string> &variants) {
+  Close();
+  m_file = TFile::Open(filename.c_str(), "RECREATE");
+  if (!m_file || m_file->IsZombie()) {
+    std::cout << "WeightSidecar::OpenWrite() cannot create " << filename
+              << std::endl;
+    delete m_file;
+    m_file = nullptr;
+    return false;
+  }
+  m_writing = true;
+  m_tree = new TTree("weights", "EnergyCorrection primary weights");
+  m_tree->Branch("event", &m_event, "event/I");
+  m_tree->Branch("npart", &m_npart, "npart/I");
+  m_tree->Branch("trkid", &m_trkid);
+  m_tree->Branch("weight", &m_weight);
+  m_variantweights.assign(variants.size(), std::vector<float>());
+  for (unsigned int i = 0; i < variants.size(); i++)
+    m_tree->Branch(("weight_" + variants[i]).c_str(), &m_variantweights[i]);
+  return true;
+}
+
+//____________________________________________________________________________..
+bool WeightSidecar::OpenRead(const std::string &filename,
+                             const std::string &variant) {
+  Close();
+  m_file = TFile::Open(filename.c_str(), "READ");
+  if (!m_file || m_file->IsZombie()) {
+    std::cout << "WeightSidecar::OpenRead() cannot open " << filename
+              << std::endl;
+    delete m_file;
+    m_file = nullptr;
+    return false;
+  }
+  m_tree = (TTree *) m_file->Get("weights");
+  if (!m_tree) {
+    std::cout << "WeightSidecar::OpenRead() no weights tree in " << filename
+              << std::endl;
+    Close();
+    return false;
+  }
+  m_trkidptr = &m_trkid;
+  m_weightptr = &m_weight;
+  m_tree->SetBranchAddress("event", &m_event);
+  m_tree->SetBranchAddress("npart", &m_npart);
+  m_tree->SetBranchAddress("trkid", &m_trkidptr);
+  const std::string weightbranch =
+      variant.empty() ? "weight" : "weight_" + variant;
+  if (!m_tree->GetBranch(weightbranch.c_str())) {
+    std::cout << "WeightSidecar::OpenRead() no weights of variant " << variant
+              << " in " << filename << std::endl;
+    Close();
+    return false;
+  }
+  m_tree->SetBranchAddress(weightbranch.c_str(), &m_weightptr);
+  return true;
+}
+
+//____________________________________________________________________________..
+void WeightSidecar::Close() {
+  if (!m_file)
+    return;
+  if (m_writing) {
+    m_file->cd();
+    m_tree->Write();
+  }
+  m_file->Close();
+  delete m_file;
+  m_file = nullptr;
+  m_tree = nullptr;
+  m_writing = false;
+  m_variantweights.clear();
+}
+
+//____________________________________________________________________________..
+void WeightSidecar::Fill(int event, int npart) {
+  m_event = event;
+  m_npart = npart;
+  m_tree->Fill();
+}
+
+//____________________________________________________________________________..
+long long WeightSidecar::GetEntries() const {
+  return m_tree ? m_tree->GetEntries() : 0;
+}
+
+//____________________________________________________________________________..
+bool WeightSidecar::Read(long long entry) {
+  if (!m_tree || entry < 0 || entry >= m_tree->GetEntries())
+    return false;
+  m_tree->GetEntry(entry);
+  return true;
+}
@@ -0,0 +1,83 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef WEIGHTSIDECAR_H
+#define WEIGHTSIDECAR_H
+
+#include <string>
+#include <vector>
+
+class TFile;
+class TTree;
+
+// Per-event primary weights in a small ROOT file next to the DST, one tree
+// entry per event in processing order: the Npart used and the track id and
+// weight of every primary whose weight differs from 1. Hits of primaries
+// that are not listed keep their energy. Weights of systematic variants are
+// stored next to the nominal one as weight_<variant>, and a primary is
+// listed if any of its weights differs from 1. Events EnergyCorrection
+// aborted have an entry with Npart abortednpart and no primaries. The event
+// id of entry i is i + 1, the input events EnergyCorrection counted.
+class WeightSidecar
+{
+public:
+    static const int abortednpart = -1;
+
+    WeightSidecar() = default;
+    ~WeightSidecar();
+
+    WeightSidecar(const WeightSidecar &) = delete;
+    WeightSidecar &operator=(const WeightSidecar &) = delete;
+
+    bool OpenWrite(const std::string &filename, const std::vector<std::string> &variants = std::vector<std::string>());
+    // GetWeight() returns the weights of variant, the nominal ones if empty
+    bool OpenRead(const std::string &filename, const std::string &variant = "");
+    void Close();
+
+    bool IsWriting() const { return m_writing; }
+    bool IsOpen() const { return m_file != nullptr; }
+
+    // writing
+    void BeginEvent()
+    {
+        m_trkid.clear();
+        m_weight.clear();
+        for (std::vector<float> &weights : m_variantweights)
+            weights.clear();
+    }
+    // variantweights holds one weight per variant given to OpenWrite()
+    void Add(int trkid, float weight, const float *variantweights = nullptr)
+    {
+        m_trkid.push_back(trkid);
+        m_weight.push_back(weight);
+        for (unsigned int i = 0; i < m_variantweights.size(); i++)
+            m_variantweights[i].push_back(variantweights[i]);
+    }
+    void Fill(int event, int npart);
+
+    // reading, false past the last entry
+    long long GetEntries() const;
+    bool Read(long long entry);
+
+    int GetEvent() const { return m_event; }
+    int GetNpart() const { return m_npart; }
+    int GetNPrimaries() const { return m_trkidptr->size(); }
+    int GetTrackId(int i) const { return (*m_trkidptr)[i]; }
+    float GetWeight(int i) const { return (*m_weightptr)[i]; }
+
+private:
+    TFile *m_file = nullptr;
+    TTree *m_tree = nullptr;
+    bool m_writing = false;
+
+    int m_event = 0;
+    int m_npart = -1;
+    std::vector<int> m_trkid;
+    std::vector<float> m_weight;
+    // one per variant, sized at OpenWrite() so the branch addresses stay valid
+    std::vector<std::vector<float>> m_variantweights;
+    // branch addresses of the reader
+    std::vector<int> *m_trkidptr = &m_trkid;
+    std::vector<float> *m_weightptr = &m_weight;
+};
+
+#endif // WEIGHTSIDECAR_H
@@ -0,0 +1,133 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+
+//____________________________________________________________________________..
+void WorkStealingPool::Start(int nthreads) {
+  Stop();
+  if (nthreads <= 1)
+    return;
+  m_stop = false;
+  for (int i = 0; i < nthreads; i++)
+    m_queues.emplace_back(new Queue);
+  // worker 0 is the thread calling ParallelFor()
+  for (int i = 1; i < nthreads; i++)
+    m_threads.emplace_back(&WorkStealingPool::workerloop, this, i);
+}
+
+//____________________________________________________________________________..
+void WorkStealingPool::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (std::thread &thread : m_threads)
+    thread.join();
+  m_threads.clear();
+  m_queues.clear();
+}
+
+//____________________________________________________________________________..
+void WorkStealingPool::parallelfor(int n, int grain, const void *func,
+                                   RangeCall call) {
+  if (n <= 0)
+    return;
+  grain = std::max(grain, 1);
+  const int nworkers = m_queues.size();
+  if (nworkers <= 1 || n <= grain) {
+    call(func, 0, n);
+    return;
+  }
+
+  // the function and the chunk count are published before the first chunk
+  // is queued, the queue mutex orders them for the workers
+  const int nchunks = (n + grain - 1) / grain;
+  m_func = func;
+  m_call = call;
+  m_remaining = nchunks;
+  for (int w = 0; w < nworkers; w++) {
+    int first = (long) nchunks * w / nworkers;
+    int last = (long) nchunks * (w + 1) / nworkers;
+    std::lock_guard<std::mutex> lock(m_queues[w]->mutex);
+    m_queues[w]->chunks.clear();
+    m_queues[w]->head = 0;
+    for (int chunk = first; chunk < last; chunk++) {
+      m_queues[w]->chunks.emplace_back(chunk * grain,
+                                       std::min(n, (chunk + 1) * grain));
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation++;
+  }
+  m_wake.notify_all();
+
+  runchunks(0);
+
+  // wait for the chunks still running and for every worker to leave the loop
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [this] { return m_remaining == 0 && m_busy == 0; });
+  m_func = nullptr;
+  m_call = nullptr;
+}
+
+//____________________________________________________________________________..
+void WorkStealingPool::workerloop(int worker) {
+  unsigned int seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+      if (m_stop)
+        return;
+      seen = m_generation;
+      m_busy++;
+    }
+    runchunks(worker);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_busy--;
+    }
+    m_done.notify_all();
+  }
+}
+
+//____________________________________________________________________________..
+void WorkStealingPool::runchunks(int worker) {
+  const int nworkers = m_queues.size();
+  Chunk chunk;
+  while (true) {
+    bool found = pop(worker, chunk);
+    for (int i = 1; !found && i < nworkers; i++)
+      found = steal((worker + i) % nworkers, chunk);
+    if (!found)
+      return;
+    m_call(m_func, chunk.first, chunk.second);
+    if (m_remaining.fetch_sub(1) == 1) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_done.notify_all();
+    }
+  }
+}
+
+//____________________________________________________________________________..
+bool WorkStealingPool::pop(int worker, Chunk &chunk) {
+  Queue &queue = *m_queues[worker];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.head == queue.chunks.size())
+    return false;
+  chunk = queue.chunks[queue.head++];
+  return true;
+}
+
+//____________________________________________________________________________..
+bool WorkStealingPool::steal(int victim, Chunk &chunk) {
+  Queue &queue = *m_queues[victim];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.head == queue.chunks.size())
+    return false;
+  chunk = queue.chunks.back();
+  queue.chunks.pop_back();
+  return true;
+}
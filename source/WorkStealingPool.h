@@ -0,0 +1,86 @@
+// Tell emacs that this is a C++ source
+//  -*- C++ -*-.
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fixed set of worker threads running parallel loops over an index range.
+// The range is cut into chunks, each worker starts on its own contiguous
+// share and steals from the back of the other queues when it runs dry.
+// The calling thread works as worker 0, ParallelFor() returns when every
+// chunk is done. Which thread runs a chunk is not deterministic, so the
+// loop body must only write to its own indices. Nothing is allocated once
+// the queues have held the largest loop: the body is called through a plain
+// pointer, not copied into a std::function, and the queues keep their
+// capacity.
+class WorkStealingPool
+{
+public:
+    WorkStealingPool() = default;
+    ~WorkStealingPool() { Stop(); }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    // nthreads including the calling thread, 1 runs everything inline
+    void Start(int nthreads);
+    void Stop();
+
+    int GetNThreads() const { return m_queues.empty() ? 1 : m_queues.size(); }
+
+    // func(begin, end) on chunks of at most grain indices covering [0, n)
+    template <class Function>
+    void ParallelFor(int n, int grain, const Function &func)
+    {
+        parallelfor(n, grain, &func, &callrange<Function>);
+    }
+
+private:
+    typedef std::pair<int, int> Chunk;
+    typedef void (*RangeCall)(const void *func, int begin, int end);
+
+    template <class Function>
+    static void callrange(const void *func, int begin, int end)
+    {
+        (*static_cast<const Function *>(func))(begin, end);
+    }
+
+    void parallelfor(int n, int grain, const void *func, RangeCall call);
+
+    // chunks [head, size) are queued, the owner pops at head and thieves at
+    // the back; refilled only when every queue is empty
+    struct Queue
+    {
+        std::mutex mutex;
+        std::vector<Chunk> chunks;
+        unsigned int head = 0;
+    };
+
+    void workerloop(int worker);
+    void runchunks(int worker);
+    bool pop(int worker, Chunk &chunk);
+    bool steal(int victim, Chunk &chunk);
+
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    unsigned int m_generation = 0;
+    int m_busy = 0;
+    bool m_stop = false;
+
+    const void *m_func = nullptr;
+    RangeCall m_call = nullptr;
+    std::atomic<int> m_remaining{0};
+};
+
+#endif // WORKSTEALINGPOOL_H